@@ -37,14 +37,15 @@ class simDetector(AsynPort):
         HEIGHT = Simple('Image Height', int),
         DATATYPE = Enum('Datatype', NDDataTypes),
         BUFFERS = Simple('Maximum number of NDArray buffers to be created for plugin callbacks', int),
-        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins', int))
+        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins; may be more than 2 GB', float))
 
     # Device attributes
     LibFileList = ['simDetector']
     DbdFileList = ['simDetectorSupport']
 
     def Initialise(self):
-        print('# simDetectorConfig(portName, maxSizeX, maxSizeY, dataType, maxBuffers, maxMemory)')
-        print('simDetectorConfig("%(PORT)s", %(WIDTH)s, %(HEIGHT)s, %(DATATYPE)d, %(BUFFERS)d, %(MEMORY)d)' % self.__dict__)
+        print('# simDetectorConfig(portName, maxSizeX, maxSizeY, dataType, maxBuffers, maxMemory,')
+        print('#                   priority, stackSize, ringDepth, numRenderThreads, maxThreads, numModules)')
+        print('simDetectorConfig("%(PORT)s", %(WIDTH)s, %(HEIGHT)s, %(DATATYPE)d, %(BUFFERS)d, %(MEMORY).0f)' % self.__dict__)
 
 
@@ -40,7 +40,8 @@ asynSetMinTimerPeriod(0.001)
 
 # Create a simDetector driver
 # simDetectorConfig(const char *portName, int maxSizeX, int maxSizeY, int dataType,
-#                   int maxBuffers, int maxMemory, int priority, int stackSize)
+#                   int maxBuffers, int maxMemory, int priority, int stackSize,
+#                   int ringDepth, int numRenderThreads, int maxThreads, int numModules)
 simDetectorConfig("$(PORT)", $(XSIZE), $(YSIZE), 1, 0, 0)
 # To have the rate calculation use a non-zero smoothing factor use the following line
 #dbLoadRecords("simDetector.template",     "P=$(PREFIX),R=cam1:,PORT=$(PORT),ADDR=0,TIMEOUT=1,RATE_SMOOTH=0.2")
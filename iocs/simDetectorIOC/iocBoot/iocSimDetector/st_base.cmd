@@ -40,8 +40,13 @@ asynSetMinTimerPeriod(0.001)
 
 # Create a simDetector driver
 # simDetectorConfig(const char *portName, int maxSizeX, int maxSizeY, int dataType,
-#                   int maxBuffers, int maxMemory, int priority, int stackSize)
+#                   int maxBuffers, int maxMemory, int priority, int stackSize,
+#                   int ringDepth, int numRenderThreads, int maxThreads, int numModules)
 simDetectorConfig("$(PORT)", $(XSIZE), $(YSIZE), 1, 0, 0)
+# To run all the threads of the driver on the CPUs of the first NUMA node, e.g. 0-7, use the following line
+#simDetectorConfigAffinity("$(PORT)", "all", "0-7")
+# To simulate the rings of a powder diffraction pattern, use the following line and set cam1:SimMode to Generator
+#simDetectorConfigGenerator("$(PORT)", "rings", "-1 -1 20 2")
 # To have the rate calculation use a non-zero smoothing factor use the following line
 #dbLoadRecords("simDetector.template",     "P=$(PREFIX),R=cam1:,PORT=$(PORT),ADDR=0,TIMEOUT=1,RATE_SMOOTH=0.2")
 dbLoadRecords("$(ADSIMDETECTOR)/db/simDetector.template","P=$(PREFIX),R=cam1:,PORT=$(PORT),ADDR=0,TIMEOUT=1")
@@ -74,6 +79,11 @@ NDStdArraysConfigure("Image2", 3, 0, "FFT1", 0)
 # This waveform allows transporting 64-bit images, so it can handle any detector data type at the expense of more memory and bandwidth
 dbLoadRecords("NDStdArrays.template", "P=$(PREFIX),R=image2:,PORT=Image2,ADDR=0,TIMEOUT=1,NDARRAY_PORT=FFT1,TYPE=Float64,FTVL=DOUBLE,NELEMENTS=12000000")
 
+# To measure the latency of the frames at the end of a plugin chain, set cam1:LatencyAttributes to Yes
+# and uncomment the following lines
+#NDSimLatencyConfigure("Latency1", 20, 0, "FFT1", 0, 0, 0, 0, 0)
+#dbLoadRecords("$(ADSIMDETECTOR)/db/NDSimLatency.template","P=$(PREFIX),R=Latency1:,PORT=Latency1,ADDR=0,TIMEOUT=1,NDARRAY_PORT=FFT1")
+
 set_requestfile_path("$(ADSIMDETECTOR)/simDetectorApp/Db")
 
 asynSetTraceIOMask("$(PORT)",0,2)
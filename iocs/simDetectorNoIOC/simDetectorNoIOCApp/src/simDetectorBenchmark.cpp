@@ -0,0 +1,274 @@
+/* simDetectorBenchmark.cpp
+ *
+ * Measures how fast a simDetector generates images for each simulation mode, data type, color mode
+ * and image size, outside of an IOC.
+ *
+ * Each configuration is acquired in Multiple mode with AcquireTime=AcquirePeriod=0 and no plugins,
+ * so the time is that of computeImage() plus the publishing overhead of simTask.  The end of each acquisition
+ * is taken from the callback of the Acquire parameter, so the time includes no polling.
+ * The results are printed as a table, as CSV or as JSON, so that they can be compared between versions.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsStdio.h>
+#include <asynPortClient.h>
+#include <simDetector.h>
+
+#ifndef EPICS_LIBCOM_ONLY
+  #include <dbAccess.h>
+#endif
+
+#include "simToolSupport.h"
+
+#define WARMUP_FRAMES 2
+
+static void usage(const char *program)
+{
+  printf("Usage: %s [options]\n"
+         "  -s sizes      Comma-separated image sizes (square), default 256,1024\n"
+         "  -n frames     Number of frames timed for each configuration, default 100\n"
+         "  -m modes      LinearRamp,Peaks,Sine,OffsetNoise,File,Generator or all, default all\n"
+         "  -F file       File replayed in File mode; File mode is skipped without it\n"
+         "  -t types      Int8,UInt8,...,Float64 or all, default UInt8,UInt16,Float32\n"
+         "  -c colors     Mono,RGB1,RGB2,RGB3 or all, default Mono\n"
+         "  -T threads    Number of threads computing each image, default 1\n"
+         "  -N noise      Value of the Noise parameter, default 0\n"
+         "  -f format     text, csv or json, default text\n"
+         "  -o file       Write the results to file instead of stdout\n",
+         program);
+}
+
+/** Result of one configuration */
+typedef struct {
+  int size;
+  int mode;
+  int dataType;
+  int colorMode;
+  int frames;
+  double seconds;
+  double framesPerSecond;
+  double gigabytesPerSecond;
+  double nsPerPixel;
+} benchmarkResult_t;
+
+/** Signals the end of each acquisition, from the callbacks of the Acquire parameter */
+class acquireMonitor {
+public:
+  acquireMonitor() : done_(epicsEventCreate(epicsEventEmpty)) {}
+  void update(int acquire)
+  {
+    if (acquire) return;
+    epicsTimeGetCurrent(&end_);
+    epicsEventSignal(done_);
+  }
+  /** Discards the end of an earlier acquisition */
+  void clear()
+  {
+    while (epicsEventTryWait(done_) == epicsEventWaitOK);
+  }
+  /** Waits until Acquire is 0 and returns the time at which it was set.
+    * The callback is only a hint, so Acquire is also read once a second. */
+  epicsTimeStamp wait(asynPortClient *pClient)
+  {
+    int acquire;
+
+    while (epicsEventWaitWithTimeout(done_, 1.0) != epicsEventWaitOK) {
+      pClient->read(ADAcquireString, &acquire);
+      if (!acquire) {
+        epicsTimeGetCurrent(&end_);
+        break;
+      }
+    }
+    return end_;
+  }
+private:
+  epicsEventId done_;
+  epicsTimeStamp end_;
+};
+
+static void acquireCallback(void *drvPvt, asynUser *pasynUser, epicsInt32 data)
+{
+  ((acquireMonitor *)drvPvt)->update(data);
+}
+
+/** Acquires numFrames frames and returns the elapsed time in seconds */
+static double acquireFrames(asynPortClient *pClient, acquireMonitor *pMonitor, int numFrames)
+{
+  epicsTimeStamp start, end;
+
+  pClient->write(ADNumImagesString, numFrames);
+  pMonitor->clear();
+  epicsTimeGetCurrent(&start);
+  pClient->write(ADAcquireString, 1);
+  end = pMonitor->wait(pClient);
+  return epicsTimeDiffInSeconds(&end, &start);
+}
+
+static void runConfiguration(asynPortClient *pClient, acquireMonitor *pMonitor, int size, int mode, int dataType,
+                             int colorMode, int numFrames, benchmarkResult_t *pResult)
+{
+  int arraySize;
+
+  pClient->write(SimModeString, mode);
+  pClient->write(NDDataTypeString, dataType);
+  pClient->write(NDColorModeString, colorMode);
+  pClient->write(SimResetImageString, 1);
+  /* The first frames allocate the buffers and compute the tables */
+  acquireFrames(pClient, pMonitor, WARMUP_FRAMES);
+  pResult->seconds = acquireFrames(pClient, pMonitor, numFrames);
+  pClient->read(NDArraySizeString, &arraySize);
+
+  pResult->size = size;
+  pResult->mode = mode;
+  pResult->dataType = dataType;
+  pResult->colorMode = colorMode;
+  pResult->frames = numFrames;
+  pResult->framesPerSecond = numFrames / pResult->seconds;
+  pResult->gigabytesPerSecond = (double)arraySize * numFrames / pResult->seconds / 1e9;
+  pResult->nsPerPixel = pResult->seconds * 1e9 / ((double)numFrames * size * size);
+}
+
+/** Columns of the results, in the order of the values of benchmarkValues() */
+static const outputColumn_t benchmarkColumns[] = {
+  {"Size",     "size",         ColumnInteger,  6, 0, 0},
+  {"Mode",     "mode",         ColumnString,  12, 0, 0},
+  {"Type",     "type",         ColumnString,   8, 0, 0},
+  {"Color",    "color",        ColumnString,   5, 0, 0},
+  {"Frames",   "frames",       ColumnInteger,  7, 0, 0},
+  {"Seconds",  "seconds",      ColumnDouble,   0, 0, 6},
+  {"Frames/s", "frames_per_s", ColumnDouble,  10, 1, 3},
+  {"GB/s",     "gb_per_s",     ColumnDouble,   8, 3, 4},
+  {"ns/pixel", "ns_per_pixel", ColumnDouble,   9, 3, 4}
+};
+#define NUM_BENCHMARK_COLUMNS (int)(sizeof(benchmarkColumns)/sizeof(benchmarkColumns[0]))
+
+static void benchmarkValues(const benchmarkResult_t *pResult, outputValue_t *values)
+{
+  memset(values, 0, NUM_BENCHMARK_COLUMNS*sizeof(*values));
+  values[0].integer = pResult->size;
+  values[1].string  = nameOf(modeNames, pResult->mode);
+  values[2].string  = nameOf(dataTypeNames, pResult->dataType);
+  values[3].string  = nameOf(colorModeNames, pResult->colorMode);
+  values[4].integer = pResult->frames;
+  values[5].number  = pResult->seconds;
+  values[6].number  = pResult->framesPerSecond;
+  values[7].number  = pResult->gigabytesPerSecond;
+  values[8].number  = pResult->nsPerPixel;
+}
+
+int main(int argc, char **argv)
+{
+  int sizes[MAX_ITEMS], modes[MAX_ITEMS], dataTypes[MAX_ITEMS], colorModes[MAX_ITEMS];
+  int numSizes, numModes, numDataTypes, numColorModes;
+  int numFrames = 100;
+  int numThreads = 1;
+  double noise = 0.;
+  const char *fileName = 0;
+  outputFormat_t format = FormatText;
+  FILE *fp = stdout;
+  bool first = true;
+  int i, s, m, t, c;
+
+  numSizes      = parseIntegers("256,1024", sizes);
+  numModes      = parseNames("all", modeNames, modes);
+  numDataTypes  = parseNames("UInt8,UInt16,Float32", dataTypeNames, dataTypes);
+  numColorModes = parseNames("Mono", colorModeNames, colorModes);
+
+  for (i=1; i<argc; i++) {
+    const char *value = (i+1 < argc) ? argv[i+1] : 0;
+    if ((strcmp(argv[i], "-h") == 0) || !value) {
+      usage(argv[0]);
+      return (strcmp(argv[i], "-h") == 0) ? 0 : 1;
+    }
+    if      (strcmp(argv[i], "-s") == 0) numSizes      = parseIntegers(value, sizes);
+    else if (strcmp(argv[i], "-n") == 0) numFrames     = atoi(value);
+    else if (strcmp(argv[i], "-m") == 0) numModes      = parseNames(value, modeNames, modes);
+    else if (strcmp(argv[i], "-t") == 0) numDataTypes  = parseNames(value, dataTypeNames, dataTypes);
+    else if (strcmp(argv[i], "-c") == 0) numColorModes = parseNames(value, colorModeNames, colorModes);
+    else if (strcmp(argv[i], "-T") == 0) numThreads    = atoi(value);
+    else if (strcmp(argv[i], "-N") == 0) noise         = atof(value);
+    else if (strcmp(argv[i], "-F") == 0) fileName      = value;
+    else if (strcmp(argv[i], "-f") == 0) {
+      if (!parseFormat(value, &format)) {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-o") == 0) {
+      fp = fopen(value, "w");
+      if (!fp) {
+        perror(value);
+        return 1;
+      }
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+  }
+  if (numFrames < 1) numFrames = 1;
+  if (numThreads < 1) numThreads = 1;
+
+#ifndef EPICS_LIBCOM_ONLY
+  // Must set this for callbacks to work if EPICS_LIBCOM_ONLY is not defined
+  interruptAccept = 1;
+#endif
+
+  printHeader(fp, format, numThreads, benchmarkColumns, NUM_BENCHMARK_COLUMNS);
+  for (s=0; s<numSizes; s++) {
+    char portName[32];
+    epicsSnprintf(portName, sizeof(portName), "SIMBENCH%d", s);
+    // Create a simDetector for this size; the drivers are never deleted
+    simDetector *pSimDetector = new simDetector(portName, sizes[s], sizes[s], NDUInt8, 0, 0, 0, 0, 0, 0, numThreads, 1);
+    pSimDetector->setGenerator("rings", "");
+    asynPortClient *pClient = new asynPortClient(portName);
+    acquireMonitor *pMonitor = new acquireMonitor();
+    asynInt32Client *pAcquire = (asynInt32Client*)pClient->getParamClient(ADAcquireString);
+    pAcquire->registerInterruptUser(acquireCallback, pMonitor);
+    pClient->write(SimNumThreadsString, numThreads);
+    pClient->write(NDArrayCallbacksString, 1);
+    pClient->write(ADImageModeString, ADImageMultiple);
+    pClient->write(ADAcquireTimeString, 0.);
+    pClient->write(ADAcquirePeriodString, 0.);
+    pClient->write(ADGainString, 1.0);
+    pClient->write(SimNoiseString, noise);
+    // A grid of 10x10 peaks covering the image
+    pClient->write(SimPeakStartXString, sizes[s]/20);
+    pClient->write(SimPeakStartYString, sizes[s]/20);
+    pClient->write(SimPeakStepXString, sizes[s]/10);
+    pClient->write(SimPeakStepYString, sizes[s]/10);
+    pClient->write(SimPeakNumXString, 10);
+    pClient->write(SimPeakNumYString, 10);
+    pClient->write(SimPeakWidthXString, 8);
+    pClient->write(SimPeakWidthYString, 8);
+    if (fileName) {
+      asynOctetClient *pFileName = (asynOctetClient*)pClient->getParamClient(SimFileNameString);
+      size_t nActual;
+      pFileName->write(fileName, strlen(fileName), &nActual);
+    }
+    for (m=0; m<numModes; m++) {
+      if ((modes[m] == SimModeFile) && !fileName) continue;
+      for (t=0; t<numDataTypes; t++) {
+        for (c=0; c<numColorModes; c++) {
+          benchmarkResult_t result;
+          outputValue_t values[NUM_BENCHMARK_COLUMNS];
+          runConfiguration(pClient, pMonitor, sizes[s], modes[m], dataTypes[t], colorModes[c], numFrames, &result);
+          benchmarkValues(&result, values);
+          printResult(fp, format, numThreads, benchmarkColumns, NUM_BENCHMARK_COLUMNS, values, first);
+          first = false;
+        }
+      }
+    }
+  }
+  printFooter(fp, format);
+  if (fp != stdout) fclose(fp);
+  return 0;
+}
@@ -103,7 +103,7 @@ simDetectorDemo::simDetectorDemo()
 {
 
   // Create a simDetector driver
-  pSimDetector_ =  new simDetector("SIM1", 1024, 1024, NDUInt8, 0, 0, 0, 0);
+  pSimDetector_ =  new simDetector("SIM1", 1024, 1024, NDUInt8, 0, 0, 0, 0, 0, 0, 0, 1);
   // Create an asynPortClient for the simDetector
   pSimClient_   =  new asynPortClient("SIM1");
   pSimClient_->write(NDArrayCallbacksString, 1);           // Enable NDArray callbacks
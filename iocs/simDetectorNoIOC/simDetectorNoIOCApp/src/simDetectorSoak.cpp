@@ -0,0 +1,455 @@
+/* simDetectorSoak.cpp
+ *
+ * Soak and throughput test of a simDetector feeding a statistics plugin, outside of an IOC.
+ *
+ * Each configuration of image size, data type, simulation mode, frame rate and plugin queue size is acquired
+ * in Continuous mode for a fixed time.  For each configuration the achieved frame rate, the arrays dropped by
+ * the plugin, the high-water mark of the plugin queue and the late frames of the driver are recorded.
+ * The results are printed as a table, as CSV or as JSON.  A CSV file written by an earlier run can be given
+ * as a baseline, and the program then exits with status 2 if a configuration is slower or drops more arrays
+ * than in the baseline, so it can be run unattended, e.g. in nightly performance runs.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsStdio.h>
+#include <asynPortClient.h>
+#include <NDPluginStats.h>
+#include <simDetector.h>
+
+#ifndef EPICS_LIBCOM_ONLY
+  #include <dbAccess.h>
+#endif
+
+#include "simToolSupport.h"
+
+#define MAX_BASELINE 1024
+#define WARMUP_FRAMES 2
+#define DRAIN_TIMEOUT 10.
+/* The fraction of the frames which can be dropped above the baseline without a regression */
+#define DROPPED_SLACK 0.001
+
+static void usage(const char *program)
+{
+  printf("Usage: %s [options]\n"
+         "  -s sizes      Comma-separated image sizes (square), default 1024\n"
+         "  -t types      Int8,UInt8,...,Float64 or all, default UInt8,UInt16\n"
+         "  -m modes      LinearRamp,Peaks,Sine,OffsetNoise,Generator or all, default Peaks\n"
+         "  -r rates      Comma-separated frame rates in Hz, 0 for free run, default 0,100\n"
+         "  -q queues     Comma-separated queue sizes of the plugin, default 2,20\n"
+         "  -d seconds    Time each configuration is acquired for, default 5\n"
+         "  -T threads    Number of threads computing each image, default 1\n"
+         "  -N noise      Value of the Noise parameter, default 0\n"
+         "  -b file       Baseline written by an earlier run with -f csv; exits with 2 on regressions\n"
+         "  -x percent    Tolerance of the comparison with the baseline, default 10\n"
+         "  -f format     text, csv or json, default text\n"
+         "  -o file       Write the results to file instead of stdout\n",
+         program);
+}
+
+/** Result of one configuration */
+typedef struct {
+  int size;
+  int mode;
+  int dataType;
+  double rate;
+  int queueSize;
+  double seconds;
+  int frames;
+  double framesPerSecond;
+  int droppedArrays;
+  int queueHighWater;
+  int lateFrames;
+} soakResult_t;
+
+/** Tracks the high-water mark of the queue of a plugin, from the callbacks and readings of its QueueFree parameter */
+class queueMonitor {
+public:
+  queueMonitor() : mutex_(epicsMutexMustCreate()), minFree_(0) {}
+  void reset(int queueSize)
+  {
+    epicsMutexLock(mutex_);
+    minFree_ = queueSize;
+    epicsMutexUnlock(mutex_);
+  }
+  void update(epicsInt32 queueFree)
+  {
+    epicsMutexLock(mutex_);
+    if (queueFree < minFree_) minFree_ = queueFree;
+    epicsMutexUnlock(mutex_);
+  }
+  int minFree()
+  {
+    int minFree;
+    epicsMutexLock(mutex_);
+    minFree = minFree_;
+    epicsMutexUnlock(mutex_);
+    return minFree;
+  }
+private:
+  epicsMutexId mutex_;
+  int minFree_;
+};
+
+static void queueFreeCallback(void *drvPvt, asynUser *pasynUser, epicsInt32 data)
+{
+  ((queueMonitor *)drvPvt)->update(data);
+}
+
+/** A simDetector and the statistics plugin receiving its arrays */
+typedef struct {
+  simDetector    *pSimDetector;
+  asynPortClient *pSimClient;
+  NDPluginStats  *pStatsPlugin;
+  asynPortClient *pStatsClient;
+  queueMonitor   *pQueue;
+} soakChain_t;
+
+static void createChain(int index, int size, int numThreads, double noise, soakChain_t *pChain)
+{
+  char simPort[32], statsPort[32];
+
+  epicsSnprintf(simPort, sizeof(simPort), "SIMSOAK%d", index);
+  epicsSnprintf(statsPort, sizeof(statsPort), "SOAKSTATS%d", index);
+  // The drivers and plugins are never deleted
+  pChain->pSimDetector = new simDetector(simPort, size, size, NDUInt8, 0, 0, 0, 0, 0, 0, numThreads, 1);
+  pChain->pSimDetector->setGenerator("rings", "");
+  pChain->pSimClient = new asynPortClient(simPort);
+  pChain->pSimClient->write(SimNumThreadsString, numThreads);
+  pChain->pSimClient->write(NDArrayCallbacksString, 1);
+  pChain->pSimClient->write(ADImageModeString, ADImageContinuous);
+  pChain->pSimClient->write(ADAcquireTimeString, 0.);
+  pChain->pSimClient->write(ADGainString, 1.0);
+  pChain->pSimClient->write(SimNoiseString, noise);
+  // A grid of 10x10 peaks covering the image
+  pChain->pSimClient->write(SimPeakStartXString, size/20);
+  pChain->pSimClient->write(SimPeakStartYString, size/20);
+  pChain->pSimClient->write(SimPeakStepXString, size/10);
+  pChain->pSimClient->write(SimPeakStepYString, size/10);
+  pChain->pSimClient->write(SimPeakNumXString, 10);
+  pChain->pSimClient->write(SimPeakNumYString, 10);
+  pChain->pSimClient->write(SimPeakWidthXString, 8);
+  pChain->pSimClient->write(SimPeakWidthYString, 8);
+
+  // Create a statistics plugin getting its data from the simDetector, without blocking callbacks
+  pChain->pStatsPlugin = new NDPluginStats(statsPort, 2, 0, simPort, 0, 0, 0, 0, 0);
+  pChain->pStatsClient = new asynPortClient(statsPort);
+  pChain->pStatsPlugin->start();
+  pChain->pStatsClient->write(NDPluginDriverEnableCallbacksString, 1);
+  pChain->pStatsClient->write(NDPluginStatsComputeStatisticsString, 1);
+
+  pChain->pQueue = new queueMonitor();
+  asynInt32Client *pQueueFree = (asynInt32Client*)pChain->pStatsClient->getParamClient(NDPluginDriverQueueFreeString);
+  pQueueFree->registerInterruptUser(queueFreeCallback, pChain->pQueue);
+}
+
+/** Waits until the plugin has processed all the arrays in its queue; returns false on timeout */
+static bool drainQueue(soakChain_t *pChain, int queueSize)
+{
+  epicsTimeStamp start, now;
+  int queueFree;
+
+  epicsTimeGetCurrent(&start);
+  while (1) {
+    pChain->pStatsClient->read(NDPluginDriverQueueFreeString, &queueFree);
+    if (queueFree >= queueSize) return true;
+    epicsTimeGetCurrent(&now);
+    if (epicsTimeDiffInSeconds(&now, &start) > DRAIN_TIMEOUT) return false;
+    epicsThreadSleep(0.01);
+  }
+}
+
+/** Acquires for a number of seconds, or for numFrames frames if it is greater than 0;
+  * returns the elapsed time in seconds */
+static double acquireFrames(soakChain_t *pChain, double seconds, int numFrames)
+{
+  asynPortClient *pClient = pChain->pSimClient;
+  epicsTimeStamp start, now;
+  int acquire, queueFree;
+
+  pClient->write(ADImageModeString, (numFrames > 0) ? ADImageMultiple : ADImageContinuous);
+  if (numFrames > 0) pClient->write(ADNumImagesString, numFrames);
+  epicsTimeGetCurrent(&start);
+  pClient->write(ADAcquireString, 1);
+  do {
+    epicsThreadSleep(0.001);
+    // The queue is also sampled here, in case QueueFree is only posted at the end of each array
+    pChain->pStatsClient->read(NDPluginDriverQueueFreeString, &queueFree);
+    pChain->pQueue->update(queueFree);
+    epicsTimeGetCurrent(&now);
+    if ((numFrames <= 0) && (epicsTimeDiffInSeconds(&now, &start) >= seconds)) {
+      pClient->write(ADAcquireString, 0);
+      numFrames = 1;
+    }
+    pClient->read(ADAcquireString, &acquire);
+  } while (acquire);
+  epicsTimeGetCurrent(&now);
+  return epicsTimeDiffInSeconds(&now, &start);
+}
+
+static void runConfiguration(soakChain_t *pChain, int size, int mode, int dataType, double rate, int queueSize,
+                             double seconds, soakResult_t *pResult)
+{
+  asynPortClient *pSimClient = pChain->pSimClient;
+  asynPortClient *pStatsClient = pChain->pStatsClient;
+
+  pSimClient->write(SimModeString, mode);
+  pSimClient->write(NDDataTypeString, dataType);
+  pSimClient->write(SimPacingModeString, (rate > 0.) ? SimPacingDeadline : SimPacingFreeRun);
+  pSimClient->write(ADAcquirePeriodString, (rate > 0.) ? 1. / rate : 0.);
+  pSimClient->write(SimResetImageString, 1);
+  // Writing QueueSize recreates the queue of the plugin
+  pStatsClient->write(NDPluginDriverQueueSizeString, queueSize);
+  /* The first frames allocate the buffers and compute the tables */
+  acquireFrames(pChain, 0., WARMUP_FRAMES);
+  if (!drainQueue(pChain, queueSize)) fprintf(stderr, "The queue of the plugin was not drained\n");
+
+  pSimClient->write(NDArrayCounterString, 0);
+  pStatsClient->write(NDPluginDriverDroppedArraysString, 0);
+  pChain->pQueue->reset(queueSize);
+  pResult->seconds = acquireFrames(pChain, seconds, 0);
+  if (!drainQueue(pChain, queueSize)) fprintf(stderr, "The queue of the plugin was not drained\n");
+  pSimClient->read(NDArrayCounterString, &pResult->frames);
+  pSimClient->read(SimLateFramesString, &pResult->lateFrames);
+  pStatsClient->read(NDPluginDriverDroppedArraysString, &pResult->droppedArrays);
+
+  pResult->size = size;
+  pResult->mode = mode;
+  pResult->dataType = dataType;
+  pResult->rate = rate;
+  pResult->queueSize = queueSize;
+  pResult->framesPerSecond = pResult->frames / pResult->seconds;
+  pResult->queueHighWater = queueSize - pChain->pQueue->minFree();
+}
+
+/** Reads the results of a CSV file written with -f csv; returns the number of results */
+static int readBaseline(const char *fileName, soakResult_t *pResults)
+{
+  char line[512];
+  char mode[64], type[64];
+  FILE *fp;
+  int num=0;
+
+  fp = fopen(fileName, "r");
+  if (!fp) {
+    perror(fileName);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fp) && (num < MAX_BASELINE)) {
+    soakResult_t *pResult = &pResults[num];
+    const char *pFields = line;
+    int field;
+    // Skips the version and the number of threads
+    for (field=0; (field < 2) && pFields; field++) {
+      pFields = strchr(pFields, ',');
+      if (pFields) pFields++;
+    }
+    if (!pFields) continue;
+    if (sscanf(pFields, "%d,%63[^,],%63[^,],%lf,%d,%lf,%d,%lf,%d,%d,%d",
+               &pResult->size, mode, type, &pResult->rate, &pResult->queueSize, &pResult->seconds,
+               &pResult->frames, &pResult->framesPerSecond, &pResult->droppedArrays,
+               &pResult->queueHighWater, &pResult->lateFrames) != 11) continue;
+    pResult->mode = valueOf(modeNames, mode);
+    pResult->dataType = valueOf(dataTypeNames, type);
+    num++;
+  }
+  fclose(fp);
+  return num;
+}
+
+/** Returns true if two frame rates are the same, allowing for the rounding of the CSV files */
+static bool sameRate(double rate1, double rate2)
+{
+  return fabs(rate1 - rate2) <= 1e-5 * fabs(rate1 + rate2);
+}
+
+/** Compares a result with the baseline; returns true if it is a regression */
+static bool isRegression(const soakResult_t *pResult, const soakResult_t *pBaseline, int numBaseline,
+                         double tolerance)
+{
+  const soakResult_t *pBase = 0;
+  double droppedFraction, baseFraction;
+  bool regression = false;
+  int i;
+
+  for (i=0; i<numBaseline; i++) {
+    if ((pBaseline[i].size == pResult->size) && (pBaseline[i].mode == pResult->mode) &&
+        (pBaseline[i].dataType == pResult->dataType) && sameRate(pBaseline[i].rate, pResult->rate) &&
+        (pBaseline[i].queueSize == pResult->queueSize)) {
+      pBase = &pBaseline[i];
+      break;
+    }
+  }
+  if (!pBase) {
+    fprintf(stderr, "No baseline for size=%d mode=%s type=%s rate=%g queue=%d\n", pResult->size,
+            nameOf(modeNames, pResult->mode), nameOf(dataTypeNames, pResult->dataType), pResult->rate,
+            pResult->queueSize);
+    return false;
+  }
+  if (pResult->framesPerSecond < pBase->framesPerSecond * (1. - tolerance)) {
+    fprintf(stderr, "Regression: size=%d mode=%s type=%s rate=%g queue=%d: %.1f frames/s, baseline %.1f\n",
+            pResult->size, nameOf(modeNames, pResult->mode), nameOf(dataTypeNames, pResult->dataType),
+            pResult->rate, pResult->queueSize, pResult->framesPerSecond, pBase->framesPerSecond);
+    regression = true;
+  }
+  // The dropped arrays are compared as fractions of the frames, since the number of frames varies
+  droppedFraction = pResult->frames ? (double)pResult->droppedArrays / pResult->frames : 0.;
+  baseFraction = pBase->frames ? (double)pBase->droppedArrays / pBase->frames : 0.;
+  if ((pResult->droppedArrays > pBase->droppedArrays) &&
+      (droppedFraction > baseFraction * (1. + tolerance) + DROPPED_SLACK)) {
+    fprintf(stderr, "Regression: size=%d mode=%s type=%s rate=%g queue=%d: %d of %d arrays dropped, baseline %d of %d\n",
+            pResult->size, nameOf(modeNames, pResult->mode), nameOf(dataTypeNames, pResult->dataType),
+            pResult->rate, pResult->queueSize, pResult->droppedArrays, pResult->frames,
+            pBase->droppedArrays, pBase->frames);
+    regression = true;
+  }
+  return regression;
+}
+
+/** Columns of the results, in the order of the values of soakValues() and of the fields read by readBaseline() */
+static const outputColumn_t soakColumns[] = {
+  {"Size",      "size",         ColumnInteger,  6, 0,  0},
+  {"Mode",      "mode",         ColumnString,  12, 0,  0},
+  {"Type",      "type",         ColumnString,   8, 0,  0},
+  {"Rate",      "rate",         ColumnDouble,   8, 1, -1},
+  {"Queue",     "queue",        ColumnInteger,  5, 0,  0},
+  {"Seconds",   "seconds",      ColumnDouble,   8, 2,  6},
+  {"Frames",    "frames",       ColumnInteger,  8, 0,  0},
+  {"Frames/s",  "frames_per_s", ColumnDouble,  10, 1,  3},
+  {"Dropped",   "dropped",      ColumnInteger,  8, 0,  0},
+  {"HighWater", "high_water",   ColumnInteger,  9, 0,  0},
+  {"Late",      "late",         ColumnInteger,  6, 0,  0}
+};
+#define NUM_SOAK_COLUMNS (int)(sizeof(soakColumns)/sizeof(soakColumns[0]))
+
+static void soakValues(const soakResult_t *pResult, outputValue_t *values)
+{
+  memset(values, 0, NUM_SOAK_COLUMNS*sizeof(*values));
+  values[0].integer  = pResult->size;
+  values[1].string   = nameOf(modeNames, pResult->mode);
+  values[2].string   = nameOf(dataTypeNames, pResult->dataType);
+  values[3].number   = pResult->rate;
+  values[4].integer  = pResult->queueSize;
+  values[5].number   = pResult->seconds;
+  values[6].integer  = pResult->frames;
+  values[7].number   = pResult->framesPerSecond;
+  values[8].integer  = pResult->droppedArrays;
+  values[9].integer  = pResult->queueHighWater;
+  values[10].integer = pResult->lateFrames;
+}
+
+int main(int argc, char **argv)
+{
+  double sizes[MAX_ITEMS], rates[MAX_ITEMS], queueSizes[MAX_ITEMS];
+  int modes[MAX_ITEMS], dataTypes[MAX_ITEMS];
+  int numSizes, numModes, numDataTypes, numRates, numQueueSizes;
+  static soakResult_t baseline[MAX_BASELINE];
+  int numBaseline = 0;
+  const char *baselineFile = 0;
+  double tolerance = 10.;
+  double seconds = 5.;
+  int numThreads = 1;
+  double noise = 0.;
+  outputFormat_t format = FormatText;
+  FILE *fp = stdout;
+  bool first = true;
+  int numRegressions = 0;
+  int i, s, m, t, r, q;
+
+  numSizes      = parseNumbers("1024", sizes);
+  numModes      = parseNames("Peaks", modeNames, modes);
+  numDataTypes  = parseNames("UInt8,UInt16", dataTypeNames, dataTypes);
+  numRates      = parseNumbers("0,100", rates);
+  numQueueSizes = parseNumbers("2,20", queueSizes);
+
+  for (i=1; i<argc; i++) {
+    const char *value = (i+1 < argc) ? argv[i+1] : 0;
+    if ((strcmp(argv[i], "-h") == 0) || !value) {
+      usage(argv[0]);
+      return (strcmp(argv[i], "-h") == 0) ? 0 : 1;
+    }
+    if      (strcmp(argv[i], "-s") == 0) numSizes      = parseNumbers(value, sizes);
+    else if (strcmp(argv[i], "-t") == 0) numDataTypes  = parseNames(value, dataTypeNames, dataTypes);
+    else if (strcmp(argv[i], "-m") == 0) numModes      = parseNames(value, modeNames, modes);
+    else if (strcmp(argv[i], "-r") == 0) numRates      = parseNumbers(value, rates);
+    else if (strcmp(argv[i], "-q") == 0) numQueueSizes = parseNumbers(value, queueSizes);
+    else if (strcmp(argv[i], "-d") == 0) seconds       = atof(value);
+    else if (strcmp(argv[i], "-T") == 0) numThreads    = atoi(value);
+    else if (strcmp(argv[i], "-N") == 0) noise         = atof(value);
+    else if (strcmp(argv[i], "-b") == 0) baselineFile  = value;
+    else if (strcmp(argv[i], "-x") == 0) tolerance     = atof(value);
+    else if (strcmp(argv[i], "-f") == 0) {
+      if (!parseFormat(value, &format)) {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-o") == 0) {
+      fp = fopen(value, "w");
+      if (!fp) {
+        perror(value);
+        return 1;
+      }
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+  }
+  if (seconds <= 0.) seconds = 1.;
+  if (numThreads < 1) numThreads = 1;
+  tolerance /= 100.;
+  if (baselineFile) {
+    numBaseline = readBaseline(baselineFile, baseline);
+    if (numBaseline == 0) {
+      fprintf(stderr, "No results in baseline %s\n", baselineFile);
+      return 1;
+    }
+  }
+
+#ifndef EPICS_LIBCOM_ONLY
+  // Must set this for callbacks to work if EPICS_LIBCOM_ONLY is not defined
+  interruptAccept = 1;
+#endif
+
+  printHeader(fp, format, numThreads, soakColumns, NUM_SOAK_COLUMNS);
+  for (s=0; s<numSizes; s++) {
+    int size = (int)sizes[s];
+    soakChain_t chain;
+    createChain(s, size, numThreads, noise, &chain);
+    for (t=0; t<numDataTypes; t++) {
+      for (m=0; m<numModes; m++) {
+        // File mode needs a file, which is not an option of the soak test
+        if (modes[m] == SimModeFile) continue;
+        for (r=0; r<numRates; r++) {
+          for (q=0; q<numQueueSizes; q++) {
+            soakResult_t result;
+            outputValue_t values[NUM_SOAK_COLUMNS];
+            int queueSize = (int)queueSizes[q];
+            if (queueSize < 1) queueSize = 1;
+            runConfiguration(&chain, size, modes[m], dataTypes[t], rates[r], queueSize, seconds, &result);
+            soakValues(&result, values);
+            printResult(fp, format, numThreads, soakColumns, NUM_SOAK_COLUMNS, values, first);
+            first = false;
+            if (numBaseline && isRegression(&result, baseline, numBaseline, tolerance)) numRegressions++;
+          }
+        }
+      }
+    }
+  }
+  printFooter(fp, format);
+  if (fp != stdout) fclose(fp);
+  if (numRegressions) {
+    fprintf(stderr, "%d regression(s) against baseline %s\n", numRegressions, baselineFile);
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+/* simToolSupport.cpp
+ *
+ * Option parsing and result formatting shared by simDetectorBenchmark and simDetectorSoak.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsString.h>
+#include <simDetector.h>
+
+#include "simToolSupport.h"
+
+const namedValue_t modeNames[] = {
+  {"LinearRamp",  SimModeLinearRamp},
+  {"Peaks",       SimModePeaks},
+  {"Sine",        SimModeSine},
+  {"OffsetNoise", SimModeOffsetNoise},
+  {"File",        SimModeFile},
+  {"Generator",   SimModeGenerator},
+  {0, 0}
+};
+
+const namedValue_t dataTypeNames[] = {
+  {"Int8",    NDInt8},
+  {"UInt8",   NDUInt8},
+  {"Int16",   NDInt16},
+  {"UInt16",  NDUInt16},
+  {"Int32",   NDInt32},
+  {"UInt32",  NDUInt32},
+  {"Int64",   NDInt64},
+  {"UInt64",  NDUInt64},
+  {"Float32", NDFloat32},
+  {"Float64", NDFloat64},
+  {0, 0}
+};
+
+const namedValue_t colorModeNames[] = {
+  {"Mono", NDColorModeMono},
+  {"RGB1", NDColorModeRGB1},
+  {"RGB2", NDColorModeRGB2},
+  {"RGB3", NDColorModeRGB3},
+  {0, 0}
+};
+
+/** Returns the name of a value, or "Unknown" */
+const char *nameOf(const namedValue_t *pNames, int value)
+{
+  for (; pNames->name; pNames++) {
+    if (pNames->value == value) return pNames->name;
+  }
+  return "Unknown";
+}
+
+/** Returns the value of a name, which is not case sensitive, or -1 if it is unknown */
+int valueOf(const namedValue_t *pNames, const char *name)
+{
+  for (; pNames->name; pNames++) {
+    if (epicsStrCaseCmp(name, pNames->name) == 0) return pNames->value;
+  }
+  return -1;
+}
+
+/** Parses a comma-separated list of names (or "all") into values; returns the number of values.
+  * Exits on an unknown name. */
+int parseNames(const char *list, const namedValue_t *pNames, int *values)
+{
+  char buffer[256];
+  char *pToken, *pSave;
+  int num=0;
+  int i;
+
+  if (strcmp(list, "all") == 0) {
+    for (i=0; pNames[i].name && (num < MAX_ITEMS); i++) values[num++] = pNames[i].value;
+    return num;
+  }
+  strncpy(buffer, list, sizeof(buffer)-1);
+  buffer[sizeof(buffer)-1] = 0;
+  for (pToken = epicsStrtok_r(buffer, ",", &pSave); pToken && (num < MAX_ITEMS);
+       pToken = epicsStrtok_r(NULL, ",", &pSave)) {
+    values[num] = valueOf(pNames, pToken);
+    if (values[num] < 0) {
+      fprintf(stderr, "Unknown name %s\n", pToken);
+      exit(1);
+    }
+    num++;
+  }
+  return num;
+}
+
+/** Parses a comma-separated list of integers; returns the number of values */
+int parseIntegers(const char *list, int *values)
+{
+  char buffer[256];
+  char *pToken, *pSave;
+  int num=0;
+
+  strncpy(buffer, list, sizeof(buffer)-1);
+  buffer[sizeof(buffer)-1] = 0;
+  for (pToken = epicsStrtok_r(buffer, ",", &pSave); pToken && (num < MAX_ITEMS);
+       pToken = epicsStrtok_r(NULL, ",", &pSave)) {
+    values[num++] = atoi(pToken);
+  }
+  return num;
+}
+
+/** Parses a comma-separated list of numbers; returns the number of values */
+int parseNumbers(const char *list, double *values)
+{
+  char buffer[256];
+  char *pToken, *pSave;
+  int num=0;
+
+  strncpy(buffer, list, sizeof(buffer)-1);
+  buffer[sizeof(buffer)-1] = 0;
+  for (pToken = epicsStrtok_r(buffer, ",", &pSave); pToken && (num < MAX_ITEMS);
+       pToken = epicsStrtok_r(NULL, ",", &pSave)) {
+    values[num++] = atof(pToken);
+  }
+  return num;
+}
+
+/** Parses the value of the -f option, text, csv or json; returns false if it is none of them */
+bool parseFormat(const char *name, outputFormat_t *pFormat)
+{
+  if      (strcmp(name, "csv")  == 0) *pFormat = FormatCSV;
+  else if (strcmp(name, "json") == 0) *pFormat = FormatJSON;
+  else if (strcmp(name, "text") == 0) *pFormat = FormatText;
+  else return false;
+  return true;
+}
+
+/** Prints the value of a column to CSV or JSON */
+static void printData(FILE *fp, const outputColumn_t *pColumn, const outputValue_t *pValue, bool quote)
+{
+  switch (pColumn->type) {
+    case ColumnInteger:
+      fprintf(fp, "%d", pValue->integer);
+      break;
+    case ColumnDouble:
+      if (pColumn->dataPrecision < 0) fprintf(fp, "%g", pValue->number);
+      else fprintf(fp, "%.*f", pColumn->dataPrecision, pValue->number);
+      break;
+    case ColumnString:
+      fprintf(fp, quote ? "\"%s\"" : "%s", pValue->string);
+      break;
+  }
+}
+
+/** Prints the heading of the results: the version of the driver and the number of threads it uses, and the
+  * titles of the columns */
+void printHeader(FILE *fp, outputFormat_t format, int numThreads, const outputColumn_t *columns, int numColumns)
+{
+  const char *separator = "";
+  int i;
+
+  switch (format) {
+    case FormatText:
+      fprintf(fp, "simDetector %d.%d.%d, %d thread(s)\n", DRIVER_VERSION, DRIVER_REVISION, DRIVER_MODIFICATION, numThreads);
+      for (i=0; i<numColumns; i++) {
+        if (columns[i].textWidth == 0) continue;
+        fprintf(fp, (columns[i].type == ColumnString) ? "%s%-*s" : "%s%*s", separator,
+                columns[i].textWidth, columns[i].title);
+        separator = " ";
+      }
+      fprintf(fp, "\n");
+      break;
+    case FormatCSV:
+      fprintf(fp, "version,threads");
+      for (i=0; i<numColumns; i++) fprintf(fp, ",%s", columns[i].key);
+      fprintf(fp, "\n");
+      break;
+    case FormatJSON:
+      fprintf(fp, "{\n  \"version\": \"%d.%d.%d\",\n  \"threads\": %d,\n  \"results\": [",
+              DRIVER_VERSION, DRIVER_REVISION, DRIVER_MODIFICATION, numThreads);
+      break;
+  }
+}
+
+/** Prints one result, a value for each column.
+  * \param[in] first Whether this is the first result, which is not preceded by a comma in JSON. */
+void printResult(FILE *fp, outputFormat_t format, int numThreads, const outputColumn_t *columns, int numColumns,
+                 const outputValue_t *values, bool first)
+{
+  const char *separator = "";
+  int i;
+
+  switch (format) {
+    case FormatText:
+      for (i=0; i<numColumns; i++) {
+        const outputColumn_t *pColumn = &columns[i];
+        if (pColumn->textWidth == 0) continue;
+        fprintf(fp, "%s", separator);
+        separator = " ";
+        switch (pColumn->type) {
+          case ColumnInteger:
+            fprintf(fp, "%*d", pColumn->textWidth, values[i].integer);
+            break;
+          case ColumnDouble:
+            fprintf(fp, "%*.*f", pColumn->textWidth, pColumn->textPrecision, values[i].number);
+            break;
+          case ColumnString:
+            fprintf(fp, "%-*s", pColumn->textWidth, values[i].string);
+            break;
+        }
+      }
+      fprintf(fp, "\n");
+      break;
+    case FormatCSV:
+      fprintf(fp, "%d.%d.%d,%d", DRIVER_VERSION, DRIVER_REVISION, DRIVER_MODIFICATION, numThreads);
+      for (i=0; i<numColumns; i++) {
+        fprintf(fp, ",");
+        printData(fp, &columns[i], &values[i], false);
+      }
+      fprintf(fp, "\n");
+      break;
+    case FormatJSON:
+      fprintf(fp, "%s\n    {", first ? "" : ",");
+      for (i=0; i<numColumns; i++) {
+        fprintf(fp, "%s\"%s\": ", i ? ", " : "", columns[i].key);
+        printData(fp, &columns[i], &values[i], true);
+      }
+      fprintf(fp, "}");
+      break;
+  }
+  fflush(fp);
+}
+
+/** Prints the end of the results */
+void printFooter(FILE *fp, outputFormat_t format)
+{
+  if (format == FormatJSON) fprintf(fp, "\n  ]\n}\n");
+}
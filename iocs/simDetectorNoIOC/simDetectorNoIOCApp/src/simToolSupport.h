@@ -0,0 +1,67 @@
+/* simToolSupport.h
+ *
+ * Option parsing and result formatting shared by simDetectorBenchmark and simDetectorSoak, so that the two
+ * tools take the same option syntax and write their results in the same formats.
+ *
+ */
+
+#ifndef SIM_TOOL_SUPPORT_H
+#define SIM_TOOL_SUPPORT_H
+
+#include <stdio.h>
+
+/* The largest number of values of a comma-separated option */
+#define MAX_ITEMS 16
+
+typedef enum {
+  FormatText,
+  FormatCSV,
+  FormatJSON
+} outputFormat_t;
+
+typedef struct {
+  const char *name;
+  int value;
+} namedValue_t;
+
+/** Names of the simulation modes, data types and color modes, terminated by a NULL name */
+extern const namedValue_t modeNames[];
+extern const namedValue_t dataTypeNames[];
+extern const namedValue_t colorModeNames[];
+
+const char *nameOf(const namedValue_t *pNames, int value);
+int valueOf(const namedValue_t *pNames, const char *name);
+int parseNames(const char *list, const namedValue_t *pNames, int *values);
+int parseIntegers(const char *list, int *values);
+int parseNumbers(const char *list, double *values);
+bool parseFormat(const char *name, outputFormat_t *pFormat);
+
+typedef enum {
+  ColumnInteger,
+  ColumnDouble,
+  ColumnString
+} columnType_t;
+
+/** A column of the results */
+typedef struct {
+  const char *title;         /**< Heading of the text table */
+  const char *key;           /**< Name in the CSV heading and the JSON objects */
+  columnType_t type;
+  int textWidth;             /**< Width in the text table, or 0 if the column is not in it; strings are left aligned */
+  int textPrecision;         /**< Digits after the point in the text table */
+  int dataPrecision;         /**< Digits after the point in CSV and JSON, or -1 for the shortest form */
+} outputColumn_t;
+
+/** The value of a column for one result */
+typedef struct {
+  int integer;
+  double number;
+  const char *string;
+} outputValue_t;
+
+void printHeader(FILE *fp, outputFormat_t format, int numThreads, const outputColumn_t *columns, int numColumns);
+void printResult(FILE *fp, outputFormat_t format, int numThreads, const outputColumn_t *columns, int numColumns,
+                 const outputValue_t *values, bool first);
+void printFooter(FILE *fp, outputFormat_t format);
+
+#endif
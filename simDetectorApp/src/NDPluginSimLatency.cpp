@@ -0,0 +1,222 @@
+/* NDPluginSimLatency.cpp
+ *
+ * Plugin which measures the latency of the frames of a simDetector driver, from the latency attributes which
+ * the driver adds to the frames when SimLatencyAttributes is enabled.
+ *
+ * The driver stamps each frame with the monotonic times at which its generation started and ended and at which
+ * it was published; this plugin adds the time at which the frame arrived, which the driver cannot see.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsString.h>
+#include <epicsStdio.h>
+#include <iocsh.h>
+
+#include "NDPluginDriver.h"
+#include <epicsExport.h>
+#include "NDPluginSimLatency.h"
+
+static const char *driverName="NDPluginSimLatency";
+
+static const char *latencyNames[SimNumLatencies] = {"GENERATE", "PUBLISH", "DELIVER", "TOTAL"};
+
+/** Reads one of the latency attributes of an array.
+  * \return true if the array has the attribute. */
+static bool getLatencyAttribute(NDArray *pArray, const char *name, epicsUInt64 *pValue)
+{
+    NDAttribute *pAttribute = pArray->pAttributeList->find(name);
+
+    if (!pAttribute) return false;
+    return (pAttribute->getValue(NDAttrUInt64, pValue, sizeof(*pValue)) == ND_SUCCESS);
+}
+
+/** Returns the time in seconds from one monotonic time in ns to a later one */
+static double latencySeconds(epicsUInt64 from, epicsUInt64 to)
+{
+    return (to > from) ? (to - from) * 1e-9 : 0.;
+}
+
+/** Callback function that is called by the NDArray driver with new NDArray data.
+  * Adds the latencies of the stages of the array to the statistics.
+  * \param[in] pArray  The NDArray from the callback.
+  */
+void NDPluginSimLatency::processCallbacks(NDArray *pArray)
+{
+    /* Take the time of arrival first, so that it does not include the time taken by this method */
+    epicsUInt64 arrival = simMonotonicNs();
+    epicsUInt64 generateStart, generateEnd, publish;
+
+    /* Call the base class method */
+    NDPluginDriver::beginProcessCallbacks(pArray);
+
+    if (getLatencyAttribute(pArray, SimAttrGenerateStart, &generateStart) &&
+        getLatencyAttribute(pArray, SimAttrGenerateEnd,   &generateEnd) &&
+        getLatencyAttribute(pArray, SimAttrPublish,       &publish)) {
+        stages_[SimLatencyGenerate].add(latencySeconds(generateStart, generateEnd));
+        stages_[SimLatencyPublish].add(latencySeconds(generateEnd, publish));
+        stages_[SimLatencyDeliver].add(latencySeconds(publish, arrival));
+        stages_[SimLatencyTotal].add(latencySeconds(generateStart, arrival));
+    } else {
+        missing_++;
+    }
+    updateParams();
+    callParamCallbacks();
+}
+
+/** Copies the statistics to the parameters; the times are in ms */
+void NDPluginSimLatency::updateParams()
+{
+    int i;
+
+    setIntegerParam(SimLatencyMissing, missing_);
+    for (i=0; i<SimNumLatencies; i++) {
+        setDoubleParam(SimLatencyLast[i], stages_[i].last() * 1e3);
+        setDoubleParam(SimLatencyMean[i], stages_[i].mean() * 1e3);
+        setDoubleParam(SimLatencyMax[i],  stages_[i].max()  * 1e3);
+        doCallbacksInt32Array(stages_[i].histogram(), SIM_TIMING_BINS, SimLatencyHistogram[i], 0);
+    }
+}
+
+/** Called when asyn clients call pasynInt32->write().
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus NDPluginSimLatency::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+    int i;
+
+    status = setIntegerParam(function, value);
+
+    if ((function == SimLatencyReset) && value) {
+        for (i=0; i<SimNumLatencies; i++) stages_[i].reset();
+        missing_ = 0;
+        setIntegerParam(SimLatencyReset, 0);
+        updateParams();
+    } else if (function < FIRST_SIM_LATENCY_PARAM) {
+        /* If this parameter belongs to a base class call its method */
+        status = NDPluginDriver::writeInt32(pasynUser, value);
+    }
+
+    /* Do callbacks so higher layers see any changes */
+    callParamCallbacks();
+
+    if (status)
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+              "%s:writeInt32 error, status=%d function=%d, value=%d\n",
+              driverName, status, function, value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:writeInt32: function=%d, value=%d\n",
+              driverName, function, value);
+    return status;
+}
+
+/** Constructor for NDPluginSimLatency; most parameters are simply passed to NDPluginDriver::NDPluginDriver.
+  * After calling the base class constructor this method sets reasonable default values for all of the parameters.
+  * \param[in] portName The name of the asyn port driver to be created.
+  * \param[in] queueSize The number of NDArrays that the input queue for this plugin can hold when
+  *            NDPluginDriverBlockingCallbacks=0.
+  * \param[in] blockingCallbacks Initial setting for the NDPluginDriverBlockingCallbacks flag.
+  *            0=callbacks are queued and executed by the callback thread; 1 callbacks execute in the thread
+  *            of the driver doing the callbacks.
+  * \param[in] NDArrayPort Name of asyn port driver for initial source of NDArray callbacks.
+  * \param[in] NDArrayAddr asyn port driver address for initial source of NDArray callbacks.
+  * \param[in] maxBuffers The maximum number of NDArray buffers that the NDArrayPool for this driver is
+  *            allowed to allocate. Set this to 0 to allow an unlimited number of buffers.
+  * \param[in] maxMemory The maximum amount of memory that the NDArrayPool for this driver is
+  *            allowed to allocate. Set this to 0 to allow an unlimited amount of memory.
+  * \param[in] priority The thread priority for the asyn port driver thread.
+  * \param[in] stackSize The stack size for the asyn port driver thread.
+  */
+NDPluginSimLatency::NDPluginSimLatency(const char *portName, int queueSize, int blockingCallbacks,
+                                       const char *NDArrayPort, int NDArrayAddr,
+                                       int maxBuffers, size_t maxMemory,
+                                       int priority, int stackSize)
+    /* Invoke the base class constructor; the plugin only reads the attributes of the arrays, so it is
+     * compression aware */
+    : NDPluginDriver(portName, queueSize, blockingCallbacks,
+                     NDArrayPort, NDArrayAddr, 1, maxBuffers, maxMemory,
+                     asynInt32ArrayMask | asynGenericPointerMask,
+                     asynInt32ArrayMask | asynGenericPointerMask,
+                     0, 1, priority, stackSize, 1, true),
+      missing_(0)
+{
+    int i;
+
+    createParam(SimLatencyResetString,        asynParamInt32,   &SimLatencyReset);
+    createParam(SimLatencyMissingString,      asynParamInt32,   &SimLatencyMissing);
+    for (i=0; i<SimNumLatencies; i++) {
+        char paramName[64];
+        epicsSnprintf(paramName, sizeof(paramName), SimLatencyLastString, latencyNames[i]);
+        createParam(paramName, asynParamFloat64, &SimLatencyLast[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimLatencyMeanString, latencyNames[i]);
+        createParam(paramName, asynParamFloat64, &SimLatencyMean[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimLatencyMaxString, latencyNames[i]);
+        createParam(paramName, asynParamFloat64, &SimLatencyMax[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimLatencyHistogramString, latencyNames[i]);
+        createParam(paramName, asynParamInt32Array, &SimLatencyHistogram[i]);
+    }
+
+    /* Set the plugin type string */
+    setStringParam(NDPluginDriverPluginType, "NDPluginSimLatency");
+    setIntegerParam(SimLatencyReset, 0);
+    updateParams();
+
+    /* Try to connect to the array port */
+    connectToArrayPort();
+}
+
+/** Configuration command, called directly or from iocsh */
+extern "C" int NDSimLatencyConfigure(const char *portName, int queueSize, int blockingCallbacks,
+                                     const char *NDArrayPort, int NDArrayAddr,
+                                     int maxBuffers, int maxMemory,
+                                     int priority, int stackSize)
+{
+    NDPluginSimLatency *pPlugin = new NDPluginSimLatency(portName, queueSize, blockingCallbacks,
+                                                         NDArrayPort, NDArrayAddr,
+                                                         (maxBuffers < 0) ? 0 : maxBuffers,
+                                                         (maxMemory < 0) ? 0 : maxMemory,
+                                                         priority, stackSize);
+    return(pPlugin->start());
+}
+
+/** Code for iocsh registration */
+static const iocshArg NDSimLatencyConfigureArg0 = {"portName", iocshArgString};
+static const iocshArg NDSimLatencyConfigureArg1 = {"frame queue size", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg2 = {"blocking callbacks", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg3 = {"NDArrayPort", iocshArgString};
+static const iocshArg NDSimLatencyConfigureArg4 = {"NDArrayAddr", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg5 = {"maxBuffers", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg6 = {"maxMemory", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg7 = {"priority", iocshArgInt};
+static const iocshArg NDSimLatencyConfigureArg8 = {"stackSize", iocshArgInt};
+static const iocshArg * const NDSimLatencyConfigureArgs[] =  {&NDSimLatencyConfigureArg0,
+                                                              &NDSimLatencyConfigureArg1,
+                                                              &NDSimLatencyConfigureArg2,
+                                                              &NDSimLatencyConfigureArg3,
+                                                              &NDSimLatencyConfigureArg4,
+                                                              &NDSimLatencyConfigureArg5,
+                                                              &NDSimLatencyConfigureArg6,
+                                                              &NDSimLatencyConfigureArg7,
+                                                              &NDSimLatencyConfigureArg8};
+static const iocshFuncDef configNDSimLatency = {"NDSimLatencyConfigure", 9, NDSimLatencyConfigureArgs};
+static void configNDSimLatencyCallFunc(const iocshArgBuf *args)
+{
+    NDSimLatencyConfigure(args[0].sval, args[1].ival, args[2].ival,
+                          args[3].sval, args[4].ival, args[5].ival,
+                          args[6].ival, args[7].ival, args[8].ival);
+}
+
+static void NDSimLatencyRegister(void)
+{
+    iocshRegister(&configNDSimLatency, configNDSimLatencyCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(NDSimLatencyRegister);
+}
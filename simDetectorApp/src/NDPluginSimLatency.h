@@ -0,0 +1,60 @@
+/* NDPluginSimLatency.h
+ *
+ * Plugin which measures the latency of the frames of a simDetector driver, from the latency attributes which
+ * the driver adds to the frames when SimLatencyAttributes is enabled.
+ *
+ */
+
+#ifndef NDPluginSimLatency_H
+#define NDPluginSimLatency_H
+
+#include "NDPluginDriver.h"
+#include "simTiming.h"
+
+/** Stages of the latency of a frame */
+typedef enum {
+    SimLatencyGenerate,        /**< From the start to the end of the generation of the frame */
+    SimLatencyPublish,         /**< From the end of the generation to the callbacks of the driver */
+    SimLatencyDeliver,         /**< From the callbacks of the driver to the arrival at this plugin */
+    SimLatencyTotal,           /**< From the start of the generation to the arrival at this plugin */
+    SimNumLatencies
+} SimLatency_t;
+
+#define SimLatencyResetString         "SIM_LATENCY_RESET"
+#define SimLatencyMissingString       "SIM_LATENCY_MISSING"
+/* The statistics parameters are created for each stage, e.g. SIM_LATENCY_TOTAL_MEAN */
+#define SimLatencyLastString          "SIM_LATENCY_%s_LAST"
+#define SimLatencyMeanString          "SIM_LATENCY_%s_MEAN"
+#define SimLatencyMaxString           "SIM_LATENCY_%s_MAX"
+#define SimLatencyHistogramString     "SIM_LATENCY_%s_HIST"
+
+/** Computes the distribution of the latency of the frames of a simDetector at the point of the plugin chain
+  * where it is connected, for example next to a file writer. */
+class epicsShareClass NDPluginSimLatency : public NDPluginDriver {
+public:
+    NDPluginSimLatency(const char *portName, int queueSize, int blockingCallbacks,
+                       const char *NDArrayPort, int NDArrayAddr,
+                       int maxBuffers, size_t maxMemory,
+                       int priority, int stackSize);
+
+    /* These methods override the virtual methods in the base class */
+    void processCallbacks(NDArray *pArray);
+    asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+
+protected:
+    int SimLatencyReset;
+    #define FIRST_SIM_LATENCY_PARAM SimLatencyReset
+    int SimLatencyMissing;
+    int SimLatencyLast[SimNumLatencies];
+    int SimLatencyMean[SimNumLatencies];
+    int SimLatencyMax[SimNumLatencies];
+    int SimLatencyHistogram[SimNumLatencies];
+
+private:
+    void updateParams();
+
+    simTimer stages_[SimNumLatencies];
+    int missing_;              /* Frames without the latency attributes */
+};
+
+#endif
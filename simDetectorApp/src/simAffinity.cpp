@@ -0,0 +1,147 @@
+/* simAffinity.cpp
+ *
+ * Sets of CPUs which the threads of the simDetector driver are allowed to run on.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <sched.h>
+#endif
+
+#include <epicsStdio.h>
+
+#include "simAffinity.h"
+
+simCpuSet::simCpuSet()
+{
+    clear();
+}
+
+/** Empties the set, so that a thread may run on any CPU */
+void simCpuSet::clear()
+{
+    memset(mask_, 0, sizeof(mask_));
+}
+
+/** Sets the CPUs from a list of CPU numbers and ranges, for example "0-3,8,10-11".
+  * An empty string, NULL or "all" empty the set.
+  * \param[in] spec The list.
+  * \return 0 on success, -1 if the list is not valid, in which case the set is unchanged. */
+int simCpuSet::parse(const char *spec)
+{
+    epicsUInt32 mask[SIM_MAX_CPUS / 32];
+    const char *p = spec;
+    char *end;
+    long first, last, cpu;
+
+    memset(mask, 0, sizeof(mask));
+    if (!spec || (spec[0] == 0) || (strcmp(spec, "all") == 0)) {
+        clear();
+        return 0;
+    }
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        first = strtol(p, &end, 10);
+        if ((end == p) || (first < 0) || (first >= SIM_MAX_CPUS)) return -1;
+        p = end;
+        last = first;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if ((end == p) || (last < first) || (last >= SIM_MAX_CPUS)) return -1;
+            p = end;
+        }
+        for (cpu=first; cpu<=last; cpu++) mask[cpu / 32] |= 1u << (cpu % 32);
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    memcpy(mask_, mask, sizeof(mask_));
+    return 0;
+}
+
+/** Writes the set as a list of CPU numbers and ranges, or "all" if it is empty */
+void simCpuSet::format(char *buffer, size_t size) const
+{
+    size_t length = 0;
+    int first, last;
+
+    if (size == 0) return;
+    buffer[0] = 0;
+    if (empty()) {
+        epicsSnprintf(buffer, size, "all");
+        return;
+    }
+    for (first=0; first<SIM_MAX_CPUS; first++) {
+        if (!contains(first)) continue;
+        for (last=first; (last+1 < SIM_MAX_CPUS) && contains(last+1); last++);
+        if (length < size) {
+            if (last > first) {
+                length += epicsSnprintf(buffer + length, size - length, "%s%d-%d", length ? "," : "", first, last);
+            } else {
+                length += epicsSnprintf(buffer + length, size - length, "%s%d", length ? "," : "", first);
+            }
+        }
+        first = last;
+    }
+}
+
+/** Returns true if the set is empty, so that a thread may run on any CPU */
+bool simCpuSet::empty() const
+{
+    int i;
+
+    for (i=0; i<SIM_MAX_CPUS / 32; i++) {
+        if (mask_[i]) return false;
+    }
+    return true;
+}
+
+bool simCpuSet::contains(int cpu) const
+{
+    if ((cpu < 0) || (cpu >= SIM_MAX_CPUS)) return false;
+    return (mask_[cpu / 32] >> (cpu % 32)) & 1;
+}
+
+/** Restricts the calling thread to the CPUs of the set, or lets it run on any CPU if the set is empty.
+  * Memory which the thread touches first is then normally allocated on the NUMA node of those CPUs.
+  * \return 0 on success, -1 if the CPUs cannot be set or thread affinity is not supported on this system. */
+int simCpuSet::apply() const
+{
+#if defined(_WIN32)
+    DWORD_PTR mask = 0, processMask, systemMask;
+    int cpu;
+
+    if (empty()) {
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return -1;
+        mask = processMask;
+    } else {
+        for (cpu=0; cpu<(int)(8 * sizeof(DWORD_PTR)); cpu++) {
+            if (contains(cpu)) mask |= (DWORD_PTR)1 << cpu;
+        }
+    }
+    if (mask == 0) return -1;
+    return (SetThreadAffinityMask(GetCurrentThread(), mask) != 0) ? 0 : -1;
+#elif defined(__linux__)
+    cpu_set_t set;
+    int cpu;
+
+    CPU_ZERO(&set);
+    for (cpu=0; (cpu<SIM_MAX_CPUS) && (cpu<CPU_SETSIZE); cpu++) {
+        if (empty() || contains(cpu)) CPU_SET(cpu, &set);
+    }
+    /* pid 0 is the calling thread */
+    return (sched_setaffinity(0, sizeof(set), &set) == 0) ? 0 : -1;
+#else
+    return empty() ? 0 : -1;
+#endif
+}
@@ -0,0 +1,32 @@
+/* simAffinity.h
+ *
+ * Sets of CPUs which the threads of the simDetector driver are allowed to run on.
+ *
+ */
+
+#ifndef SIM_AFFINITY_H
+#define SIM_AFFINITY_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+/** Largest number of CPUs in a set */
+#define SIM_MAX_CPUS 1024
+
+/** A set of CPUs.  An empty set means that a thread may run on any CPU.
+  * A set which is all zero bytes is a valid empty set. */
+class simCpuSet {
+public:
+    simCpuSet();
+    void clear();
+    int parse(const char *spec);
+    void format(char *buffer, size_t size) const;
+    bool empty() const;
+    bool contains(int cpu) const;
+    int apply() const;
+
+private:
+    epicsUInt32 mask_[SIM_MAX_CPUS / 32];
+};
+
+#endif
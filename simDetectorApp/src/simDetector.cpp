@@ -17,6 +17,8 @@
 #include <errno.h>
 #include <string.h>
 
+#include <limits>
+
 #include <epicsTime.h>
 #include <epicsThread.h>
 #include <epicsEvent.h>
@@ -28,64 +30,404 @@
 #include <iocsh.h>
 
 #include "ADDriver.h"
+#include "NDPluginCodec.h"
 #include <epicsExport.h>
 #include "simDetector.h"
+#include "simKernels.h"
 
 static const char *driverName = "simDetector";
 
+/* Names of the timed stages, in the order of SimTimer_t */
+static const char *timerNames[SimNumTimers] = {"GENERATE", "CONVERT", "ENCODE", "ATTRIBUTES", "CALLBACKS",
+                                                 "UNPACK"};
+
+/* Names of the threads in SimAffinity_t, as given to simDetectorConfigAffinity */
+static const char *affinityNames[SimNumAffinity] = {"acquire", "workers", "render", "modules"};
+
 #define MIN_DELAY 1e-5
+/* Delays of a render thread before it tries again after failing to compute a frame, in seconds */
+#define MIN_RETRY_DELAY 0.01
+#define MAX_RETRY_DELAY 1.0
 #define MAX_PEAK_SIGMA 4
+/* Number of sine table elements computed by the rotation recurrence before it is restarted from sin() and cos() */
+#define SINE_RESTART 256
 
 /* Some systems don't define M_PI in math.h */
 #ifndef M_PI
   #define M_PI 3.14159265358979323846
 #endif
 
+/** Returns the number of lines of a window; see windowLine() */
+static inline int windowNumLines(const simWindow_t *pWindow, int colorMode)
+{
+    if ((colorMode == NDColorModeRGB2) || (colorMode == NDColorModeRGB3)) return 3 * pWindow->sizeY;
+    return pWindow->sizeY;
+}
+
+/** Computes the first element and the number of elements of one line of a window of the raw image.
+  * A line is the contiguous part of the window in one row of the image, or in one row of one color plane
+  * for RGB2 and RGB3. */
+static inline void windowLine(const simWindow_t *pWindow, int colorMode, int sizeX, int sizeY, int line,
+                              size_t *pFirst, size_t *pNumElements)
+{
+    size_t x = pWindow->minX;
+    size_t y;
+
+    switch (colorMode) {
+        case NDColorModeRGB1:
+            y = pWindow->minY + line;
+            *pFirst = 3 * (y * sizeX + x);
+            *pNumElements = 3 * (size_t)pWindow->sizeX;
+            break;
+        case NDColorModeRGB2:
+            y = pWindow->minY + line/3;
+            *pFirst = (3 * y + line%3) * sizeX + x;
+            *pNumElements = pWindow->sizeX;
+            break;
+        case NDColorModeRGB3:
+            y = pWindow->minY + line%pWindow->sizeY;
+            *pFirst = ((size_t)(line/pWindow->sizeY) * sizeY + y) * sizeX + x;
+            *pNumElements = pWindow->sizeX;
+            break;
+        default:
+            y = pWindow->minY + line;
+            *pFirst = y * sizeX + x;
+            *pNumElements = pWindow->sizeX;
+            break;
+    }
+}
+
+/** Returns true if window pInner lies entirely inside window pOuter */
+static inline bool windowContains(const simWindow_t *pOuter, const simWindow_t *pInner)
+{
+    return (pInner->minX >= pOuter->minX) && (pInner->minY >= pOuter->minY) &&
+           (pInner->minX + pInner->sizeX <= pOuter->minX + pOuter->sizeX) &&
+           (pInner->minY + pInner->sizeY <= pOuter->minY + pOuter->sizeY);
+}
+
+/** Job description for backgroundElements() */
+template <typename epicsType> struct backgroundJob {
+    epicsType *pData;
+    size_t nElements;
+    double noise;
+    epicsType offset;
+    epicsUInt32 seed;
+};
+
+/** Computes a band of elements of the random background.
+  * Element i always uses value i of the background stream, so the result does not depend on the number of tasks. */
+template <typename epicsType> static void backgroundElements(void *pvt, int task, int numTasks)
+{
+    backgroundJob<epicsType> *pJob = (backgroundJob<epicsType> *)pvt;
+    simRandom random(pJob->seed, SimRandomStreamBackground);
+    double values[256];
+    size_t first, last, i, j, n;
+
+    simElementBand(task, numTasks, pJob->nElements, &first, &last);
+    random.skipTo(first);
+    for (i=first; i<last; i+=n) {
+        n = last - i;
+        if (n > sizeof(values)/sizeof(values[0])) n = sizeof(values)/sizeof(values[0]);
+        random.fillUniform(values, n);
+        for (j=0; j<n; j++) {
+            pJob->pData[i+j] = (epicsType)((pJob->noise * values[j]) + pJob->offset);
+        }
+    }
+}
+
+/** Job description for noiseLines() */
+template <typename epicsType> struct noiseJob {
+    epicsType *pOut;
+    const epicsType *pIn;
+    simWindow_t window;
+    int colorMode;
+    int sizeX;
+    int sizeY;
+    size_t rowLength;
+    size_t elementOrigin;      /* Index in the frame of the first element of the buffer, which is a tile */
+    double offset;
+    double uniform;
+    double gaussian;
+    double shot;
+    double read;
+    epicsUInt32 key[2];
+    epicsUInt64 noiseStream;
+    epicsUInt64 readNoiseStream;
+};
+
+/** Converts a value to epicsType, limiting it to the range of integer types */
+template <typename epicsType> static inline epicsType clipToType(double value)
+{
+    if (std::numeric_limits<epicsType>::is_integer) {
+        if (value <= (double)std::numeric_limits<epicsType>::min()) return std::numeric_limits<epicsType>::min();
+        if (value >= (double)std::numeric_limits<epicsType>::max()) return std::numeric_limits<epicsType>::max();
+    }
+    return (epicsType)value;
+}
+
+/* Largest count returned by poissonCount() for small means; the probability of larger counts is negligible */
+#define MAX_SMALL_POISSON 64
+
+/** Table of 1/k, so that poissonCount() does not need a division per step */
+static const struct poissonInverseTable {
+    double inverse[MAX_SMALL_POISSON+1];
+    poissonInverseTable() {
+        inverse[0] = 0.;
+        for (int i=1; i<=MAX_SMALL_POISSON; i++) inverse[i] = 1. / i;
+    }
+} poissonInverse;
+
+/** Returns a Poisson distributed count with the given mean.
+  * Small means use inversion of the cumulative distribution with the uniform value u,
+  * and expMinusMean must be exp(-mean). Large means use the normal approximation with the standard normal value z. */
+static inline double poissonCount(double mean, double expMinusMean, double u, double z)
+{
+    double p, sum, k;
+    int i;
+
+    if (mean >= 16.) {
+        k = floor(mean + sqrt(mean) * z + 0.5);
+        return (k < 0) ? 0 : k;
+    }
+    p = expMinusMean;
+    sum = p;
+    for (i=0; (u > sum) && (i < MAX_SMALL_POISSON); ) {
+        i++;
+        p *= mean * poissonInverse.inverse[i];
+        sum += p;
+    }
+    return i;
+}
+
+/** Adds independent noise to a band of lines of the window.
+  * Element i of the frame uses the 4 random values of block i of the noise stream: one uniform value,
+  * one normal value for the Gaussian noise, and one normal and one uniform value for the shot noise.
+  * The read noise uses block n of the read noise stream for row n, and is common to all elements of the row.
+  * The elements and rows are those of the frame, so a tile has the same noise as that part of the whole frame. */
+template <typename epicsType> static void noiseLines(void *pvt, int task, int numTasks)
+{
+    noiseJob<epicsType> *pJob = (noiseJob<epicsType> *)pvt;
+    epicsUInt32 counter[4], values[4];
+    size_t first, last, i, n, element;
+    size_t row, lastRow=0;
+    double signal, value, rowNoise=0;
+    double lastSignal=-1., expMinusMean=1.;
+    int firstLine, lastLine, line;
+
+    simRowBand(task, numTasks, windowNumLines(&pJob->window, pJob->colorMode), &firstLine, &lastLine);
+    counter[2] = (epicsUInt32)pJob->noiseStream;
+    counter[3] = (epicsUInt32)(pJob->noiseStream >> 32);
+    for (line=firstLine; line<lastLine; line++) {
+        windowLine(&pJob->window, pJob->colorMode, pJob->sizeX, pJob->sizeY, line, &first, &n);
+        last = first + n;
+        for (i=first; i<last; i++) {
+            element = i + pJob->elementOrigin;
+            row = element / pJob->rowLength;
+            if ((pJob->read != 0.) && ((i == first) || (row != lastRow))) {
+                epicsUInt32 rowCounter[4];
+                lastRow = row;
+                rowCounter[0] = (epicsUInt32)row;
+                rowCounter[1] = (epicsUInt32)((epicsUInt64)row >> 32);
+                rowCounter[2] = (epicsUInt32)pJob->readNoiseStream;
+                rowCounter[3] = (epicsUInt32)(pJob->readNoiseStream >> 32);
+                simRandom::philox(pJob->key, rowCounter, values);
+                rowNoise = pJob->read * simRandom::toNormal(values[0]);
+            }
+            counter[0] = (epicsUInt32)element;
+            counter[1] = (epicsUInt32)((epicsUInt64)element >> 32);
+            simRandom::philox(pJob->key, counter, values);
+            signal = (double)pJob->pIn[i];
+            value = signal + rowNoise + pJob->offset + pJob->uniform * simRandom::toUniform(values[0]);
+            if (pJob->gaussian != 0.) {
+                value += pJob->gaussian * simRandom::toNormal(values[1]);
+            }
+            if ((pJob->shot > 0.) && (signal > 0.)) {
+                double mean = signal / pJob->shot;
+                double z = 0.;
+                if (mean >= 16.) {
+                    z = simRandom::toNormal(values[2]);
+                } else if (signal != lastSignal) {
+                    /* Neighbouring pixels often have the same signal */
+                    expMinusMean = exp(-mean);
+                    lastSignal = signal;
+                }
+                value += pJob->shot * poissonCount(mean, expMinusMean, simRandom::toUniform(values[3]), z) - signal;
+            }
+            pJob->pOut[i] = clipToType<epicsType>(value);
+        }
+    }
+}
+
+/** Constructor for the simRenderContext class; the first frame computed in the context resets everything.
+  * \param[in] pDetector The driver whose frames are computed. */
+simRenderContext::simRenderContext(simDetector *pDetector)
+    : pDetector_(pDetector), resetImage_(SimResetAll), invalidateWindow_(false), releaseBuffers_(false),
+      pRaw_(NULL), pPreviousRaw_(NULL), useBackground_(false), perFrameNoise_(false), noiseFrame_(0),
+      scratch_(SimNumScratch), frameClass_(SimFrameDynamic), fusedRamp_(false), xSineCounter_(0.), ySineCounter_(0.),
+      peakGains_(0), numPeakGains_(0), pKernels_(simGetScalarKernels()), numThreads_(1), rawColorMode_(-1),
+      tileRows_(0), numTiles_(1), tileIndex_(0), tileOffsetY_(0), rampFrame_(0), previousRampFrame_(0),
+      ringSlot_(0), ringEpoch_(0)
+{
+    memset(&frameParams_, 0, sizeof(frameParams_));
+    memset(&arrayInfo_, 0, sizeof(arrayInfo_));
+    memset(&window_, 0, sizeof(window_));
+    memset(&validWindow_, 0, sizeof(validWindow_));
+    memset(&rampWindow_, 0, sizeof(rampWindow_));
+}
+
+/** Releases the raw and scratch buffers; the next frame allocates them again, which it must reset */
+void simRenderContext::releaseBuffers()
+{
+    int i;
+
+    if (pRaw_) pRaw_->release();
+    pRaw_ = NULL;
+    rawColorMode_ = -1;
+    for (i=0; i<SimNumScratch; i++) scratch_.free(i);
+}
+
 /** Template function to compute the simulated detector data for any data type */
-template <typename epicsType> int simDetector::computeArray(int sizeX, int sizeY)
+template <typename epicsType> int simRenderContext::computeArray(int sizeX, int sizeY)
 {
     int simMode;
     int status = asynSuccess;
     int resetImage;
+    int seed;
+    int colorMode;
+    int incremental;
     epicsType offset;
     double dOffset;
     double noise;
+    double gaussian, shot, read;
+    double gain, peakVariation;
     int i;
+    int line, numLines;
+    size_t first, n;
     epicsType* pRawData = (epicsType*)pRaw_->pData;
-    epicsType* pBackgroundData = (epicsType*)pBackground_->pData;
+    epicsType* pBackgroundData = (epicsType*)scratch_.data(SimScratchBackground);
+    epicsType* pPreviousData = pPreviousRaw_ ? (epicsType*)pPreviousRaw_->pData : pRawData;
 
-    getIntegerParam(SimMode, &simMode);
-    getIntegerParam(SimResetImage, &resetImage);
-    getDoubleParam(SimOffset, &dOffset);
-    getDoubleParam(SimNoise, &noise);
+    /* NOTE: This function may be called without the mutex, it only uses frameParams_ */
+
+    simMode       = frameParams_.simMode;
+    resetImage    = frameParams_.resetImage;
+    dOffset       = frameParams_.offset;
+    noise         = frameParams_.noise;
+    seed          = frameParams_.noiseSeed;
+    gaussian      = frameParams_.noiseGaussian;
+    shot          = frameParams_.noiseShot;
+    read          = frameParams_.noiseRead;
+    colorMode     = frameParams_.colorMode;
+    incremental   = frameParams_.incremental;
+    gain          = frameParams_.gain;
+    peakVariation = frameParams_.peakVariation;
 
     offset = (epicsType)dOffset;
-    if (resetImage) {
-        useBackground_ = false;
-        if ((noise != 0.) || (offset != 0)) {
-            useBackground_ = true;
+    /* useBackground_ and perFrameNoise_ are set by simDetector::claimFrame() */
+    if (resetImage & SimResetBackground) {
+        /* The scratch buffers are only allocated for the modes which use them */
+        if (!useBackground_) scratch_.free(SimScratchBackground);
+        if ((simMode != SimModeLinearRamp) || !(useBackground_ || perFrameNoise_)) scratch_.free(SimScratchRamp);
+        if (simMode != SimModePeaks) {
+            for (i=SimScratchPeak; i<=SimScratchPeakBuckets; i++) scratch_.free(i);
+        }
+        if (simMode != SimModeSine) {
+            for (i=SimScratchSineX1; i<=SimScratchSineRed; i++) scratch_.free(i);
+        }
+        if (simMode != SimModeGenerator) scratch_.free(SimScratchGenerator);
+        if ((simMode == SimModeLinearRamp) && (useBackground_ || perFrameNoise_)) {
+            /* The ramp is kept apart from the raw image, which also holds the background or noise */
+            if (!scratch_.alloc(SimScratchRamp, arrayInfo_.totalBytes)) {
+                asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                          "%s:computeArray: error allocating ramp buffer\n", driverName);
+                return asynError;
+            }
+        }
+        if (useBackground_) {
+            pBackgroundData = (epicsType *)scratch_.alloc(SimScratchBackground, arrayInfo_.totalBytes);
+            if (!pBackgroundData) {
+                asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                          "%s:computeArray: error allocating background buffer\n", driverName);
+                useBackground_ = false;
+                return asynError;
+            }
             if (noise == 0) {
                 for (i=0; i<arrayInfo_.nElements; i++) {
                     pBackgroundData[i] = offset;
                 }
             } else {
-                for (i=0; i<arrayInfo_.nElements; i++) {
-                    pBackgroundData[i] = (epicsType)((noise * (rand() / (double)RAND_MAX)) + offset);
-                }
+                backgroundJob<epicsType> job;
+                job.pData = pBackgroundData;
+                job.nElements = arrayInfo_.nElements;
+                job.noise = noise;
+                job.offset = offset;
+                job.seed = (epicsUInt32)seed;
+                runRowTasks(backgroundElements<epicsType>, &job, sizeY);
             }
         } 
     }
             
-    if (useBackground_) {
+    /* Decide how this frame differs from the previous one.  A background without noise is constant.
+     * The buffer of a tile holds the previous tile rather than the previous frame. */
+    frameClass_ = SimFrameDynamic;
+    if (incremental && !resetImage && !tileRows_ && !perFrameNoise_ && !(useBackground_ && (noise != 0.)) &&
+        windowContains(&validWindow_, &window_)) {
+        switch (simMode) {
+            case SimModeLinearRamp:
+                frameClass_ = ((epicsType)gain == 0) ? SimFrameStatic : SimFrameAffine;
+                break;
+            case SimModePeaks:
+                frameClass_ = (peakVariation == 0) ? SimFrameStatic : SimFrameDynamic;
+                break;
+            case SimModeOffsetNoise:
+                frameClass_ = SimFrameStatic;
+                break;
+            case SimModeGenerator:
+                frameClass_ = (pDetector_->pGenerator_ && (pDetector_->pGenerator_->capabilities() & SimGeneratorIncremental)) ?
+                              SimFrameStatic : SimFrameDynamic;
+                break;
+        }
+    }
+    /* With a constant background and integer data the previous image plus the increment is the same as
+     * the background plus the new ramp, so the ramp can be advanced in the raw image in a single pass */
+    fusedRamp_ = (frameClass_ == SimFrameAffine) && useBackground_ && std::numeric_limits<epicsType>::is_integer;
+
+    /* Only the lines of the window are computed */
+    numLines = windowNumLines(&window_, colorMode);
+    if (frameClass_ == SimFrameStatic) {
+        /* Keep the same sequence of random values as when the image is computed */
+        if (useBackground_) frameRandom_.uniform();
+        if (pPreviousData != pRawData) {
+            for (line=0; line<numLines; line++) {
+                windowLine(&window_, colorMode, sizeX, sizeY, line, &first, &n);
+                memcpy(pRawData + first, pPreviousData + first, n * arrayInfo_.bytesPerElement);
+            }
+        }
+        setRawColorMode(colorMode);
+        validWindow_ = window_;
+        return status;
+    }
+    if (fusedRamp_) {
+        frameRandom_.uniform();
+    } else if (useBackground_) {
         // Copy the pre-computed random noise array starting at a random location
-        int backgroundStart = (int)((arrayInfo_.nElements) * (rand() / (double)RAND_MAX));
-        int numCopy1 = (arrayInfo_.nElements - backgroundStart) * arrayInfo_.bytesPerElement;
-        int numCopy2 = backgroundStart * arrayInfo_.bytesPerElement;
-        memcpy(pRawData, pBackgroundData + backgroundStart, numCopy1); 
-        memcpy(pRawData + arrayInfo_.nElements - backgroundStart, pBackgroundData, numCopy2); 
+        size_t backgroundStart = (size_t)((arrayInfo_.nElements) * frameRandom_.uniform());
+        for (line=0; line<numLines; line++) {
+            size_t start, numCopy1;
+            windowLine(&window_, colorMode, sizeX, sizeY, line, &first, &n);
+            start = first + backgroundStart;
+            if (start >= arrayInfo_.nElements) start -= arrayInfo_.nElements;
+            numCopy1 = arrayInfo_.nElements - start;
+            if (numCopy1 > n) numCopy1 = n;
+            memcpy(pRawData + first, pBackgroundData + start, numCopy1 * arrayInfo_.bytesPerElement);
+            memcpy(pRawData + first + numCopy1, pBackgroundData, (n - numCopy1) * arrayInfo_.bytesPerElement);
+        }
     } else {
-        if (simMode != SimModeLinearRamp) {
-            memset(pRawData, 0, arrayInfo_.totalBytes);
+        if ((simMode != SimModeLinearRamp) && (simMode != SimModeFile)) {
+            for (line=0; line<numLines; line++) {
+                windowLine(&window_, colorMode, sizeX, sizeY, line, &first, &n);
+                memset(pRawData + first, 0, n * arrayInfo_.bytesPerElement);
+            }
         }
     }
              
@@ -101,593 +443,3107 @@ template <typename epicsType> int simDetector::computeArray(int sizeX, int sizeY
             break;
         case SimModeOffsetNoise:
             break;
+        case SimModeFile:
+            status = computeFileArray<epicsType>(sizeX, sizeY);
+            break;
+        case SimModeGenerator:
+            status = computeGeneratorArray<epicsType>(sizeX, sizeY);
+            break;
+    }
+    /* The frame is not published, and the raw buffer no longer holds a valid image */
+    if (status) {
+        validWindow_.sizeX = 0;
+        validWindow_.sizeY = 0;
+        return status;
+    }
+
+    if (perFrameNoise_) {
+        /* Add new noise to the signal; the linear ramp keeps its signal in its scratch buffer from frame to frame */
+        noiseJob<epicsType> job;
+        job.pOut = pRawData;
+        job.pIn = (simMode == SimModeLinearRamp) ? (epicsType *)scratch_.data(SimScratchRamp) : pRawData;
+        job.window = window_;
+        job.colorMode = colorMode;
+        job.sizeX = sizeX;
+        job.sizeY = sizeY;
+        job.rowLength = (colorMode == NDColorModeRGB1) ? 3 * (size_t)sizeX : (size_t)sizeX;
+        job.elementOrigin = (size_t)tileOffsetY_ * ((colorMode == NDColorModeMono) ? 1 : 3) * sizeX;
+        job.offset = (double)offset;
+        job.uniform = noise;
+        job.gaussian = gaussian;
+        job.shot = shot;
+        job.read = read;
+        job.key[0] = (epicsUInt32)seed;
+        job.key[1] = 0;
+        job.noiseStream     = SimRandomStreamNoise     + 2 * noiseFrame_;
+        job.readNoiseStream = SimRandomStreamReadNoise + 2 * noiseFrame_;
+        runRowTasks(noiseLines<epicsType>, &job, numLines);
     }
+    validWindow_ = window_;
 
     return status;
 }
 
-/** Template function to compute the simulated detector data for any data type */
-template <typename epicsType> int simDetector::computeLinearRampArray(int sizeX, int sizeY)
+/** Computes the pointers to the first red, green and blue pixels of a row of a color image,
+  * and the step between successive pixels of the same color */
+template <typename epicsType> static void colorRowPointers(epicsType *pData, int colorMode, int sizeX, int sizeY, int row,
+                                                           epicsType **ppRed, epicsType **ppGreen, epicsType **ppBlue,
+                                                           int *pColumnStep)
 {
-    epicsType *pMono=NULL, *pRed=NULL, *pGreen=NULL, *pBlue=NULL;
-    int columnStep=0, rowStep=0, colorMode;
+    switch (colorMode) {
+        case NDColorModeRGB1:
+            *pColumnStep = 3;
+            *ppRed   = pData + 3 * (size_t)row * sizeX;
+            *ppGreen = *ppRed + 1;
+            *ppBlue  = *ppRed + 2;
+            break;
+        case NDColorModeRGB2:
+            *pColumnStep = 1;
+            *ppRed   = pData + 3 * (size_t)row * sizeX;
+            *ppGreen = *ppRed + sizeX;
+            *ppBlue  = *ppRed + 2*sizeX;
+            break;
+        case NDColorModeRGB3:
+        default:
+            *pColumnStep = 1;
+            *ppRed   = pData + (size_t)row * sizeX;
+            *ppGreen = *ppRed + (size_t)sizeX*sizeY;
+            *ppBlue  = *ppRed + 2*(size_t)sizeX*sizeY;
+            break;
+    }
+}
+
+/** Job description for linearRampRows() */
+template <typename epicsType> struct linearRampJob {
+    epicsType *pData;
+    const epicsType *pPrevious;   /* The previous image; this is pData unless the previous buffer was published */
+    simWindow_t window;
+    simWindow_t valid;         /* Region of pPrevious which holds the previous frame of the ramp, empty after a reset */
+    int sizeX;
+    int sizeY;
+    int colorMode;
+    int rowOrigin;             /* Row of the frame of row 0 of the buffer, which is a tile */
+    double gainX;
+    double gainY;
     epicsType incMono, incRed, incGreen, incBlue;
+    epicsType offsetMono, offsetRed, offsetGreen, offsetBlue;   /* Added to the pixels computed from the ramp */
+    epicsType stepMono, stepRed, stepGreen, stepBlue;   /* Added to the pixels of pPrevious, whose frame is earlier */
+    const simKernels *pKernels;
+};
+
+/** Returns the sum of numFrames increments, as the ramp would have after numFrames frames.
+  * The integer types wrap around in the same way as adding the increment once per frame,
+  * and the floating point types can differ in the last bits. */
+template <typename epicsType> static epicsType rampOffset(epicsUInt64 numFrames, epicsType increment)
+{
+    if (std::numeric_limits<epicsType>::is_integer) {
+        return (epicsType)(numFrames * (epicsUInt64)increment);
+    }
+    return (epicsType)(numFrames * (double)increment);
+}
+
+/** Computes pixels [firstX, lastX) of a row of one color of the linear ramp from the ramp itself */
+template <typename epicsType> static void rampPixels(epicsType *pOut, int columnStep, int firstX, int lastX,
+                                                     double gainX, double y, epicsType inc, epicsType offset)
+{
+    int j;
+
+    for (j=firstX; j<lastX; j++) {
+        *pOut = (epicsType) (inc * (gainX*j + y)) + offset;
+        pOut += columnStep;
+    }
+}
+
+/** Advances numX pixels of a row of one color of the linear ramp from the previous frame */
+template <typename epicsType> static void advancePixels(const simKernels *pKernels, epicsType *pOut,
+                                                        const epicsType *pPrevious, int columnStep, int numX,
+                                                        epicsType inc)
+{
+    int j;
+
+    if (columnStep == 1) {
+        simAddConstant(pKernels, pOut, pPrevious, inc, numX);
+        return;
+    }
+    for (j=0; j<numX; j++) {
+        *pOut = *pPrevious + inc;
+        pOut += columnStep;
+        pPrevious += columnStep;
+    }
+}
+
+/** Computes a band of rows of the window of the linear ramp image.
+  * The pixels which hold a previous frame are advanced by the increments since that frame, and the others, which
+  * have just entered the window or follow a reset, are computed from the ramp and the increments since the reset. */
+template <typename epicsType> static void linearRampRows(void *pvt, int task, int numTasks)
+{
+    linearRampJob<epicsType> *pJob = (linearRampJob<epicsType> *)pvt;
+    epicsType *pRed, *pGreen, *pBlue;
+    epicsType *pPrevRed, *pPrevGreen, *pPrevBlue;
+    const epicsType *pPrevious = pJob->pPrevious;
+    const simWindow_t *pValid = &pJob->valid;
+    epicsType incMono=pJob->incMono, incRed=pJob->incRed, incGreen=pJob->incGreen, incBlue=pJob->incBlue;
+    epicsType stepMono=pJob->stepMono, stepRed=pJob->stepRed, stepGreen=pJob->stepGreen, stepBlue=pJob->stepBlue;
+    epicsType offsetMono=pJob->offsetMono, offsetRed=pJob->offsetRed;
+    epicsType offsetGreen=pJob->offsetGreen, offsetBlue=pJob->offsetBlue;
+    double gainX=pJob->gainX, gainY=pJob->gainY;
+    double y;
+    int sizeX = pJob->sizeX;
+    int minX = pJob->window.minX;
+    int maxX = pJob->window.minX + pJob->window.sizeX;
+    int addMinX, addMaxX;
+    int columnStep;
+    int firstRow, lastRow;
+    int i;
+
+    simRowBand(task, numTasks, pJob->window.sizeY, &firstRow, &lastRow);
+    firstRow += pJob->window.minY;
+    lastRow  += pJob->window.minY;
+    for (i=firstRow; i<lastRow; i++) {
+        y = gainY * (i + pJob->rowOrigin);
+        /* Columns [addMinX, addMaxX) of the row hold the previous frame */
+        addMinX = addMaxX = maxX;
+        if ((i >= pValid->minY) && (i < pValid->minY + pValid->sizeY)) {
+            addMinX = (pValid->minX > minX) ? pValid->minX : minX;
+            addMaxX = (pValid->minX + pValid->sizeX < maxX) ? pValid->minX + pValid->sizeX : maxX;
+            if (addMinX >= addMaxX) addMinX = addMaxX = maxX;
+        }
+        if (pJob->colorMode == NDColorModeMono) {
+            epicsType *pRow = pJob->pData + (size_t)i * sizeX;
+            rampPixels(pRow + minX, 1, minX, addMinX, gainX, y, incMono, offsetMono);
+            advancePixels(pJob->pKernels, pRow + addMinX, pPrevious + (size_t)i * sizeX + addMinX, 1,
+                          addMaxX - addMinX, stepMono);
+            rampPixels(pRow + addMaxX, 1, addMaxX, maxX, gainX, y, incMono, offsetMono);
+        } else {
+            colorRowPointers(pJob->pData, pJob->colorMode, sizeX, pJob->sizeY, i,
+                             &pRed, &pGreen, &pBlue, &columnStep);
+            colorRowPointers((epicsType *)pPrevious, pJob->colorMode, sizeX, pJob->sizeY, i,
+                             &pPrevRed, &pPrevGreen, &pPrevBlue, &columnStep);
+            rampPixels(pRed   + (size_t)minX * columnStep, columnStep, minX, addMinX, gainX, y, incRed,   offsetRed);
+            rampPixels(pGreen + (size_t)minX * columnStep, columnStep, minX, addMinX, gainX, y, incGreen, offsetGreen);
+            rampPixels(pBlue  + (size_t)minX * columnStep, columnStep, minX, addMinX, gainX, y, incBlue,  offsetBlue);
+            advancePixels(pJob->pKernels, pRed   + (size_t)addMinX * columnStep, pPrevRed   + (size_t)addMinX * columnStep,
+                          columnStep, addMaxX - addMinX, stepRed);
+            advancePixels(pJob->pKernels, pGreen + (size_t)addMinX * columnStep, pPrevGreen + (size_t)addMinX * columnStep,
+                          columnStep, addMaxX - addMinX, stepGreen);
+            advancePixels(pJob->pKernels, pBlue  + (size_t)addMinX * columnStep, pPrevBlue  + (size_t)addMinX * columnStep,
+                          columnStep, addMaxX - addMinX, stepBlue);
+            rampPixels(pRed   + (size_t)addMaxX * columnStep, columnStep, addMaxX, maxX, gainX, y, incRed,   offsetRed);
+            rampPixels(pGreen + (size_t)addMaxX * columnStep, columnStep, addMaxX, maxX, gainX, y, incGreen, offsetGreen);
+            rampPixels(pBlue  + (size_t)addMaxX * columnStep, columnStep, addMaxX, maxX, gainX, y, incBlue,  offsetBlue);
+        }
+    }
+}
+
+/** Job description for addArrayLines() */
+template <typename epicsType> struct addArrayJob {
+    epicsType *pOut;
+    epicsType *pIn;
+    simWindow_t window;
+    int colorMode;
+    int sizeX;
+    int sizeY;
+    const simKernels *pKernels;
+};
+
+/** Adds a band of lines of the window of one array to another */
+template <typename epicsType> static void addArrayLines(void *pvt, int task, int numTasks)
+{
+    addArrayJob<epicsType> *pJob = (addArrayJob<epicsType> *)pvt;
+    size_t first, n;
+    int firstLine, lastLine, line;
+
+    simRowBand(task, numTasks, windowNumLines(&pJob->window, pJob->colorMode), &firstLine, &lastLine);
+    for (line=firstLine; line<lastLine; line++) {
+        windowLine(&pJob->window, pJob->colorMode, pJob->sizeX, pJob->sizeY, line, &first, &n);
+        simAddArray(pJob->pKernels, pJob->pOut + first, pJob->pIn + first, n);
+    }
+}
+
+/** Copies a band of lines of the window of one array to another */
+template <typename epicsType> static void copyArrayLines(void *pvt, int task, int numTasks)
+{
+    addArrayJob<epicsType> *pJob = (addArrayJob<epicsType> *)pvt;
+    size_t first, n;
+    int firstLine, lastLine, line;
+
+    simRowBand(task, numTasks, windowNumLines(&pJob->window, pJob->colorMode), &firstLine, &lastLine);
+    for (line=firstLine; line<lastLine; line++) {
+        windowLine(&pJob->window, pJob->colorMode, pJob->sizeX, pJob->sizeY, line, &first, &n);
+        memcpy(pJob->pOut + first, pJob->pIn + first, n * sizeof(epicsType));
+    }
+}
+
+/** Runs a row-parallel job on the worker pool using the number of threads currently selected */
+void simRenderContext::runRowTasks(simWorkFunction func, void *pvt, int numRows)
+{
+    int numTasks;
+
+    if (!pDetector_->pWorkerPool_ || (numThreads_ <= 1)) {
+        func(pvt, 0, 1);
+        return;
+    }
+    /* Use a few bands per thread so that threads which finish early can pick up more work */
+    numTasks = numThreads_ * 4;
+    if (numTasks > numRows) numTasks = numRows;
+    if (numTasks < 1) numTasks = 1;
+    pDetector_->pWorkerPool_->run(func, pvt, numTasks, numThreads_);
+}
+
+/** Template function to compute the simulated detector data for any data type */
+template <typename epicsType> int simRenderContext::computeLinearRampArray(int sizeX, int sizeY)
+{
+    int colorMode;
+    epicsType incMono;
     int status = asynSuccess;
     double gain, gainX, gainY, gainRed, gainGreen, gainBlue;
     int resetImage;
-    int i, j;
+    bool rampInScratch;
     epicsType* pRawData = (epicsType*)pRaw_->pData;
-    epicsType* pRampData = (epicsType*)pRamp_->pData;
-    epicsType *pData;
+    epicsType* pRampData = (epicsType*)scratch_.data(SimScratchRamp);
+    linearRampJob<epicsType> job;
 
-    status = getDoubleParam (ADGain,        &gain);
-    status = getDoubleParam (SimGainX,      &gainX);
-    status = getDoubleParam (SimGainY,      &gainY);
-    status = getDoubleParam (SimGainRed,    &gainRed);
-    status = getDoubleParam (SimGainGreen,  &gainGreen);
-    status = getDoubleParam (SimGainBlue,   &gainBlue);
-    status = getIntegerParam(SimResetImage, &resetImage);
-    status = getIntegerParam(NDColorMode,   &colorMode);
+    gain       = frameParams_.gain;
+    gainX      = frameParams_.gainX;
+    gainY      = frameParams_.gainY;
+    gainRed    = frameParams_.gainRed;
+    gainGreen  = frameParams_.gainGreen;
+    gainBlue   = frameParams_.gainBlue;
+    resetImage = frameParams_.resetImage;
+    colorMode  = frameParams_.colorMode;
  
     /* The intensity at each pixel[i,j] is:
      * (i * gainX + j* gainY) + imageCounter * gain */
-    incMono  = (epicsType) (gain);
-    incRed   = (epicsType) gainRed   * incMono;
-    incGreen = (epicsType) gainGreen * incMono;
-    incBlue  = (epicsType) gainBlue  * incMono;
+    incMono      = (epicsType) (gain);
+    job.incMono  = incMono;
+    job.incRed   = (epicsType) gainRed   * incMono;
+    job.incGreen = (epicsType) gainGreen * incMono;
+    job.incBlue  = (epicsType) gainBlue  * incMono;
+    job.gainX = gainX;
+    job.gainY = gainY;
+    job.window = window_;
+    job.sizeX = sizeX;
+    job.sizeY = sizeY;
+    job.colorMode = colorMode;
+    job.rowOrigin = tileOffsetY_;
+    /* The ramp is only kept up to date inside the window, so the pixels which enter the window are computed
+     * from the frames since the reset, as is every pixel of a tile, since the buffer only holds a tile */
+    rampInScratch = (useBackground_ || perFrameNoise_) && !fusedRamp_;
+    job.valid = rampInScratch ? rampWindow_ : validWindow_;
+    if ((resetImage & SimResetRamp) || tileRows_ || (rampFrame_ < previousRampFrame_)) {
+        job.valid.sizeX = 0;
+        job.valid.sizeY = 0;
+    }
+    job.offsetMono  = rampOffset(rampFrame_, job.incMono);
+    job.offsetRed   = rampOffset(rampFrame_, job.incRed);
+    job.offsetGreen = rampOffset(rampFrame_, job.incGreen);
+    job.offsetBlue  = rampOffset(rampFrame_, job.incBlue);
+    /* The buffers of a render thread hold its previous frame, which is not always the previous frame of the ramp */
+    job.stepMono    = rampOffset(rampFrame_ - previousRampFrame_, job.incMono);
+    job.stepRed     = rampOffset(rampFrame_ - previousRampFrame_, job.incRed);
+    job.stepGreen   = rampOffset(rampFrame_ - previousRampFrame_, job.incGreen);
+    job.stepBlue    = rampOffset(rampFrame_ - previousRampFrame_, job.incBlue);
+    previousRampFrame_ = rampFrame_;
+    job.pKernels = pKernels_;
     
-    if (useBackground_) {
-        pData = pRampData;
+    if (rampInScratch) {
+        job.pData = pRampData;
+        job.pPrevious = pRampData;
     } else {
-        pData = pRawData;
+        job.pData = pRawData;
+        job.pPrevious = pPreviousRaw_ ? (epicsType *)pPreviousRaw_->pData : pRawData;
     }
+    setRawColorMode(colorMode);
 
-    switch (colorMode) {
-        case NDColorModeMono:
-            pMono = pData;
-            break;
-        case NDColorModeRGB1:
-            columnStep = 3;
-            rowStep = 0;
-            pRed   = pData;
-            pGreen = pData+1;
-            pBlue  = pData+2;
-            break;
-        case NDColorModeRGB2:
-            columnStep = 1;
-            rowStep = 2 * sizeX;
-            pRed   = pData;
-            pGreen = pData + sizeX;
-            pBlue  = pData + 2*sizeX;
-            break;
-        case NDColorModeRGB3:
-            columnStep = 1;
-            rowStep = 0;
-            pRed   = pData;
-            pGreen = pData + sizeX*sizeY;
-            pBlue  = pData + 2*sizeX*sizeY;
-            break;
+    runRowTasks(linearRampRows<epicsType>, &job, window_.sizeY);
+    /* The fused ramp is advanced in the raw image, so the ramp in the scratch buffer falls behind */
+    rampWindow_ = window_;
+    if (!rampInScratch) {
+        rampWindow_.sizeX = 0;
+        rampWindow_.sizeY = 0;
     }
-    pRaw_->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
 
-    if (resetImage) {
-        for (i=0; i<sizeY; i++) {
-            switch (colorMode) {
-                case NDColorModeMono:
-                    for (j=0; j<sizeX; j++) {
-                        (*pMono++) = (epicsType) (incMono * (gainX*j + gainY*i));
-                    }
-                    break;
-                case NDColorModeRGB1:
-                case NDColorModeRGB2:
-                case NDColorModeRGB3:
-                    for (j=0; j<sizeX; j++) {
-                        *pRed   = (epicsType) (incRed   * (gainX*j + gainY*i));
-                        *pGreen = (epicsType) (incGreen * (gainX*j + gainY*i));
-                        *pBlue  = (epicsType) (incBlue  * (gainX*j + gainY*i));
-                        pRed   += columnStep;
-                        pGreen += columnStep;
-                        pBlue  += columnStep;
-                    }
-                    pRed   += rowStep;
-                    pGreen += rowStep;
-                    pBlue  += rowStep;
-                    break;
-            }
-        }
-    } else {
-        for (i=0; i<sizeY; i++) {
-            switch (colorMode) {
-                case NDColorModeMono:
-                    for (j=0; j<sizeX; j++) {
-                            *pMono++ += incMono;
+    if (useBackground_ && !fusedRamp_) {
+        addArrayJob<epicsType> addJob;
+        addJob.pOut = pRawData;
+        addJob.pIn = pRampData;
+        addJob.window = window_;
+        addJob.colorMode = colorMode;
+        addJob.sizeX = sizeX;
+        addJob.sizeY = sizeY;
+        addJob.pKernels = pKernels_;
+        runRowTasks(addArrayLines<epicsType>, &addJob, windowNumLines(&window_, colorMode));
+    }
+    return(status);
+}
+
+/** Job description for peaksRows() */
+template <typename epicsType> struct peaksJob {
+    epicsType *pRawData;
+    epicsType *pPeakData;
+    epicsType *pTiles;
+    double *pGainVariation;
+    int *pBuckets;
+    simWindow_t window;
+    int sizeX;
+    int sizeY;
+    int colorMode;
+    int peaksStartX, peaksStartY, peaksStepX, peaksStepY;
+    int peaksNumX, peaksNumY;
+    int peakFullWidthX, peakFullWidthY;
+    double gainRed, gainGreen, gainBlue;
+    const simKernels *pKernels;
+};
+
+/** Divides rounding towards minus infinity, for divisor > 0 */
+static int floorDivide(int numerator, int divisor)
+{
+    return (numerator >= 0) ? numerator / divisor : -((divisor - 1 - numerator) / divisor);
+}
+
+/** Computes the range of the peaks along one axis which can overlap the pixels [lo, hi).
+  * \param[in] lo The first pixel.
+  * \param[in] hi The pixel after the last one.
+  * \param[in] start The centre of the first peak.
+  * \param[in] step The distance between the peaks.
+  * \param[in] num The number of peaks.
+  * \param[in] fullWidth The full width of a peak.
+  * \param[out] pFirst The first peak.
+  * \param[out] pLast The peak after the last one. */
+static void peakRange(int lo, int hi, int start, int step, int num, int fullWidth, int *pFirst, int *pLast)
+{
+    *pFirst = 0;
+    *pLast = num;
+    /* With other steps the peaks are not in order, so they are all tested */
+    if (step <= 0) return;
+    /* Peak p covers the pixels [start + p*step - fullWidth/2, start + p*step - fullWidth/2 + fullWidth) */
+    *pFirst = floorDivide(lo - start + fullWidth/2 - fullWidth, step) + 1;
+    *pLast  = floorDivide(hi - start + fullWidth/2 - 1, step) + 1;
+    if (*pFirst < 0) *pFirst = 0;
+    if (*pLast > num) *pLast = num;
+}
+
+/** Adds the peaks to a band of output rows of the window.
+  * Only the peaks which overlap the band are visited, and the part of each peak row which is inside
+  * the window is computed once, so the inner loops have no bounds checks.
+  * Each task only writes the rows it owns, so tasks never update the same pixel. */
+template <typename epicsType> static void peaksRows(void *pvt, int task, int numTasks)
+{
+    peaksJob<epicsType> *pJob = (peaksJob<epicsType> *)pvt;
+    epicsType *pRed=NULL, *pGreen=NULL, *pBlue=NULL;
+    epicsType *pIn, *pOut, *pTile;
+    int sizeX = pJob->sizeX;
+    int peakFullWidthX = pJob->peakFullWidthX;
+    int peakFullWidthY = pJob->peakFullWidthY;
+    size_t tileSize = (size_t)peakFullWidthX * peakFullWidthY;
+    int numChannels = (pJob->colorMode == NDColorModeMono) ? 1 : 3;
+    int minX = pJob->window.minX;
+    int maxX = pJob->window.minX + pJob->window.sizeX;
+    int firstRow, lastRow;
+    int firstI, lastI, firstJ, lastJ;
+    int firstK, lastK, firstL, lastL;
+    int i, j, k, l, n;
+    int xOut, yOut;
+    int offsetX, offsetY;
+    int columnStep;
+    double gainVariation;
+
+    simRowBand(task, numTasks, pJob->window.sizeY, &firstRow, &lastRow);
+    firstRow += pJob->window.minY;
+    lastRow  += pJob->window.minY;
+    peakRange(firstRow, lastRow, pJob->peaksStartY, pJob->peaksStepY, pJob->peaksNumY, peakFullWidthY, &firstI, &lastI);
+    peakRange(minX, maxX, pJob->peaksStartX, pJob->peaksStepX, pJob->peaksNumX, peakFullWidthX, &firstJ, &lastJ);
+    for (i=firstI; i<lastI; i++) {
+        offsetY = i * pJob->peaksStepY + pJob->peaksStartY;
+        /* Only the rows of this peak which fall in this band */
+        firstK = firstRow - offsetY + peakFullWidthY/2;
+        lastK  = lastRow  - offsetY + peakFullWidthY/2;
+        if (firstK < 0) firstK = 0;
+        if (lastK > peakFullWidthY) lastK = peakFullWidthY;
+        if (firstK >= lastK) continue;
+        for (j=firstJ; j<lastJ; j++) {
+            offsetX = j * pJob->peaksStepX + pJob->peaksStartX;
+            /* Only the columns of this peak which fall in the window */
+            firstL = minX - offsetX + peakFullWidthX/2;
+            lastL  = maxX - offsetX + peakFullWidthX/2;
+            if (firstL < 0) firstL = 0;
+            if (lastL > peakFullWidthX) lastL = peakFullWidthX;
+            if (firstL >= lastL) continue;
+            n = lastL - firstL;
+            xOut = offsetX + firstL - peakFullWidthX/2;
+            gainVariation = pJob->pGainVariation[i * pJob->peaksNumX + j];
+            pTile = pJob->pTiles ?
+                    pJob->pTiles + (size_t)pJob->pBuckets[i * pJob->peaksNumX + j] * numChannels * tileSize : NULL;
+            for (k=firstK; k<lastK; k++) {
+                yOut = offsetY + k - peakFullWidthY/2;
+                if (pJob->colorMode == NDColorModeMono) {
+                    pOut = pJob->pRawData + (size_t)yOut * sizeX + xOut;
+                    if (pTile) {
+                        simAddArray(pJob->pKernels, pOut, pTile + (size_t)k * peakFullWidthX + firstL, n);
+                    } else {
+                        pIn = pJob->pPeakData + (size_t)k * peakFullWidthX + firstL;
+                        for (l=0; l<n; l++) pOut[l] += gainVariation * pIn[l];
                     }
-                    break;
-                case NDColorModeRGB1:
-                case NDColorModeRGB2:
-                case NDColorModeRGB3:
-                    for (j=0; j<sizeX; j++) {
-                        *pRed   += incRed;
-                        *pGreen += incGreen;
-                        *pBlue  += incBlue;
-                        pRed   += columnStep;
-                        pGreen += columnStep;
-                        pBlue  += columnStep;
+                } else {
+                    //Move to the starting point for this peak
+                    colorRowPointers(pJob->pRawData, pJob->colorMode, sizeX, pJob->sizeY, yOut,
+                                     &pRed, &pGreen, &pBlue, &columnStep);
+                    pRed   += (size_t)xOut * columnStep;
+                    pGreen += (size_t)xOut * columnStep;
+                    pBlue  += (size_t)xOut * columnStep;
+                    //Fill in a row for this peak
+                    if (pTile) {
+                        epicsType *pTileRed   = pTile + (size_t)k * peakFullWidthX + firstL;
+                        epicsType *pTileGreen = pTileRed + tileSize;
+                        epicsType *pTileBlue  = pTileGreen + tileSize;
+                        for (l=0; l<n; l++) {
+                            pRed  [l * columnStep] += pTileRed[l];
+                            pGreen[l * columnStep] += pTileGreen[l];
+                            pBlue [l * columnStep] += pTileBlue[l];
+                        }
+                    } else {
+                        pIn = pJob->pPeakData + (size_t)k * peakFullWidthX + firstL;
+                        for (l=0; l<n; l++) {
+                            pRed  [l * columnStep] += (epicsType)(pJob->gainRed   * gainVariation * pIn[l]);
+                            pGreen[l * columnStep] += (epicsType)(pJob->gainGreen * gainVariation * pIn[l]);
+                            pBlue [l * columnStep] += (epicsType)(pJob->gainBlue  * gainVariation * pIn[l]);
+                        }
                     }
-                    pRed   += rowStep;
-                    pGreen += rowStep;
-                    pBlue  += rowStep;
-                    break;
+                }
             }
         }
     }
-    if (useBackground_) {
-        for (i=0; i<arrayInfo_.nElements; i++) {
-            pRawData[i] += pRampData[i];
-        }
-    }
-    return(status);
 }
 
 /** Compute array for array of peaks */
-template <typename epicsType> int simDetector::computePeaksArray(int sizeX, int sizeY)
+template <typename epicsType> int simRenderContext::computePeaksArray(int sizeX, int sizeY)
 {
-    epicsType *pRed=NULL, *pGreen=NULL, *pBlue=NULL;
     int colorMode;
     int peaksStartX, peaksStartY, peaksStepX, peaksStepY;
     int peaksNumX, peaksNumY, peaksWidthX, peaksWidthY;
     int peakFullWidthX, peakFullWidthY;
+    int numBuckets, numChannels;
+    int frameSizeY;
+    bool drawGains;
     int status = asynSuccess;
-    int i,j,k,l;
-    int xOut, yOut;
-    int offsetX, offsetY;
-    double peakVariation;
+    int i,j;
+    double peakVariation, peakShiftX, peakShiftY;
+    double random;
     int resetImage;
-    double gain, gainVariation, gainRed, gainGreen, gainBlue;
-    epicsType *pPeakData = (epicsType*)pPeak_->pData;
+    double gain, gainRed, gainGreen, gainBlue;
+    epicsType *pPeakData = (epicsType*)scratch_.data(SimScratchPeak);
+    epicsType *pTiles = (epicsType*)scratch_.data(SimScratchPeakTiles);
+    char *pTileValid = (char *)scratch_.data(SimScratchPeakTileValid);
+    int *pBuckets;
     epicsType *pRawData = (epicsType*)pRaw_->pData;
-    epicsType *pIn, *pOut;
-
-    status = getIntegerParam(NDColorMode,   &colorMode);
-    status = getDoubleParam (ADGain,        &gain);
-    status = getDoubleParam (SimGainRed,    &gainRed);
-    status = getDoubleParam (SimGainGreen,  &gainGreen);
-    status = getDoubleParam (SimGainBlue,   &gainBlue);
-    status = getIntegerParam (SimPeakStartX,  &peaksStartX);
-    status = getIntegerParam (SimPeakStartY,  &peaksStartY);
-    status = getIntegerParam (SimPeakStepX,  &peaksStepX);
-    status = getIntegerParam (SimPeakStepY,  &peaksStepY);
-    status = getIntegerParam (SimPeakNumX,  &peaksNumX);
-    status = getIntegerParam (SimPeakNumY,  &peaksNumY);
-    status = getIntegerParam (SimPeakWidthX,  &peaksWidthX);
-    status = getIntegerParam (SimPeakWidthY,  &peaksWidthY);
-    status = getDoubleParam (SimPeakHeightVariation,  &peakVariation);
-    status = getIntegerParam(SimResetImage, &resetImage);
+    epicsType *pOut;
+    size_t tileSize;
+    peaksJob<epicsType> job;
+
+    colorMode     = frameParams_.colorMode;
+    gain          = frameParams_.gain;
+    gainRed       = frameParams_.gainRed;
+    gainGreen     = frameParams_.gainGreen;
+    gainBlue      = frameParams_.gainBlue;
+    peaksStartX   = frameParams_.peakStartX;
+    peaksStartY   = frameParams_.peakStartY;
+    peaksStepX    = frameParams_.peakStepX;
+    peaksStepY    = frameParams_.peakStepY;
+    peaksNumX     = frameParams_.peakNumX;
+    peaksNumY     = frameParams_.peakNumY;
+    peaksWidthX   = frameParams_.peakWidthX;
+    peaksWidthY   = frameParams_.peakWidthY;
+    peakVariation = frameParams_.peakVariation;
+    peakShiftX    = frameParams_.peakShiftX;
+    peakShiftY    = frameParams_.peakShiftY;
+    numBuckets    = frameParams_.peakGainBuckets;
+    resetImage    = frameParams_.resetImage;
+    frameSizeY    = frameParams_.maxSizeY;
 
+    /* The peaks are limited by the size of the frame, not of the tile */
+    if (!tileRows_) frameSizeY = sizeY;
     peakFullWidthX = ((2 * MAX_PEAK_SIGMA * peaksWidthX + 1) < sizeX) ? (2 * MAX_PEAK_SIGMA * peaksWidthX + 1) : (sizeX - 1);
-    peakFullWidthY = ((2 * MAX_PEAK_SIGMA * peaksWidthY + 1) < sizeY) ? (2 * MAX_PEAK_SIGMA * peaksWidthY + 1) : (sizeY - 1);
+    peakFullWidthY = ((2 * MAX_PEAK_SIGMA * peaksWidthY + 1) < frameSizeY) ? (2 * MAX_PEAK_SIGMA * peaksWidthY + 1) : (frameSizeY - 1);
 
-    if (resetImage) {
-        // Compute a 2-D Gaussian according to parameters
-        double gaussX, gaussY;
+    if (peakFullWidthX < 0) peakFullWidthX = 0;
+    if (peakFullWidthY < 0) peakFullWidthY = 0;
+    tileSize = (size_t)peakFullWidthX * peakFullWidthY;
+    numChannels = (colorMode == NDColorModeMono) ? 1 : 3;
+    if (numBuckets < 0) numBuckets = 0;
+
+    /* The whole pixels of the shift move the peaks, the fraction moves the centre of the profiles */
+    peaksStartX += (int)floor(peakShiftX);
+    peaksStartY += (int)floor(peakShiftY);
+    peakShiftX -= floor(peakShiftX);
+    peakShiftY -= floor(peakShiftY);
+
+    if (resetImage & SimResetPeaks) {
+        // Compute a 2-D Gaussian according to parameters, in a buffer of the size of one peak,
+        // as the outer product of the profiles along X and Y
+        double *pProfileX, *pProfileY;
+        pPeakData = (epicsType *)scratch_.alloc(SimScratchPeak, tileSize * sizeof(epicsType));
+        pProfileX = (double *)scratch_.alloc(SimScratchPeakProfileX, peakFullWidthX * sizeof(double));
+        pProfileY = (double *)scratch_.alloc(SimScratchPeakProfileY, peakFullWidthY * sizeof(double));
+        if (!pPeakData || !pProfileX || !pProfileY) {
+            scratch_.free(SimScratchPeak);
+            pPeakData = NULL;
+            peakFullWidthX = peakFullWidthY = 0;
+        }
+        for (j=0; j<peakFullWidthX; j++) {
+            pProfileX[j] = exp( -pow((double)(j-peakFullWidthX/2 - peakShiftX)/(double)peaksWidthX,2.0)/2.0 );
+        }
         for (i=0; i<peakFullWidthY; i++) {
-            pOut = pPeakData + (i * sizeX);
+            pProfileY[i] = exp( -pow((double)(i-peakFullWidthY/2 - peakShiftY)/(double)peaksWidthY,2.0)/2.0 );
+        }
+        for (i=0; i<peakFullWidthY; i++) {
+            pOut = pPeakData + (i * peakFullWidthX);
             for (j=0; j<peakFullWidthX; j++) {
-                gaussY = exp( -pow((double)(i-peakFullWidthY/2)/(double)peaksWidthY,2.0)/2.0 );
-                gaussX = exp( -pow((double)(j-peakFullWidthX/2)/(double)peaksWidthX,2.0)/2.0 );
-                *pOut++ = (epicsType)(gain * gaussX * gaussY);
+                *pOut++ = (epicsType)(gain * pProfileX[j] * pProfileY[i]);
             }
         }
+        /* The scaled peaks are computed when a bucket is first used */
+        pTiles = NULL;
+        pTileValid = NULL;
+        if ((numBuckets > 0) && (tileSize > 0)) {
+            pTiles = (epicsType *)scratch_.alloc(SimScratchPeakTiles,
+                                                 (size_t)numBuckets * numChannels * tileSize * sizeof(epicsType));
+            pTileValid = (char *)scratch_.alloc(SimScratchPeakTileValid, numBuckets);
+        }
+        if (pTiles && pTileValid) {
+            memset(pTileValid, 0, numBuckets);
+        } else {
+            scratch_.free(SimScratchPeakTiles);
+            scratch_.free(SimScratchPeakTileValid);
+            pTiles = NULL;
+        }
+    }
+    if (!pPeakData) {
+        peakFullWidthX = peakFullWidthY = 0;
+        tileSize = 0;
     }
+    if (!pTileValid) pTiles = NULL;
 
-    pRaw_->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
-    for (i=0; i<peaksNumY; i++) {
+    setRawColorMode(colorMode);
+    if (peaksNumX < 0) peaksNumX = 0;
+    if (peaksNumY < 0) peaksNumY = 0;
+
+    /* The gain variations are computed up front, in the same order as the peaks are drawn,
+     * so the rows can be computed in parallel.  The tiles of a frame share the gains of its first tile. */
+    drawGains = (tileIndex_ == 0) || resetImage || (peaksNumX * peaksNumY > numPeakGains_);
+    if (peaksNumX * peaksNumY > numPeakGains_) {
+        free(peakGains_);
+        numPeakGains_ = peaksNumX * peaksNumY;
+        peakGains_ = (double *)malloc(numPeakGains_ * sizeof(double));
+        if (!peakGains_) {
+            asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:computePeaksArray: error allocating peak gains\n", driverName);
+            numPeakGains_ = 0;
+            return asynError;
+        }
+    }
+    pBuckets = NULL;
+    if (pTiles) {
+        pBuckets = (int *)scratch_.alloc(SimScratchPeakBuckets, (size_t)peaksNumX * peaksNumY * sizeof(int));
+        if (!pBuckets) pTiles = NULL;
+    }
+    for (i=0; drawGains && (i<peaksNumY); i++) {
         for (j=0; j<peaksNumX; j++) {
+            random = (peakVariation != 0) ? frameRandom_.uniform() : 0.5;
+            if (pTiles) {
+                /* The peaks in a bucket all have the gain of the centre of the bucket */
+                int bucket = (int)(random * numBuckets);
+                if (bucket >= numBuckets) bucket = numBuckets - 1;
+                pBuckets[i * peaksNumX + j] = bucket;
+                random = (bucket + 0.5) / numBuckets;
+            }
             if (peakVariation != 0) {
-                gainVariation = (1.0 + ((peakVariation / 100.0) * (((rand() / (double)RAND_MAX)) - 0.5)));
+                peakGains_[i * peaksNumX + j] = (1.0 + ((peakVariation / 100.0) * (random - 0.5)));
             }
             else {
-                gainVariation = 1.0;
+                peakGains_[i * peaksNumX + j] = 1.0;
             }
-            offsetY = i * peaksStepY + peaksStartY;
-            offsetX = j * peaksStepX + peaksStartX;
-            if (colorMode == NDColorModeMono) {
-                for (k=0; k<peakFullWidthY; k++) {
-                    pIn = pPeakData + k * sizeX;
-                    yOut = offsetY + k - peakFullWidthY/2;
-                    if ((yOut < 0) || (yOut >= sizeY)) continue;
-                    pOut = pRawData + yOut * sizeX;
-                    for (l=0; l<peakFullWidthX; l++, pIn++) {
-                        xOut = offsetX + l - peakFullWidthX/2;
-                        if ((xOut < 0) || (xOut >= sizeX)) continue;
-                        pOut[xOut] += gainVariation * *pIn;
+            if (pTiles && !pTileValid[pBuckets[i * peaksNumX + j]]) {
+                /* Scale the peak by the gain of this bucket and the color gains */
+                double channelGains[3];
+                size_t m;
+                int c;
+                epicsType *pTile = pTiles + (size_t)pBuckets[i * peaksNumX + j] * numChannels * tileSize;
+                channelGains[0] = (numChannels == 1) ? 1.0 : gainRed;
+                channelGains[1] = gainGreen;
+                channelGains[2] = gainBlue;
+                for (c=0; c<numChannels; c++) {
+                    for (m=0; m<tileSize; m++) {
+                        *pTile++ = (epicsType)(channelGains[c] * peakGains_[i * peaksNumX + j] * pPeakData[m]);
                     }
                 }
+                pTileValid[pBuckets[i * peaksNumX + j]] = 1;
+            }
+        }
+    }
+
+    job.pRawData = pRawData;
+    job.pPeakData = pPeakData;
+    job.pTiles = pTiles;
+    job.pGainVariation = peakGains_;
+    job.pBuckets = pBuckets;
+    job.window = window_;
+    job.sizeX = sizeX;
+    job.sizeY = sizeY;
+    job.colorMode = colorMode;
+    job.peaksStartX = peaksStartX;
+    job.peaksStartY = peaksStartY - tileOffsetY_;
+    job.peaksStepX = peaksStepX;
+    job.peaksStepY = peaksStepY;
+    job.peaksNumX = peaksNumX;
+    job.peaksNumY = peaksNumY;
+    job.peakFullWidthX = peakFullWidthX;
+    job.peakFullWidthY = peakFullWidthY;
+    job.gainRed = gainRed;
+    job.gainGreen = gainGreen;
+    job.gainBlue = gainBlue;
+    job.pKernels = pKernels_;
+    runRowTasks(peaksRows<epicsType>, &job, window_.sizeY);
+
+    return status;
+}
+
+/** Job description for sineRows() */
+template <typename epicsType> struct sineJob {
+    epicsType *pData;
+    simWindow_t window;
+    int sizeX;
+    int sizeY;
+    int colorMode;
+    double gain, gainRed, gainGreen, gainBlue;
+    double *xSine1, *xSine2, *ySine1, *ySine2, *xRed;
+    const simKernels *pKernels;
+};
+
+/** Adds the sine waves to a band of rows of the window */
+template <typename epicsType> static void sineRows(void *pvt, int task, int numTasks)
+{
+    sineJob<epicsType> *pJob = (sineJob<epicsType> *)pvt;
+    epicsType *pMono, *pRed, *pGreen, *pBlue;
+    double gain=pJob->gain, gainRed=pJob->gainRed, gainGreen=pJob->gainGreen, gainBlue=pJob->gainBlue;
+    double *xSine1=pJob->xSine1, *xSine2=pJob->xSine2, *ySine1=pJob->ySine1, *ySine2=pJob->ySine2;
+    double *xRed=pJob->xRed;
+    int sizeX = pJob->sizeX;
+    int minX = pJob->window.minX;
+    int numX = pJob->window.sizeX;
+    int columnStep;
+    int firstRow, lastRow;
+    int i, j;
+
+    simRowBand(task, numTasks, pJob->window.sizeY, &firstRow, &lastRow);
+    firstRow += pJob->window.minY;
+    lastRow  += pJob->window.minY;
+    xSine1 += minX;
+    xSine2 += minX;
+    if (xRed) xRed += minX;
+    for (i=firstRow; i<lastRow; i++) {
+        if (pJob->colorMode == NDColorModeMono) {
+            pMono = pJob->pData + (size_t)i * sizeX + minX;
+            simAddSine(pJob->pKernels, pMono, xSine1, ySine1[i], gain, 1., numX);
+        } else {
+            colorRowPointers(pJob->pData, pJob->colorMode, sizeX, pJob->sizeY, i,
+                             &pRed, &pGreen, &pBlue, &columnStep);
+            pRed   += (size_t)minX * columnStep;
+            pGreen += (size_t)minX * columnStep;
+            pBlue  += (size_t)minX * columnStep;
+            if (columnStep == 1) {
+                /* Same arithmetic as the loop below; dividing by 2 and multiplying by 0.5 are identical */
+                simAddScaled(pJob->pKernels, pRed, xSine1, gain * gainRed, numX);
+                simAddConstant(pJob->pKernels, pGreen, pGreen, (epicsType)(gain * gainGreen * ySine1[i]), numX);
+                simAddSine(pJob->pKernels, pBlue, xSine2, ySine2[i], gain * gainBlue, 0.5, numX);
             } else {
-                for (k=0; k<peakFullWidthY; k++) {
-                    //Move to the starting point for this peak
-                    pIn = pPeakData + k * sizeX;
-                    yOut = offsetY + k - peakFullWidthY/2;
-                    if ((yOut < 0) || (yOut >= sizeY)) continue;
-                    int columnStep = 1;
-                    switch (colorMode) {
-                        case NDColorModeRGB1:
-                            columnStep = 3;
-                            pRed = pRawData + 3 * yOut * sizeX;
-                            pGreen = pRed + 1;
-                            pBlue = pRed + 2;
-                            break;
-                        case NDColorModeRGB2:
-                            pRed = pRawData + 3 * yOut * sizeX;
-                            pGreen = pRed + sizeX;
-                            pBlue = pRed + 2 * sizeX;
-                            break;
-                        case NDColorModeRGB3:
-                            pRed = pRawData + yOut * sizeX;
-                            pGreen = pRed + sizeX * sizeY;
-                            pBlue = pRed + 2 * sizeX * sizeY;
-                            break;
-                    }
-                    //Fill in a row for this peak
-                    for (l=0; l<peakFullWidthX; l++, pIn++) {
-                        xOut = offsetX + l - peakFullWidthX/2;
-                        if ((xOut < 0) || (xOut >= sizeX)) continue;
-                        xOut *= columnStep;
-                        pRed[xOut]   += (epicsType)(gainRed   * gainVariation * *pIn);
-                        pGreen[xOut] += (epicsType)(gainGreen * gainVariation * *pIn);
-                        pBlue[xOut]  += (epicsType)(gainBlue  * gainVariation * *pIn);
-                    }
+                /* The red gain is folded into xRed, and green is the same for the whole row */
+                epicsType green = (epicsType)(gain * gainGreen * ySine1[i]);
+                double blueGain = gain * gainBlue;
+                double y2 = ySine2[i];
+                for (j=0; j<numX; j++) {
+                    *pRed   += (epicsType)xRed[j];
+                    *pGreen += green;
+                    *pBlue  += (epicsType)(blueGain * (xSine2[j] + y2)/2.);
+                    pRed   += columnStep;
+                    pGreen += columnStep;
+                    pBlue  += columnStep;
                 }
             }
         }
     }
+}
 
-    return status;
+/** Computes elements [first, last) of a sine wave table,
+  * table[i] = amplitude * sin(2 pi ((counter + i) * gain / size * frequency + phase/360)).
+  * Each element is computed from the previous one by rotating (sin, cos) by the constant angle between
+  * elements.  The recurrence is restarted from sin() and cos() every SINE_RESTART elements, so that its
+  * rounding errors do not accumulate. */
+static void sineTable(double *table, int first, int last, double counter, double gain, int size,
+                      double amplitude, double frequency, double phase)
+{
+    double step = gain / size * frequency * 2. * M_PI;
+    double cosStep = cos(step), sinStep = sin(step);
+    double angle, s, c, t;
+    int i, blockEnd;
+
+    for (i=first; i<last; ) {
+        angle = ((counter + i) * gain / size * frequency + phase/360.) * 2. * M_PI;
+        s = sin(angle);
+        c = cos(angle);
+        table[i++] = amplitude * s;
+        blockEnd = (last - i > SINE_RESTART - 1) ? i + SINE_RESTART - 1 : last;
+        for (; i<blockEnd; i++) {
+            t = s * cosStep + c * sinStep;
+            c = c * cosStep - s * sinStep;
+            s = t;
+            table[i] = amplitude * s;
+        }
+    }
 }
 
 /** Template function to compute the simulated detector data for any data type */
-template <typename epicsType> int simDetector::computeSineArray(int sizeX, int sizeY)
+template <typename epicsType> int simRenderContext::computeSineArray(int sizeX, int sizeY)
 {
-    epicsType *pMono=NULL, *pRed=NULL, *pGreen=NULL, *pBlue=NULL;
-    int columnStep=0, rowStep=0, colorMode;
+    int colorMode;
     int status = asynSuccess;
     int xSineOperation, ySineOperation;   
-    double exposureTime, gain, gainX, gainY, gainRed, gainGreen, gainBlue;
+    double gain, gainX, gainY, gainRed, gainGreen, gainBlue;
     double xSine1Amplitude, xSine1Frequency, xSine1Phase;
     double xSine2Amplitude, xSine2Frequency, xSine2Phase;
     double ySine1Amplitude, ySine1Frequency, ySine1Phase;
     double ySine2Amplitude, ySine2Frequency, ySine2Phase;
-    double xTime, yTime;
-    int resetImage;
-    int i, j;
+    double *xSine1, *xSine2, *ySine1, *ySine2, *xRed;
+    int i;
+    int minX, maxX, minY, maxY;
+    int frameSizeY;
+    sineJob<epicsType> job;
 
-    status = getDoubleParam (ADGain,            &gain);
-    status = getDoubleParam (SimGainX,          &gainX);
-    status = getDoubleParam (SimGainY,          &gainY);
-    status = getDoubleParam (SimGainRed,        &gainRed);
-    status = getDoubleParam (SimGainGreen,      &gainGreen);
-    status = getDoubleParam (SimGainBlue,       &gainBlue);
-    status = getIntegerParam(SimResetImage,     &resetImage);
-    status = getIntegerParam(NDColorMode,       &colorMode);
-    status = getDoubleParam (ADAcquireTime,     &exposureTime);
-    status = getIntegerParam(SimXSineOperation, &xSineOperation);
-    status = getDoubleParam(SimXSine1Amplitude, &xSine1Amplitude);
-    status = getDoubleParam(SimXSine1Frequency, &xSine1Frequency);
-    status = getDoubleParam(SimXSine1Phase,     &xSine1Phase);
-    status = getDoubleParam(SimXSine2Amplitude, &xSine2Amplitude);
-    status = getDoubleParam(SimXSine2Frequency, &xSine2Frequency);
-    status = getDoubleParam(SimXSine2Phase,     &xSine2Phase);
-    status = getIntegerParam(SimYSineOperation, &ySineOperation);
-    status = getDoubleParam(SimYSine1Amplitude, &ySine1Amplitude);
-    status = getDoubleParam(SimYSine1Frequency, &ySine1Frequency);
-    status = getDoubleParam(SimYSine1Phase,     &ySine1Phase);
-    status = getDoubleParam(SimYSine2Amplitude, &ySine2Amplitude);
-    status = getDoubleParam(SimYSine2Frequency, &ySine2Frequency);
-    status = getDoubleParam(SimYSine2Phase,     &ySine2Phase);
+    gain            = frameParams_.gain;
+    gainX           = frameParams_.gainX;
+    gainY           = frameParams_.gainY;
+    gainRed         = frameParams_.gainRed;
+    gainGreen       = frameParams_.gainGreen;
+    gainBlue        = frameParams_.gainBlue;
+    colorMode       = frameParams_.colorMode;
+    xSineOperation  = frameParams_.xSineOperation;
+    xSine1Amplitude = frameParams_.xSine1Amplitude;
+    xSine1Frequency = frameParams_.xSine1Frequency;
+    xSine1Phase     = frameParams_.xSine1Phase;
+    xSine2Amplitude = frameParams_.xSine2Amplitude;
+    xSine2Frequency = frameParams_.xSine2Frequency;
+    xSine2Phase     = frameParams_.xSine2Phase;
+    ySineOperation  = frameParams_.ySineOperation;
+    ySine1Amplitude = frameParams_.ySine1Amplitude;
+    ySine1Frequency = frameParams_.ySine1Frequency;
+    ySine1Phase     = frameParams_.ySine1Phase;
+    ySine2Amplitude = frameParams_.ySine2Amplitude;
+    ySine2Frequency = frameParams_.ySine2Frequency;
+    ySine2Phase     = frameParams_.ySine2Phase;
+    frameSizeY      = frameParams_.maxSizeY;
 
-    switch (colorMode) {
-        case NDColorModeMono:
-            pMono = (epicsType *)pRaw_->pData;
-            break;
+    setRawColorMode(colorMode);
+    /* The tables along Y are for the whole frame, and each tile uses its rows of them */
+    if (!tileRows_) frameSizeY = sizeY;
+
+    /* The tables keep their buffers across resets, and are only reallocated when the image size changes */
+    xSine1 = (double *)scratch_.alloc(SimScratchSineX1, sizeX * sizeof(double));
+    xSine2 = (double *)scratch_.alloc(SimScratchSineX2, sizeX * sizeof(double));
+    ySine1 = (double *)scratch_.alloc(SimScratchSineY1, frameSizeY * sizeof(double));
+    ySine2 = (double *)scratch_.alloc(SimScratchSineY2, frameSizeY * sizeof(double));
+    xRed = NULL;
+    if (colorMode == NDColorModeRGB1) {
+        xRed = (double *)scratch_.alloc(SimScratchSineRed, sizeX * sizeof(double));
+    } else {
+        scratch_.free(SimScratchSineRed);
+    }
+    if (!xSine1 || !xSine2 || !ySine1 || !ySine2 || ((colorMode == NDColorModeRGB1) && !xRed)) {
+        asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:computeSineArray: error allocating sine tables\n", driverName);
+        return asynError;
+    }
+    /* Only the part of the tables in the window is computed, but the counters still advance by the full size
+     * once per frame, see simDetector::claimFrame() */
+    minX = window_.minX;
+    maxX = window_.minX + window_.sizeX;
+    minY = window_.minY + tileOffsetY_;
+    maxY = window_.minY + window_.sizeY + tileOffsetY_;
+    sineTable(xSine1, minX, maxX, xSineCounter_, gainX, sizeX, xSine1Amplitude, xSine1Frequency, xSine1Phase);
+    sineTable(xSine2, minX, maxX, xSineCounter_, gainX, sizeX, xSine2Amplitude, xSine2Frequency, xSine2Phase);
+    sineTable(ySine1, minY, maxY, ySineCounter_, gainY, frameSizeY, ySine1Amplitude, ySine1Frequency, ySine1Phase);
+    sineTable(ySine2, minY, maxY, ySineCounter_, gainY, frameSizeY, ySine2Amplitude, ySine2Frequency, ySine2Phase);
+    
+    if (colorMode == NDColorModeMono) {
+        if (xSineOperation == SimSineOperationAdd) {
+            for (i=minX; i<maxX; i++) {
+                xSine1[i] = xSine1[i] + xSine2[i];
+            }
+        }
+        else {
+            for (i=minX; i<maxX; i++) {
+                xSine1[i] = xSine1[i] * xSine2[i];
+            }
+        }
+        if (ySineOperation == SimSineOperationAdd) {
+            for (i=minY; i<maxY; i++) {
+                ySine1[i] = ySine1[i] + ySine2[i];
+            }
+        }
+        else {
+            for (i=minY; i<maxY; i++) {
+                ySine1[i] = ySine1[i] * ySine2[i];
+            }
+        }
+    } else if (xRed) {
+        /* Interleaved pixels are added one at a time, so the red scaling is done once per column here */
+        for (i=minX; i<maxX; i++) {
+            xRed[i] = gain * gainRed * xSine1[i];
+        }
+    }
+
+    job.pData = (epicsType *)pRaw_->pData;
+    job.window = window_;
+    job.sizeX = sizeX;
+    job.sizeY = sizeY;
+    job.colorMode = colorMode;
+    job.gain = gain;
+    job.gainRed = gainRed;
+    job.gainGreen = gainGreen;
+    job.gainBlue = gainBlue;
+    job.xSine1 = xSine1;
+    job.pKernels = pKernels_;
+    job.xSine2 = xSine2;
+    job.ySine1 = ySine1 + tileOffsetY_;
+    job.ySine2 = ySine2 + tileOffsetY_;
+    job.xRed = xRed;
+    runRowTasks(sineRows<epicsType>, &job, window_.sizeY);
+
+    return(status);
+}
+
+/** Template function to copy the next frame of the file into the window of the raw image.
+  * The frame is added to the background if there is one. */
+template <typename epicsType> int simRenderContext::computeFileArray(int sizeX, int sizeY)
+{
+    int colorMode;
+    int line, numLines;
+    size_t first, n;
+    addArrayJob<epicsType> job;
+
+    colorMode = frameParams_.colorMode;
+    if (pDetector_->numFileFrames_ == 0) {
+        /* There is no file, or it is too small for a frame; openFile() has reported the error */
+        if (!useBackground_) {
+            numLines = windowNumLines(&window_, colorMode);
+            for (line=0; line<numLines; line++) {
+                windowLine(&window_, colorMode, sizeX, sizeY, line, &first, &n);
+                memset((epicsType *)pRaw_->pData + first, 0, n * sizeof(epicsType));
+            }
+        }
+        return asynSuccess;
+    }
+
+    job.pOut = (epicsType *)pRaw_->pData;
+    job.pIn = (epicsType *)(pDetector_->pFile_->data() + pDetector_->fileOffset_ + (size_t)pDetector_->fileFrame_ * arrayInfo_.totalBytes);
+    job.window = window_;
+    job.colorMode = colorMode;
+    job.sizeX = sizeX;
+    job.sizeY = sizeY;
+    job.pKernels = pKernels_;
+    if (useBackground_) {
+        runRowTasks(addArrayLines<epicsType>, &job, windowNumLines(&window_, colorMode));
+    } else {
+        runRowTasks(copyArrayLines<epicsType>, &job, windowNumLines(&window_, colorMode));
+    }
+    pDetector_->advanceFileFrame();
+
+    return asynSuccess;
+}
+
+/** Job description for generatorRows() */
+template <typename epicsType> struct generatorJob {
+    simGenerator *pGenerator;
+    const simGeneratorFrame_t *pFrame;
+    epicsType *pData;
+    double *pValues;           /* A row of values for each task */
+    simWindow_t window;
+    int sizeX;
+    int sizeY;
+    int colorMode;
+    int rowOrigin;             /* Row of the frame of the first row of the raw buffer */
+    double gain, gainRed, gainGreen, gainBlue;
+};
+
+/** Adds the values of the generator, scaled by the gains, to a band of rows of the window */
+template <typename epicsType> static void generatorRows(void *pvt, int task, int numTasks)
+{
+    generatorJob<epicsType> *pJob = (generatorJob<epicsType> *)pvt;
+    double *pValues = pJob->pValues + (size_t)task * pJob->window.sizeX;
+    epicsType *pOut, *pRed, *pGreen, *pBlue;
+    int minX = pJob->window.minX;
+    int numX = pJob->window.sizeX;
+    int firstRow, lastRow;
+    int row, i;
+    int columnStep;
+    double gainRed   = pJob->gain * pJob->gainRed;
+    double gainGreen = pJob->gain * pJob->gainGreen;
+    double gainBlue  = pJob->gain * pJob->gainBlue;
+
+    simRowBand(task, numTasks, pJob->window.sizeY, &firstRow, &lastRow);
+    for (row=firstRow + pJob->window.minY; row<lastRow + pJob->window.minY; row++) {
+        pJob->pGenerator->renderRow(pJob->pFrame, row + pJob->rowOrigin, minX, numX, pValues);
+        if (pJob->colorMode == NDColorModeMono) {
+            pOut = pJob->pData + (size_t)row * pJob->sizeX + minX;
+            for (i=0; i<numX; i++) pOut[i] += (epicsType)(pJob->gain * pValues[i]);
+        } else {
+            colorRowPointers(pJob->pData, pJob->colorMode, pJob->sizeX, pJob->sizeY, row,
+                             &pRed, &pGreen, &pBlue, &columnStep);
+            pRed   += (size_t)minX * columnStep;
+            pGreen += (size_t)minX * columnStep;
+            pBlue  += (size_t)minX * columnStep;
+            for (i=0; i<numX; i++) {
+                pRed  [i * columnStep] += (epicsType)(gainRed   * pValues[i]);
+                pGreen[i * columnStep] += (epicsType)(gainGreen * pValues[i]);
+                pBlue [i * columnStep] += (epicsType)(gainBlue  * pValues[i]);
+            }
+        }
+    }
+}
+
+/** Template function to add the pattern of the generator to the window of the raw image.
+  * The generator is prepared again after a reset, and its rows are computed by the worker threads if it allows it. */
+template <typename epicsType> int simRenderContext::computeGeneratorArray(int sizeX, int sizeY)
+{
+    int numTasks;
+    generatorJob<epicsType> job;
+
+    if (!pDetector_->pGenerator_) {
+        /* There is no generator; simDetectorConfigGenerator has reported the error */
+        return asynSuccess;
+    }
+    if (frameParams_.resetImage & SimResetGenerator) {
+        pDetector_->generatorFrame_.sizeX = sizeX;
+        pDetector_->generatorFrame_.sizeY = tileRows_ ? frameParams_.maxSizeY : sizeY;
+        pDetector_->generatorFrame_.colorMode = frameParams_.colorMode;
+        pDetector_->generatorFrame_.dataType = frameParams_.dataType;
+        pDetector_->generatorFrame_.seed = (epicsUInt32)frameParams_.noiseSeed;
+        pDetector_->generatorReady_ = (pDetector_->pGenerator_->prepare(&pDetector_->generatorFrame_) == 0);
+        if (!pDetector_->generatorReady_) {
+            asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:computeGeneratorArray: error preparing the generator\n", driverName);
+        }
+    }
+    if (!pDetector_->generatorReady_) return asynSuccess;
+
+    /* runRowTasks() uses at most 4 tasks per thread */
+    numTasks = (pDetector_->pGenerator_->capabilities() & SimGeneratorParallel) ? numThreads_ * 4 : 1;
+    if (numTasks < 1) numTasks = 1;
+    job.pValues = (double *)scratch_.alloc(SimScratchGenerator, (size_t)numTasks * window_.sizeX * sizeof(double));
+    if (!job.pValues && (window_.sizeX > 0)) {
+        asynPrint(pDetector_->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:computeGeneratorArray: error allocating generator buffer\n", driverName);
+        return asynError;
+    }
+    job.pGenerator = pDetector_->pGenerator_;
+    job.pFrame = &pDetector_->generatorFrame_;
+    job.pData = (epicsType *)pRaw_->pData;
+    job.window = window_;
+    job.sizeX = sizeX;
+    job.sizeY = sizeY;
+    job.colorMode = frameParams_.colorMode;
+    job.rowOrigin = tileOffsetY_;
+    job.gain = frameParams_.gain;
+    job.gainRed = frameParams_.gainRed;
+    job.gainGreen = frameParams_.gainGreen;
+    job.gainBlue = frameParams_.gainBlue;
+    setRawColorMode(frameParams_.colorMode);
+
+    if (numTasks > 1) {
+        runRowTasks(generatorRows<epicsType>, &job, window_.sizeY);
+    } else {
+        /* The rows are computed in order by this thread */
+        generatorRows<epicsType>(&job, 0, 1);
+    }
+    if (tileIndex_ == numTiles_ - 1) pDetector_->pGenerator_->advance(&pDetector_->generatorFrame_);
+
+    return asynSuccess;
+}
+
+/** Copies the timing statistics to the parameters; the times are in ms */
+void simDetector::updateTimingParams()
+{
+    int i;
+
+    epicsMutexLock(timerLock_);
+    for (i=0; i<SimNumTimers; i++) {
+        setDoubleParam(SimTimeLast[i], timers_[i].last() * 1e3);
+        setDoubleParam(SimTimeMean[i], timers_[i].mean() * 1e3);
+        setDoubleParam(SimTimeMax[i],  timers_[i].max()  * 1e3);
+        doCallbacksInt32Array(timers_[i].histogram(), SIM_TIMING_BINS, SimTimeHistogram[i], 0);
+    }
+    epicsMutexUnlock(timerLock_);
+    /* The time taken by attachAttributes() for each attribute of the attributes file, in us */
+    setDoubleParam(SimAttributeCost, numAttributes_ ? timers_[SimTimerAttributes].mean() * 1e6 / numAttributes_ : 0.);
+}
+
+/** Adds the ColorMode attribute, which NDArrayPool::convert needs, to the raw buffer.
+  * The raw buffer keeps its attributes from one frame to the next, so this only does the lookup in the
+  * attribute list when the buffer is new or the color mode has changed.
+  * \param[in] colorMode The color mode of the raw buffer. */
+void simRenderContext::setRawColorMode(int colorMode)
+{
+    if (colorMode == rawColorMode_) return;
+    pRaw_->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
+    rawColorMode_ = colorMode;
+}
+
+/** Resolves the attributes of the attributes file once, into copies which are attached to the frames.
+  * Attributes with a constant source are evaluated here; only the values of the others are updated for every frame. */
+void simDetector::buildAttributeCache()
+{
+    NDAttribute *pAttribute;
+    NDAttrSource_t sourceType;
+    int count = this->pAttributeList->count();
+
+    releaseAttributeCache();
+    if (count > 0) attributes_ = (simAttribute_t *)calloc(count, sizeof(simAttribute_t));
+    if (attributes_) {
+        for (pAttribute = this->pAttributeList->next(NULL);
+             pAttribute && (numAttributes_ < count);
+             pAttribute = this->pAttributeList->next(pAttribute)) {
+            pAttribute->getSourceInfo(&sourceType);
+            attributes_[numAttributes_].invariant = (sourceType == NDAttrSourceConst);
+            if (attributes_[numAttributes_].invariant) {
+                pAttribute->updateValue();
+                numInvariantAttributes_++;
+            }
+            attributes_[numAttributes_].pSource = pAttribute;
+            attributes_[numAttributes_].pValue  = pAttribute->copy(NULL);
+            numAttributes_++;
+        }
+    }
+    attributesValid_ = true;
+    setIntegerParam(SimNumAttributes, numAttributes_);
+}
+
+/** Releases the attribute cache, so that it is built again for the next frame */
+void simDetector::releaseAttributeCache()
+{
+    int i;
+
+    for (i=0; i<numAttributes_; i++) delete attributes_[i].pValue;
+    free(attributes_);
+    attributes_ = NULL;
+    numAttributes_ = 0;
+    numInvariantAttributes_ = 0;
+    attributesValid_ = false;
+}
+
+/** Attaches the attributes of the attributes file to a frame; replaces asynNDArrayDriver::getAttributes().
+  * The attributes which can change are evaluated and their values copied to the cache, and the attributes which
+  * the frame already has, for example because it is a frame of the movie cache published again, only get the new
+  * values.
+  * \param[in] pList The attribute list of the frame. */
+void simDetector::attachAttributes(NDAttributeList *pList)
+{
+    NDAttribute *pValue, *pOut;
+    int i;
+
+    if (!attributesValid_) buildAttributeCache();
+    for (i=0; i<numAttributes_; i++) {
+        pValue = attributes_[i].pValue;
+        if (!attributes_[i].invariant) {
+            attributes_[i].pSource->updateValue();
+            attributes_[i].pSource->copy(pValue);
+        }
+        pOut = pList->find(pValue->getName());
+        if (pOut) {
+            pValue->copy(pOut);
+        } else {
+            pList->add(pValue->copy(NULL));
+        }
+    }
+}
+
+/** Controls the shutter */
+void simDetector::setShutter(int open)
+{
+    int shutterMode;
+
+    getIntegerParam(ADShutterMode, &shutterMode);
+    if (shutterMode == ADShutterModeDetector) {
+        /* Simulate a shutter by just changing the status readback */
+        setIntegerParam(ADShutterStatus, open);
+    } else {
+        /* For no shutter or EPICS shutter call the base class method */
+        ADDriver::setShutter(open);
+    }
+}
+
+/** Reads the parameters of the image generation and makes the ROI consistent with the maximum size, fixing the
+  * parameters if it is not.  The resets requested by the writes, and with SimResetImage, are taken with the
+  * parameters, and SimResetImage is cleared, so that a reset written while a frame is computed is done by the
+  * next frame.
+  * \param[out] pParams The parameters. */
+void simDetector::getFrameParams(simFrameParams_t *pParams)
+{
+    int status = asynSuccess;
+    int itemp;
+    int resetImage;
+    const char* functionName = "getFrameParams";
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    status |= getIntegerParam(ADBinX,                 &pParams->binX);
+    status |= getIntegerParam(ADBinY,                 &pParams->binY);
+    status |= getIntegerParam(ADMinX,                 &pParams->minX);
+    status |= getIntegerParam(ADMinY,                 &pParams->minY);
+    status |= getIntegerParam(ADSizeX,                &pParams->sizeX);
+    status |= getIntegerParam(ADSizeY,                &pParams->sizeY);
+    status |= getIntegerParam(ADReverseX,             &pParams->reverseX);
+    status |= getIntegerParam(ADReverseY,             &pParams->reverseY);
+    status |= getIntegerParam(ADMaxSizeX,             &pParams->maxSizeX);
+    status |= getIntegerParam(ADMaxSizeY,             &pParams->maxSizeY);
+    status |= getIntegerParam(NDColorMode,            &pParams->colorMode);
+    status |= getIntegerParam(NDDataType,             &itemp); pParams->dataType = (NDDataType_t)itemp;
+    status |= getIntegerParam(SimResetImage,          &resetImage);
+    status |= getIntegerParam(SimMode,                &pParams->simMode);
+    status |= getIntegerParam(SimNumThreads,          &pParams->numThreads);
+    status |= getIntegerParam(SimVectorize,           &pParams->vectorize);
+    status |= getIntegerParam(SimZeroCopy,            &pParams->zeroCopy);
+    status |= getIntegerParam(SimRoiRender,           &pParams->roiRender);
+    status |= getIntegerParam(SimFileZeroCopy,        &pParams->fileZeroCopy);
+    status |= getIntegerParam(SimFilePrefetch,        &pParams->filePrefetch);
+    status |= getIntegerParam(SimTileRows,            &pParams->tileRows);
+    status |= getIntegerParam(SimMovieFrames,         &pParams->movieFrames);
+    status |= getIntegerParam(SimMovieCopy,           &pParams->movieCopy);
+    status |= getDoubleParam (SimMovieMemory,         &pParams->movieMemory);
+    status |= getIntegerParam(SimLatencyAttributes,   &pParams->latencyAttributes);
+    status |= getIntegerParam(SimIncremental,         &pParams->incremental);
+    status |= getDoubleParam (ADGain,                 &pParams->gain);
+    status |= getDoubleParam (SimGainX,               &pParams->gainX);
+    status |= getDoubleParam (SimGainY,               &pParams->gainY);
+    status |= getDoubleParam (SimGainRed,             &pParams->gainRed);
+    status |= getDoubleParam (SimGainGreen,           &pParams->gainGreen);
+    status |= getDoubleParam (SimGainBlue,            &pParams->gainBlue);
+    status |= getDoubleParam (SimOffset,              &pParams->offset);
+    status |= getDoubleParam (SimNoise,               &pParams->noise);
+    status |= getIntegerParam(SimNoiseSeed,           &pParams->noiseSeed);
+    status |= getIntegerParam(SimNoiseModel,          &pParams->noiseModel);
+    status |= getDoubleParam (SimNoiseGaussian,       &pParams->noiseGaussian);
+    status |= getDoubleParam (SimNoiseShot,           &pParams->noiseShot);
+    status |= getDoubleParam (SimNoiseRead,           &pParams->noiseRead);
+    status |= getIntegerParam(SimPeakStartX,          &pParams->peakStartX);
+    status |= getIntegerParam(SimPeakStartY,          &pParams->peakStartY);
+    status |= getIntegerParam(SimPeakStepX,           &pParams->peakStepX);
+    status |= getIntegerParam(SimPeakStepY,           &pParams->peakStepY);
+    status |= getIntegerParam(SimPeakNumX,            &pParams->peakNumX);
+    status |= getIntegerParam(SimPeakNumY,            &pParams->peakNumY);
+    status |= getIntegerParam(SimPeakWidthX,          &pParams->peakWidthX);
+    status |= getIntegerParam(SimPeakWidthY,          &pParams->peakWidthY);
+    status |= getDoubleParam (SimPeakHeightVariation, &pParams->peakVariation);
+    status |= getDoubleParam (SimPeakShiftX,          &pParams->peakShiftX);
+    status |= getDoubleParam (SimPeakShiftY,          &pParams->peakShiftY);
+    status |= getIntegerParam(SimPeakGainBuckets,     &pParams->peakGainBuckets);
+    status |= getIntegerParam(SimXSineOperation,      &pParams->xSineOperation);
+    status |= getDoubleParam (SimXSine1Amplitude,     &pParams->xSine1Amplitude);
+    status |= getDoubleParam (SimXSine1Frequency,     &pParams->xSine1Frequency);
+    status |= getDoubleParam (SimXSine1Phase,         &pParams->xSine1Phase);
+    status |= getDoubleParam (SimXSine2Amplitude,     &pParams->xSine2Amplitude);
+    status |= getDoubleParam (SimXSine2Frequency,     &pParams->xSine2Frequency);
+    status |= getDoubleParam (SimXSine2Phase,         &pParams->xSine2Phase);
+    status |= getIntegerParam(SimYSineOperation,      &pParams->ySineOperation);
+    status |= getDoubleParam (SimYSine1Amplitude,     &pParams->ySine1Amplitude);
+    status |= getDoubleParam (SimYSine1Frequency,     &pParams->ySine1Frequency);
+    status |= getDoubleParam (SimYSine1Phase,         &pParams->ySine1Phase);
+    status |= getDoubleParam (SimYSine2Amplitude,     &pParams->ySine2Amplitude);
+    status |= getDoubleParam (SimYSine2Frequency,     &pParams->ySine2Frequency);
+    status |= getDoubleParam (SimYSine2Phase,         &pParams->ySine2Phase);
+    if (status) asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error getting parameters\n",
+                    driverName, functionName);
+
+    /* Make sure parameters are consistent, fix them if they are not */
+    status = asynSuccess;
+    /* The resets requested since the parameters were last read */
+    if (resetImage) pendingResets_ = SimResetAll;
+    pParams->resetImage = pendingResets_;
+    if (pendingResets_) {
+        pendingResets_ = 0;
+        status |= setIntegerParam(SimResetImage, 0);
+    }
+    if (pParams->binX < 1) {
+        pParams->binX = 1;
+        status |= setIntegerParam(ADBinX, pParams->binX);
+    }
+    if (pParams->binY < 1) {
+        pParams->binY = 1;
+        status |= setIntegerParam(ADBinY, pParams->binY);
+    }
+    if (pParams->minX < 0) {
+        pParams->minX = 0;
+        status |= setIntegerParam(ADMinX, pParams->minX);
+    }
+    if (pParams->minY < 0) {
+        pParams->minY = 0;
+        status |= setIntegerParam(ADMinY, pParams->minY);
+    }
+    if (pParams->minX > pParams->maxSizeX-1) {
+        pParams->minX = pParams->maxSizeX-1;
+        status |= setIntegerParam(ADMinX, pParams->minX);
+    }
+    if (pParams->minY > pParams->maxSizeY-1) {
+        pParams->minY = pParams->maxSizeY-1;
+        status |= setIntegerParam(ADMinY, pParams->minY);
+    }
+    if (pParams->minX+pParams->sizeX > pParams->maxSizeX) {
+        pParams->sizeX = pParams->maxSizeX-pParams->minX;
+        status |= setIntegerParam(ADSizeX, pParams->sizeX);
+    }
+    if (pParams->minY+pParams->sizeY > pParams->maxSizeY) {
+        pParams->sizeY = pParams->maxSizeY-pParams->minY;
+        status |= setIntegerParam(ADSizeY, pParams->sizeY);
+    }
+    if (status) asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error setting parameters\n",
+                    driverName, functionName);
+}
+
+/** Reads the parameters again if a write has changed them since they were last read, except between the tiles of a
+  * frame, which all use the parameters read for its first tile.  The resets taken with the parameters are done by
+  * the next frame of every context, and the values of the simulation which they start again by the next frame claimed.
+  * The caller must have taken the mutex. */
+void simDetector::updateFrameParams()
+{
+    int resets;
+    int i;
+
+    if (!frameParamsDirty_ || (pContext_->tileIndex_ > 0)) return;
+    frameParamsDirty_ = false;
+    getFrameParams(&frameParams_);
+    resets = frameParams_.resetImage;
+    sequence_.resets |= resets;
+    pContext_->resetImage_ |= resets;
+    for (i=0; i<numRenderThreads_; i++) renderContexts_[i]->resetImage_ |= resets;
+}
+
+/** Makes the next frame of every context compute its whole window rather than reuse its previous frame.
+  * The caller must have taken the mutex. */
+void simDetector::invalidateWindows()
+{
+    int i;
+
+    pContext_->invalidateWindow_ = true;
+    for (i=0; i<numRenderThreads_; i++) renderContexts_[i]->invalidateWindow_ = true;
+}
+
+/** Returns whether an offset is still non-zero once it is converted to the data type of the images */
+static bool offsetNonZero(double offset, NDDataType_t dataType)
+{
+    switch (dataType) {
+        case NDInt8:    return (epicsInt8)offset != 0;
+        case NDUInt8:   return (epicsUInt8)offset != 0;
+        case NDInt16:   return (epicsInt16)offset != 0;
+        case NDUInt16:  return (epicsUInt16)offset != 0;
+        case NDInt32:   return (epicsInt32)offset != 0;
+        case NDUInt32:  return (epicsUInt32)offset != 0;
+        case NDInt64:   return (epicsInt64)offset != 0;
+        case NDUInt64:  return (epicsUInt64)offset != 0;
+        case NDFloat32: return (epicsFloat32)offset != 0;
+        default:        return offset != 0.;
+    }
+}
+
+/** Starts the next frame of the simulation in a context.  The values which carry over from one frame to the next,
+  * the frame counters and the position in the stream of random values, are given to the frames in the order they
+  * are claimed, so frames computed in parallel by the render threads are those which would be computed one after
+  * the other.  The caller must have taken the mutex.
+  * \param[in] pContext The context, whose frameParams_ and tiles are those of the frame. */
+void simDetector::claimFrame(simRenderContext *pContext)
+{
+    const simFrameParams_t *pParams = &pContext->frameParams_;
+    simFrameSequence_t *pSequence = &sequence_;
+    bool offset;
+    int numPeaksX, numPeaksY;
+
+    /* Restart the random values so that the same seed gives the same images */
+    if (pSequence->resets & SimResetBackground) {
+        pSequence->randomIndex = 0;
+        pSequence->noiseFrame = 0;
+    }
+    if (pSequence->resets & SimResetRamp) pSequence->rampFrame = 0;
+    if (pSequence->resets & SimResetSine) {
+        pSequence->xSineCounter = 0;
+        pSequence->ySineCounter = 0;
+    }
+    pSequence->resets = 0;
+
+    offset = offsetNonZero(pParams->offset, pParams->dataType);
+    pContext->perFrameNoise_ = (pParams->noiseModel == SimNoiseModelPerFrame) &&
+                               ((pParams->noise != 0.) || offset || (pParams->noiseGaussian != 0.) ||
+                                (pParams->noiseShot > 0.) || (pParams->noiseRead != 0.));
+    pContext->useBackground_ = !pContext->perFrameNoise_ && ((pParams->noise != 0.) || offset);
+    pContext->frameRandom_.setSeed((epicsUInt32)pParams->noiseSeed, SimRandomStreamFrame);
+    pContext->frameRandom_.skipTo(pSequence->randomIndex);
+    pContext->noiseFrame_ = pSequence->noiseFrame;
+    pContext->rampFrame_ = pSequence->rampFrame;
+    pContext->xSineCounter_ = pSequence->xSineCounter;
+    pContext->ySineCounter_ = pSequence->ySineCounter;
+
+    /* The frame draws the start of the background of each tile, and then the gains of the peaks */
+    if (pContext->useBackground_) pSequence->randomIndex += pContext->numTiles_;
+    numPeaksX = (pParams->peakNumX > 0) ? pParams->peakNumX : 0;
+    numPeaksY = (pParams->peakNumY > 0) ? pParams->peakNumY : 0;
+    if ((pParams->simMode == SimModePeaks) && (pParams->peakVariation != 0)) {
+        pSequence->randomIndex += (epicsUInt64)numPeaksX * numPeaksY;
+    }
+    if (pContext->perFrameNoise_) pSequence->noiseFrame++;
+    if (pParams->simMode == SimModeLinearRamp) pSequence->rampFrame++;
+    if (pParams->simMode == SimModeSine) {
+        pSequence->xSineCounter += pParams->maxSizeX;
+        pSequence->ySineCounter += pParams->maxSizeY;
+    }
+}
+
+/** Returns whether a render thread can compute a frame with these parameters in its own context, in parallel with
+  * the other frames.  The frames of the movie cache, of the file and of the generator, which evolve from one frame
+  * to the next, and the floating point linear ramps, which add the increment to the previous frame, are computed
+  * one at a time in the context of the driver. */
+static bool renderInParallel(const simFrameParams_t *pParams)
+{
+    if (pParams->movieFrames > 0) return false;
+    switch (pParams->simMode) {
+        case SimModeFile:
+        case SimModeGenerator:
+            return false;
+        case SimModeLinearRamp:
+            return (pParams->dataType != NDFloat32) && (pParams->dataType != NDFloat64);
+        default:
+            return true;
+    }
+}
+
+/** Waits until no other thread is generating a frame in the context of the driver, pContext_, and marks this one as
+  * generating; these frames are generated one at a time, in order, because they are computed from the previous
+  * frame.  The state of the generation in pContext_, the movie cache and the file, belongs to the generating thread,
+  * which may release the mutex, so other threads must not change it without calling this first.
+  * The caller must have taken the mutex, which is released while waiting. */
+void simDetector::beginGeneration()
+{
+    while (generating_) {
+        this->unlock();
+        epicsEventWait(generateEvent_);
+        this->lock();
+    }
+    generating_ = true;
+}
+
+/** Ends the generation begun by beginGeneration() and wakes a thread waiting to begin one.
+  * The caller must have taken the mutex. */
+void simDetector::endGeneration()
+{
+    generating_ = false;
+    epicsEventSignal(generateEvent_);
+}
+
+/** Computes the new image data in a context, with the parameters of its frameParams_.
+  * When SimTileRows is set the frame is computed and returned as tiles, strips of SimTileRows rows of the whole
+  * width of the frame, one per call, and only a tile is held in the raw buffer; the ROI and binning are not used.
+  * \param[out] ppImage The new NDArray, extracted from the raw buffer with the current ROI and binning, or the
+  *             next tile of the frame.
+  * \param[in] releaseLock Whether the mutex is released while the raw image is computed and the NDArray is
+  *            extracted, so that the writes to the parameters do not wait for them.
+  * \param[in] pContext The context which computes the frame, pContext_ or the context of a render thread. */
+int simDetector::computeImage(NDArray **ppImage, bool releaseLock, simRenderContext *pContext)
+{
+    int status = asynSuccess;
+    int arrayStatus = asynSuccess;
+    NDDataType_t dataType;
+    int binX, binY, minX, minY, sizeX, sizeY, reverseX, reverseY;
+    int xDim=0, yDim=1, colorDim=-1;
+    int resetImage;
+    int maxSizeX, maxSizeY;
+    int colorMode;
+    int zeroCopy, fullFrame;
+    int simMode;
+    int roiRender;
+    int tileRows;
+    int rawSizeY, tileSizeY;
+    int ndims=0;
+    int i;
+    NDDimension_t dimsOut[3];
+    size_t dims[3];
+    epicsTimeStamp generateStart, generateEnd, convertEnd;
+    const char* functionName = "computeImage";
+
+    /* NOTE: The caller of this function must have taken the mutex, and called beginGeneration() for pContext_ */
+
+    *ppImage = NULL;
+    binX     = pContext->frameParams_.binX;
+    binY     = pContext->frameParams_.binY;
+    minX     = pContext->frameParams_.minX;
+    minY     = pContext->frameParams_.minY;
+    sizeX    = pContext->frameParams_.sizeX;
+    sizeY    = pContext->frameParams_.sizeY;
+    reverseX = pContext->frameParams_.reverseX;
+    reverseY = pContext->frameParams_.reverseY;
+    maxSizeX = pContext->frameParams_.maxSizeX;
+    maxSizeY = pContext->frameParams_.maxSizeY;
+    colorMode = pContext->frameParams_.colorMode;
+    dataType = pContext->frameParams_.dataType;
+    pContext->numThreads_ = pContext->frameParams_.numThreads;
+    pContext->pKernels_ = pContext->frameParams_.vectorize ? simGetBestKernels() : simGetScalarKernels();
+    zeroCopy = pContext->frameParams_.zeroCopy;
+    simMode  = pContext->frameParams_.simMode;
+
+    resetImage = pContext->frameParams_.resetImage;
+
+    /* Changes which the writes leave to the next frame, rather than waiting for the frame being computed */
+    if (pContext->releaseBuffers_) {
+        pContext->releaseBuffers();
+        this->pNDArrayPool->emptyFreeList();
+        pContext->releaseBuffers_ = false;
+    }
+    if (pContext->invalidateWindow_) {
+        pContext->validWindow_.sizeX = 0;
+        pContext->validWindow_.sizeY = 0;
+        pContext->rampWindow_.sizeX = 0;
+        pContext->rampWindow_.sizeY = 0;
+        pContext->invalidateWindow_ = false;
+    }
+    if (reopenFile_ && (pContext == pContext_)) {
+        closeFile();
+        reopenFile_ = false;
+    }
+
+    switch (colorMode) {
+        case NDColorModeMono:
+            ndims = 2;
+            xDim = 0;
+            yDim = 1;
+            break;
         case NDColorModeRGB1:
-            columnStep = 3;
-            rowStep = 0;
-            pRed   = (epicsType *)pRaw_->pData;
-            pGreen = (epicsType *)pRaw_->pData+1;
-            pBlue  = (epicsType *)pRaw_->pData+2;
+            ndims = 3;
+            colorDim = 0;
+            xDim     = 1;
+            yDim     = 2;
+            break;
+        case NDColorModeRGB2:
+            ndims = 3;
+            colorDim = 1;
+            xDim     = 0;
+            yDim     = 2;
+            break;
+        case NDColorModeRGB3:
+            ndims = 3;
+            colorDim = 2;
+            xDim     = 0;
+            yDim     = 1;
+            break;
+    }
+
+    /* Whether a frame is tiled is decided when its first tile is computed.  Only the frames which are computed
+     * here one after the other, not the ring, movie or module frames, are tiled, and only in the modes whose rows
+     * can be computed apart from the rest of the frame. */
+    if (pContext->tileIndex_ == 0) {
+        tileRows = pContext->frameParams_.tileRows;
+        if ((tileRows < 0) || (tileRows >= maxSizeY) || (ringDepth_ > 0) || (numModules_ > 1) ||
+            (pContext->frameParams_.movieFrames > 0) ||
+            (simMode == SimModeFile) || (colorMode == NDColorModeRGB3)) {
+            tileRows = 0;
+        }
+        if (tileRows != pContext->tileRows_) {
+            /* The raw buffer and the scratch buffers have the size of a tile, and the simulation starts again */
+            pContext->tileRows_ = tileRows;
+            resetImage = SimResetAll;
+            sequence_.resets |= SimResetAll;
+        }
+        pContext->numTiles_ = pContext->tileRows_ ? (maxSizeY + pContext->tileRows_ - 1) / pContext->tileRows_ : 1;
+        status |= setIntegerParam(SimNumTiles, pContext->numTiles_);
+        pContext->frameParams_.resetImage = resetImage;
+        claimFrame(pContext);
+    }
+    pContext->tileOffsetY_ = pContext->tileIndex_ * pContext->tileRows_;
+    rawSizeY = pContext->tileRows_ ? pContext->tileRows_ : maxSizeY;
+    tileSizeY = (pContext->tileOffsetY_ + rawSizeY <= maxSizeY) ? rawSizeY : maxSizeY - pContext->tileOffsetY_;
+
+    /* Only the region which will be extracted needs to be computed, unless the generator cannot compute parts of rows */
+    roiRender = pContext->frameParams_.roiRender;
+    if ((simMode == SimModeGenerator) && pGenerator_ && !(pGenerator_->capabilities() & SimGeneratorRoi)) roiRender = 0;
+    /* The floating point ramps add the increment to each pixel frame by frame, which the pixels entering the
+     * window could only be given to the last bits, so they are kept up to date over the whole frame */
+    if ((simMode == SimModeLinearRamp) && ((dataType == NDFloat32) || (dataType == NDFloat64))) roiRender = 0;
+    if (pContext->tileRows_) {
+        pContext->window_.minX  = 0;
+        pContext->window_.minY  = 0;
+        pContext->window_.sizeX = maxSizeX;
+        pContext->window_.sizeY = tileSizeY;
+    } else if (roiRender) {
+        pContext->window_.minX  = minX;
+        pContext->window_.minY  = minY;
+        pContext->window_.sizeX = (sizeX > 0) ? sizeX : 0;
+        pContext->window_.sizeY = (sizeY > 0) ? sizeY : 0;
+    } else {
+        pContext->window_.minX  = 0;
+        pContext->window_.minY  = 0;
+        pContext->window_.sizeX = maxSizeX;
+        pContext->window_.sizeY = maxSizeY;
+    }
+
+    /* Without ROI, binning or reversal the raw buffer itself can be published instead of a converted copy */
+    fullFrame = (binX == 1) && (binY == 1) && (minX == 0) && (minY == 0) &&
+                (sizeX == maxSizeX) && (sizeY == maxSizeY) && !reverseX && !reverseY;
+    if (pContext->tileRows_) {
+        /* The tiles are published whole, and the last tile can have fewer rows than the raw buffer */
+        fullFrame = 0;
+        zeroCopy = zeroCopy && (tileSizeY == rawSizeY);
+        binX = binY = 1;
+        minX = minY = 0;
+        sizeX = maxSizeX;
+        sizeY = tileSizeY;
+        reverseX = reverseY = 0;
+    } else {
+        zeroCopy = zeroCopy && fullFrame;
+    }
+
+    /* Close the files which are no longer replayed once plugins have released their frames */
+    if (numFileWrappers_ > 0) releaseFileWrappers();
+
+    /* The frames of a file can be published without a copy if nothing is added to them */
+    if ((simMode == SimModeFile) && pContext->frameParams_.fileZeroCopy && fullFrame && !resetImage &&
+        !pContext->useBackground_ && !pContext->perFrameNoise_ && (numFileFrames_ > 0)) {
+        return getFileFrame(ppImage);
+    }
+
+    if (resetImage & SimResetBuffers) {
+    /* Free the previous raw buffer */
+        if (pContext->pRaw_) pContext->pRaw_->release();
+        /* Allocate the raw buffer we use to compute images. */
+        dims[xDim] = maxSizeX;
+        dims[yDim] = rawSizeY;
+        if (ndims > 2) dims[colorDim] = 3;
+        pContext->pRaw_        = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+        pContext->rawColorMode_ = -1;
+        if (!pContext->pRaw_) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error allocating raw buffer\n",
+                      driverName, functionName);
+            return(asynError);
+        }
+        pContext->pRaw_->getInfo(&pContext->arrayInfo_);
+    } else if (!pContext->pRaw_) {
+        /* The raw buffer could not be allocated for a previous frame, which left the reset pending */
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: no raw buffer\n",
+                  driverName, functionName);
+        return(asynError);
+    } else if (pContext->pRaw_->getReferenceCount() > 1) {
+        /* The previous image was published without a copy and is still in use, so compute this one in a new buffer.
+         * The linear ramp reads the previous image from pContext->pPreviousRaw_. */
+        pContext->pPreviousRaw_ = pContext->pRaw_;
+        for (i=0; i<pContext->pPreviousRaw_->ndims; i++) dims[i] = pContext->pPreviousRaw_->dims[i].size;
+        pContext->pRaw_ = this->pNDArrayPool->alloc(pContext->pPreviousRaw_->ndims, dims, dataType, 0, NULL);
+        if (!pContext->pRaw_) {
+            pContext->pRaw_ = pContext->pPreviousRaw_;
+            pContext->pPreviousRaw_ = NULL;
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error allocating raw buffer\n",
+                      driverName, functionName);
+            return(asynError);
+        }
+        pContext->pRaw_->pAttributeList->clear();
+        pContext->rawColorMode_ = -1;
+    }
+    if ((resetImage & SimResetFile) && (pContext == pContext_)) {
+        /* The size of the frames of the file depends on the data type and color mode */
+        if (simMode == SimModeFile) {
+            openFile();
+        } else {
+            closeFile();
+        }
+    }
+
+    /* Only this thread uses the context, until endGeneration() for pContext_, so its raw and scratch buffers are
+     * computed without the mutex, from its frameParams_ */
+    if (releaseLock) this->unlock();
+    epicsTimeGetCurrent(&generateStart);
+    switch (dataType) {
+        case NDInt8:
+            arrayStatus = pContext->computeArray<epicsInt8>(maxSizeX, rawSizeY);
+            break;
+        case NDUInt8:
+            arrayStatus = pContext->computeArray<epicsUInt8>(maxSizeX, rawSizeY);
+            break;
+        case NDInt16:
+            arrayStatus = pContext->computeArray<epicsInt16>(maxSizeX, rawSizeY);
+            break;
+        case NDUInt16:
+            arrayStatus = pContext->computeArray<epicsUInt16>(maxSizeX, rawSizeY);
+            break;
+        case NDInt32:
+            arrayStatus = pContext->computeArray<epicsInt32>(maxSizeX, rawSizeY);
+            break;
+        case NDUInt32:
+            arrayStatus = pContext->computeArray<epicsUInt32>(maxSizeX, rawSizeY);
+            break;
+        case NDInt64:
+            arrayStatus = pContext->computeArray<epicsInt64>(maxSizeX, rawSizeY);
+            break;
+        case NDUInt64:
+            arrayStatus = pContext->computeArray<epicsUInt64>(maxSizeX, rawSizeY);
+            break;
+        case NDFloat32:
+            arrayStatus = pContext->computeArray<epicsFloat32>(maxSizeX, rawSizeY);
+            break;
+        case NDFloat64:
+            arrayStatus = pContext->computeArray<epicsFloat64>(maxSizeX, rawSizeY);
+            break;
+    }
+    epicsTimeGetCurrent(&generateEnd);
+    if (pContext->pPreviousRaw_) {
+        pContext->pPreviousRaw_->release();
+        pContext->pPreviousRaw_ = NULL;
+    }
+    if (arrayStatus) {
+        /* The image is not published, and the resetImage of the context is kept so the next frame resets it again */
+        if (releaseLock) this->lock();
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error computing the image\n",
+                    driverName, functionName);
+        return(arrayStatus);
+    }
+
+    if (zeroCopy) {
+        /* Publish the raw buffer; the next image will be computed in a new buffer while this one is in use */
+        pContext->pRaw_->reserve();
+        *ppImage = pContext->pRaw_;
+    } else {
+        /* Extract the region of interest with binning.
+         * If the entire image is being used (no ROI or binning) that's OK because
+         * convertImage detects that case and is very efficient */
+        pContext->pRaw_->initDimension(&dimsOut[xDim], sizeX);
+        pContext->pRaw_->initDimension(&dimsOut[yDim], sizeY);
+        if (ndims > 2) pContext->pRaw_->initDimension(&dimsOut[colorDim], 3);
+        dimsOut[xDim].binning = binX;
+        dimsOut[xDim].offset  = minX;
+        dimsOut[xDim].reverse = reverseX;
+        dimsOut[yDim].binning = binY;
+        dimsOut[yDim].offset  = minY;
+        dimsOut[yDim].reverse = reverseY;
+        *ppImage = NULL;
+        status = this->pNDArrayPool->convert(pContext->pRaw_,
+                                             ppImage,
+                                             dataType,
+                                             dimsOut);
+        if (status) {
+            if (releaseLock) this->lock();
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: error allocating buffer in convert()\n",
+                        driverName, functionName);
+            return(status);
+        }
+    }
+    epicsTimeGetCurrent(&convertEnd);
+    if (releaseLock) this->lock();
+    timers_[SimTimerGenerate].add(epicsTimeDiffInSeconds(&generateEnd, &generateStart));
+    timers_[SimTimerConvert].add(epicsTimeDiffInSeconds(&convertEnd, &generateEnd));
+    if (pContext->tileRows_) {
+        NDAttributeList *pList = (*ppImage)->pAttributeList;
+        pList->add(SimAttrTileIndex,   "Index of the tile in the frame",      NDAttrInt32, &pContext->tileIndex_);
+        pList->add(SimAttrNumTiles,    "Number of tiles of the frame",        NDAttrInt32, &pContext->numTiles_);
+        pList->add(SimAttrTileOffsetY, "First row of the tile in the frame",  NDAttrInt32, &pContext->tileOffsetY_);
+        pList->add(SimAttrTileSizeY,   "Number of rows of the tile",          NDAttrInt32, &tileSizeY);
+        pList->add(SimAttrFrameSizeY,  "Number of rows of the frame",         NDAttrInt32, &maxSizeY);
+    }
+    pContext->tileIndex_ = (pContext->tileIndex_ + 1) % pContext->numTiles_;
+    /* The following frames do not reset the image until a write requests it */
+    pContext->frameParams_.resetImage = 0;
+    status |= setIntegerParam(SimFrameClass, pContext->frameClass_);
+    if (simMode == SimModeFile) status |= setIntegerParam(SimFileFrame, fileFrame_);
+    if (status) asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error setting parameters\n",
+                    driverName, functionName);
+    return(status);
+}
+
+/** Gets the next image, from the movie cache if it is enabled, otherwise by computing it.
+  * Reads the parameters again if they have been written since the last frame; the tiles of a frame all use the
+  * parameters read for its first tile.  A render thread computes the frame in its own context, in parallel with the
+  * other render threads, unless it must be computed from the previous frame, see renderInParallel(); these frames
+  * are computed in pContext_, waiting for the frame being generated there by another thread, if any.
+  * \param[out] ppImage The new NDArray.
+  * \param[in] releaseLock Whether the mutex is released while the image is computed, see computeImage().
+  * \param[in] pRenderContext The context of the calling render thread, which reserves the next place of the ring
+  *            for the frame, or NULL. */
+int simDetector::nextImage(NDArray **ppImage, bool releaseLock, simRenderContext *pRenderContext)
+{
+    int status;
+    int movieFrames;
+    int latencyAttributes;
+    int resets;
+    simRenderContext *pContext = pContext_;
+    epicsUInt64 startTime, endTime;
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    if (pRenderContext) {
+        updateFrameParams();
+        /* The movie cache is released in pContext_ by the first frame which does not use it */
+        if (renderInParallel(&frameParams_) && (numMovieFrames_ == 0)) pContext = pRenderContext;
+    }
+    if (pContext == pContext_) {
+        beginGeneration();
+        updateFrameParams();
+    }
+    if (pContext->tileIndex_ == 0) {
+        /* The frame uses the parameters read last, with the resets which the context has not done yet */
+        resets = pContext->frameParams_.resetImage | pContext->resetImage_;
+        pContext->frameParams_ = frameParams_;
+        pContext->frameParams_.resetImage = resets;
+        pContext->resetImage_ = 0;
+    }
+    if (pRenderContext) {
+        /* The frames take their places in the ring in the order they are claimed, whichever is computed first */
+        epicsMutexLock(ringLock_);
+        ringPending_--;
+        pRenderContext->ringSlot_ = (ringHead_ + ringCount_) % ringDepth_;
+        pRenderContext->ringEpoch_ = ringEpoch_;
+        frameRing_[pRenderContext->ringSlot_] = NULL;
+        ringFailed_[pRenderContext->ringSlot_] = false;
+        ringCount_++;
+        epicsMutexUnlock(ringLock_);
+    }
+    latencyAttributes = pContext->frameParams_.latencyAttributes;
+    startTime = latencyAttributes ? simMonotonicNs() : 0;
+    movieFrames = pContext->frameParams_.movieFrames;
+    if (pContext->tileIndex_ > 0) {
+        /* The rest of a tiled frame is always computed */
+        status = computeImage(ppImage, releaseLock, pContext);
+    } else if (movieFrames > 0) {
+        status = getMovieFrame(ppImage, releaseLock);
+    } else {
+        if (numMovieFrames_ > 0) releaseMovie();
+        status = computeImage(ppImage, releaseLock, pContext);
+    }
+    if (pContext == pContext_) endGeneration();
+    if (latencyAttributes && (status == asynSuccess) && *ppImage) {
+        endTime = simMonotonicNs();
+        (*ppImage)->pAttributeList->add(SimAttrGenerateStart, "Time the frame generation started (ns)",
+                                        NDAttrUInt64, &startTime);
+        (*ppImage)->pAttributeList->add(SimAttrGenerateEnd, "Time the frame generation ended (ns)",
+                                        NDAttrUInt64, &endTime);
+    } else if ((movieFrames > 0) && (status == asynSuccess) && *ppImage) {
+        /* A frame of the movie cache may have been published with the attributes before they were disabled */
+        (*ppImage)->pAttributeList->remove(SimAttrGenerateStart);
+        (*ppImage)->pAttributeList->remove(SimAttrGenerateEnd);
+        (*ppImage)->pAttributeList->remove(SimAttrPublish);
+    }
+    return status;
+}
+
+/** Compresses an array with the codecs of ADCore's NDPluginCodec, which set the codec and compressedSize of the
+  * compressed copy.
+  * \return The compressed copy, or NULL on error. */
+static NDArray *compressArray(NDArray *pArray, const simCompression_t *pCompression, char *errorMessage)
+{
+    NDCodecStatus_t codecStatus = NDCODEC_SUCCESS;
+
+    switch (pCompression->compression) {
+        case SimCompressionLZ4:
+            return compressLZ4(pArray, &codecStatus, errorMessage);
+        case SimCompressionBSLZ4:
+            return compressBSLZ4(pArray, &codecStatus, errorMessage);
+        case SimCompressionBlosc:
+            return compressBlosc(pArray, pCompression->bloscLevel, pCompression->bloscShuffle,
+                                 (NDCodecBloscComp_t)pCompression->bloscCompressor, pCompression->numThreads,
+                                 &codecStatus, errorMessage);
+        case SimCompressionJPEG:
+            return compressJPEG(pArray, pCompression->jpegQuality, &codecStatus, errorMessage);
+        default:
+            epicsSnprintf(errorMessage, 256, "unknown compression %d", pCompression->compression);
+            return NULL;
+    }
+}
+
+/** Packs an array to the bit depth of the settings, into a new array from the pool of the array with the same
+  * time stamps and attributes, and the attributes which describe the packing.
+  * \param[out] pUnpackTime The time in seconds taken to unpack the packed array if the settings ask for it,
+  *             otherwise -1.
+  * \return The packed array, or NULL on error. */
+static NDArray *packArray(NDArray *pArray, const simCompression_t *pCompression, double *pUnpackTime,
+                          char *errorMessage)
+{
+    NDArrayInfo_t arrayInfo;
+    NDArray *pPacked, *pUnpacked;
+    size_t dims[ND_ARRAY_MAX_DIMS];
+    size_t numRows, rowElements;
+    int bitDepth = pCompression->bitDepth;
+    int value;
+    int i;
+    epicsUInt64 startTime;
+
+    *pUnpackTime = -1.;
+    pArray->getInfo(&arrayInfo);
+    /* Each element of the last dimension is a row, which is Y for mono and RGB1 images */
+    numRows = (pArray->ndims > 1) ? pArray->dims[pArray->ndims-1].size : 1;
+    rowElements = numRows ? arrayInfo.nElements / numRows : 0;
+    if (pCompression->packing == SimPackingPacked) {
+        dims[0] = simPackedRowBytes(rowElements, bitDepth);
+        dims[1] = numRows;
+        pPacked = pArray->pNDArrayPool->alloc(2, dims, NDUInt8, 0, NULL);
+    } else {
+        for (i=0; i<pArray->ndims; i++) dims[i] = pArray->dims[i].size;
+        pPacked = pArray->pNDArrayPool->alloc(pArray->ndims, dims, simContainerType(bitDepth), 0, NULL);
+    }
+    if (!pPacked) {
+        epicsSnprintf(errorMessage, 256, "cannot allocate the packed array");
+        return NULL;
+    }
+    if (pCompression->packing == SimPackingPacked) {
+        simPackRows(pArray->pData, pArray->dataType, rowElements, numRows, bitDepth, (epicsUInt8 *)pPacked->pData);
+    } else {
+        simClipElements(pArray->pData, pArray->dataType, arrayInfo.nElements, bitDepth, pPacked->pData);
+    }
+    pPacked->uniqueId = pArray->uniqueId;
+    pPacked->timeStamp = pArray->timeStamp;
+    pPacked->epicsTS = pArray->epicsTS;
+    pArray->pAttributeList->copy(pPacked->pAttributeList);
+    pPacked->pAttributeList->add(SimAttrBitDepth, "Number of significant bits of the elements", NDAttrInt32, &bitDepth);
+    if (pCompression->packing != SimPackingPacked) return pPacked;
+
+    value = (int)rowElements;
+    pPacked->pAttributeList->add(SimAttrPackedElements, "Number of elements of each packed row", NDAttrInt32, &value);
+    value = simContainerType(bitDepth);
+    pPacked->pAttributeList->add(SimAttrPackedDataType, "NDDataType_t of the unpacked elements", NDAttrInt32, &value);
+    if (pCompression->unpackTiming) {
+        /* Unpack into a buffer from the pool, so only the first frame pays for the page faults */
+        dims[0] = rowElements * numRows;
+        pUnpacked = pArray->pNDArrayPool->alloc(1, dims, simContainerType(bitDepth), 0, NULL);
+        if (pUnpacked) {
+            startTime = simMonotonicNs();
+            simUnpackRows((const epicsUInt8 *)pPacked->pData, rowElements, numRows, bitDepth, pUnpacked->pData);
+            *pUnpackTime = (simMonotonicNs() - startTime) * 1e-9;
+            pUnpacked->release();
+        }
+    }
+    return pPacked;
+}
+
+/** Returns true if the settings change the frames */
+static bool encodingEnabled(const simCompression_t *pCompression)
+{
+    return (pCompression->bitDepth > 0) || (pCompression->compression != SimCompressionNone);
+}
+
+/** Returns true if a frame has already been encoded, as the frames of the movie cache are */
+static bool isEncoded(NDArray *pArray)
+{
+    return !pArray->codec.empty() || pArray->pAttributeList->find(SimAttrBitDepth);
+}
+
+/** Packs an array if the settings have a bit depth, and then compresses it if they have a codec.
+  * \param[out] pUnpackTime The time in seconds taken to unpack the packed array, or -1.
+  * \return The encoded copy, or NULL on error. */
+static NDArray *encodeArray(NDArray *pArray, const simCompression_t *pCompression, double *pUnpackTime,
+                            char *errorMessage)
+{
+    NDArray *pPacked = NULL, *pCompressed;
+
+    *pUnpackTime = -1.;
+    if (pCompression->bitDepth > 0) {
+        pPacked = packArray(pArray, pCompression, pUnpackTime, errorMessage);
+        if (!pPacked || (pCompression->compression == SimCompressionNone)) return pPacked;
+        pArray = pPacked;
+    }
+    pCompressed = compressArray(pArray, pCompression, errorMessage);
+    if (pPacked) pPacked->release();
+    return pCompressed;
+}
+
+/** Reads the packing and compression settings.
+  * \param[out] pCompression The settings. */
+void simDetector::getCompression(simCompression_t *pCompression)
+{
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    getIntegerParam(SimBitDepth,        &pCompression->bitDepth);
+    getIntegerParam(SimPacking,         &pCompression->packing);
+    getIntegerParam(SimUnpackTiming,    &pCompression->unpackTiming);
+    if (pCompression->bitDepth < 0) pCompression->bitDepth = 0;
+    if (pCompression->bitDepth > SIM_MAX_BIT_DEPTH) pCompression->bitDepth = SIM_MAX_BIT_DEPTH;
+    getIntegerParam(SimCompression,     &pCompression->compression);
+    getIntegerParam(SimBloscLevel,      &pCompression->bloscLevel);
+    getIntegerParam(SimBloscShuffle,    &pCompression->bloscShuffle);
+    getIntegerParam(SimBloscCompressor, &pCompression->bloscCompressor);
+    getIntegerParam(SimJPEGQuality,     &pCompression->jpegQuality);
+    pCompression->numThreads = pContext_->numThreads_;
+}
+
+/** Replaces a frame by a packed and compressed copy.  Frames which are already encoded, such as the frames of
+  * the movie cache, are left as they are.  This does not need the mutex, so the render threads and the module
+  * threads encode their frames in parallel.
+  * \param[in,out] ppImage The frame, which is released if it is replaced.
+  * \param[in] pCompression The packing and compression settings.
+  * \return asynSuccess, or asynError if the frame cannot be encoded, in which case it is left as it is. */
+int simDetector::compressImage(NDArray **ppImage, const simCompression_t *pCompression)
+{
+    NDArray *pCompressed;
+    char errorMessage[256] = "";
+    double unpackTime;
+    epicsUInt64 startTime;
+    const char *functionName = "compressImage";
+
+    if (!encodingEnabled(pCompression) || isEncoded(*ppImage)) return asynSuccess;
+    startTime = simMonotonicNs();
+    pCompressed = encodeArray(*ppImage, pCompression, &unpackTime, errorMessage);
+    addEncodeTimes((simMonotonicNs() - startTime) * 1e-9 - ((unpackTime > 0.) ? unpackTime : 0.), unpackTime);
+    if (!pCompressed) {
+        /* Only report the first error until the settings change, rather than one per frame */
+        if (firstCompressionError()) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error encoding frame, publishing it unchanged: %s\n",
+                      driverName, functionName, errorMessage);
+        }
+        return asynError;
+    }
+    (*ppImage)->release();
+    *ppImage = pCompressed;
+    return asynSuccess;
+}
+
+/** Sets the codec, compressed size and compression ratio parameters of an address from a frame.
+  * The ratio of a packed frame is that of the frame unpacked into the smallest data type which holds its bit
+  * depth. */
+void simDetector::setCompressionParams(NDArray *pImage, int address)
+{
+    NDArrayInfo_t arrayInfo;
+    NDAttribute *pElements, *pBitDepth;
+    int rowElements, bitDepth;
+    double uncompressedSize, compressedSize;
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    pImage->getInfo(&arrayInfo);
+    uncompressedSize = (double)arrayInfo.totalBytes;
+    pElements = pImage->pAttributeList->find(SimAttrPackedElements);
+    pBitDepth = pImage->pAttributeList->find(SimAttrBitDepth);
+    if (pElements && pBitDepth &&
+        (pElements->getValue(NDAttrInt32, &rowElements) == ND_SUCCESS) &&
+        (pBitDepth->getValue(NDAttrInt32, &bitDepth) == ND_SUCCESS)) {
+        uncompressedSize = (double)rowElements * pImage->dims[pImage->ndims-1].size * simContainerSize(bitDepth);
+    }
+    if (pImage->codec.empty()) {
+        setStringParam(address, NDCodec, "");
+        compressedSize = (double)arrayInfo.totalBytes;
+    } else {
+        setStringParam(address, NDCodec, pImage->codec.name.c_str());
+        compressedSize = (double)pImage->compressedSize;
+    }
+    setIntegerParam(address, NDCompressedSize, (int)compressedSize);
+    setDoubleParam(address, SimCompressionRatio, (compressedSize > 0.) ? uncompressedSize / compressedSize : 0.);
+}
+
+/** Adds the times taken to encode a frame to the ENCODE and UNPACK timers; the mutex is not needed.
+  * \param[in] encodeTime The time in seconds taken to pack and compress the frame.
+  * \param[in] unpackTime The time in seconds taken to unpack the frame, or a negative value if it was not unpacked. */
+void simDetector::addEncodeTimes(double encodeTime, double unpackTime)
+{
+    epicsMutexLock(timerLock_);
+    timers_[SimTimerEncode].add(encodeTime);
+    if (unpackTime >= 0.) timers_[SimTimerUnpack].add(unpackTime);
+    epicsMutexUnlock(timerLock_);
+}
+
+/** Frames of the movie cache compressed by one task of compressMovie() */
+/** Marks a compression error as reported, since only the first one is reported until the settings change.
+  * \return true if no error had been reported yet. */
+bool simDetector::firstCompressionError()
+{
+    bool first;
+
+    epicsMutexLock(compressionLock_);
+    first = (compressionError_ == 0);
+    compressionError_ = 1;
+    epicsMutexUnlock(compressionLock_);
+    return first;
+}
+
+typedef struct {
+    NDArray **frames;
+    int numFrames;
+    const simCompression_t *pCompression;
+    double *encodeTimes;       /* The times taken to encode and unpack each frame, in seconds */
+    double *unpackTimes;
+    epicsMutexId errorLock;    /* Protects numErrors and errorMessage */
+    int numErrors;
+    char errorMessage[256];
+} movieCompressJob;
+
+static void compressMovieFrames(void *pvt, int task, int numTasks)
+{
+    movieCompressJob *pJob = (movieCompressJob *)pvt;
+    int first = (int)((long)pJob->numFrames * task / numTasks);
+    int last = (int)((long)pJob->numFrames * (task + 1) / numTasks);
+    char errorMessage[256];
+    NDArray *pCompressed;
+    epicsUInt64 startTime;
+    int i;
+
+    for (i=first; i<last; i++) {
+        startTime = simMonotonicNs();
+        pCompressed = encodeArray(pJob->frames[i], pJob->pCompression, &pJob->unpackTimes[i], errorMessage);
+        pJob->encodeTimes[i] = (simMonotonicNs() - startTime) * 1e-9 -
+                               ((pJob->unpackTimes[i] > 0.) ? pJob->unpackTimes[i] : 0.);
+        if (!pCompressed) {
+            epicsMutexLock(pJob->errorLock);
+            if (++pJob->numErrors == 1) strcpy(pJob->errorMessage, errorMessage);
+            epicsMutexUnlock(pJob->errorLock);
+            continue;
+        }
+        pJob->frames[i]->release();
+        pJob->frames[i] = pCompressed;
+    }
+}
+
+/** Compresses the frames of the movie cache in parallel with the worker threads, so each frame is only
+  * compressed once however many times it is published. */
+void simDetector::compressMovie()
+{
+    simCompression_t compression;
+    movieCompressJob job;
+    int i;
+    const char *functionName = "compressMovie";
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    getCompression(&compression);
+    /* The modules compress their strips of the frames */
+    if (!encodingEnabled(&compression) || (numModules_ > 1) || (numMovieFrames_ == 0)) return;
+    /* The frames are compressed in parallel rather than by Blosc's threads */
+    compression.numThreads = 1;
+    job.frames = movieFrames_;
+    job.numFrames = numMovieFrames_;
+    job.pCompression = &compression;
+    job.encodeTimes = (double *)calloc(2 * numMovieFrames_, sizeof(double));
+    if (!job.encodeTimes) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: error allocating the frame times\n", driverName, functionName);
+        return;
+    }
+    job.unpackTimes = job.encodeTimes + numMovieFrames_;
+    job.errorLock = compressionLock_;
+    job.numErrors = 0;
+    job.errorMessage[0] = 0;
+    pContext_->runRowTasks(compressMovieFrames, &job, numMovieFrames_);
+    for (i=0; i<numMovieFrames_; i++) addEncodeTimes(job.encodeTimes[i], job.unpackTimes[i]);
+    free(job.encodeTimes);
+    if ((job.numErrors > 0) && firstCompressionError()) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: error encoding %d frames, which are published unchanged: %s\n",
+                  driverName, functionName, job.numErrors, job.errorMessage);
+    }
+    /* Free the uncompressed frames */
+    pMoviePool_->emptyFreeList();
+}
+
+/** Publishes the next frame of the movie cache, filling the cache first if it is not valid.
+  * The cached frame itself is published if no plugin still holds it from the previous cycle, otherwise a copy.
+  * \param[out] ppImage The frame.
+  * \param[in] releaseLock Whether the mutex is released while the frames are computed, see computeImage(). */
+int simDetector::getMovieFrame(NDArray **ppImage, bool releaseLock)
+{
+    int movieCopy;
+    NDArray *pFrame;
+    const char *functionName = "getMovieFrame";
+
+    /* NOTE: The caller of this function must have taken the mutex and called beginGeneration() */
+
+    movieCopy = pContext_->frameParams_.movieCopy;
+    if (!movieValid_) fillMovie(pContext_->frameParams_.movieFrames, releaseLock);
+    /* Compute the frames if none fitted in the memory budget */
+    if (numMovieFrames_ == 0) return computeImage(ppImage, releaseLock, pContext_);
+
+    timers_[SimTimerConvert].start();
+    pFrame = movieFrames_[movieIndex_];
+    movieIndex_ = (movieIndex_ + 1) % numMovieFrames_;
+    if (!movieCopy && (pFrame->getReferenceCount() == 1)) {
+        pFrame->reserve();
+        *ppImage = pFrame;
+    } else {
+        *ppImage = this->pNDArrayPool->copy(pFrame, NULL, true);
+    }
+    timers_[SimTimerConvert].stop();
+    if (!*ppImage) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: error allocating buffer for copy\n",
+                  driverName, functionName);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/** Computes numFrames successive frames into the movie cache.
+  * The frames are copied into pMoviePool_, so they count towards SimMovieMemory rather than the maxMemory of the
+  * driver pool; filling stops at the first frame which does not fit in SimMovieMemory.
+  * \param[in] numFrames The number of frames.
+  * \param[in] releaseLock Whether the mutex is released while the frames are computed, see computeImage(). */
+int simDetector::fillMovie(int numFrames, bool releaseLock)
+{
+    int status = asynSuccess;
+    double maxMemory;
+    size_t memoryLimit, memoryUsed=0;
+    NDArray *pImage, *pFrame;
+    NDArrayInfo_t arrayInfo;
+    const char *functionName = "fillMovie";
+
+    releaseMovie();
+    /* A write which changes the images while the mutex is released marks the cache for refilling again */
+    movieValid_ = true;
+    maxMemory = pContext_->frameParams_.movieMemory;
+    memoryLimit = (maxMemory > 0.) ? (size_t)(maxMemory * 1024. * 1024.) : 0;
+    movieFrames_ = (NDArray **)calloc(numFrames, sizeof(NDArray *));
+    while (movieFrames_ && (numMovieFrames_ < numFrames)) {
+        status = computeImage(&pImage, releaseLock, pContext_);
+        if (status) break;
+        pImage->getInfo(&arrayInfo);
+        pFrame = NULL;
+        if (!memoryLimit || (memoryUsed + arrayInfo.totalBytes <= memoryLimit)) {
+            pFrame = pMoviePool_->copy(pImage, NULL, true);
+        }
+        pImage->release();
+        if (!pFrame) break;
+        movieFrames_[numMovieFrames_++] = pFrame;
+        memoryUsed += arrayInfo.totalBytes;
+    }
+    if (numMovieFrames_ < numFrames) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                  "%s:%s: only %d of %d frames fit in the movie cache\n",
+                  driverName, functionName, numMovieFrames_, numFrames);
+    }
+    compressMovie();
+    setIntegerParam(SimMovieFill, numMovieFrames_);
+    setDoubleParam(SimMovieMemoryUsed, memoryUsed / (1024. * 1024.));
+    return status;
+}
+
+/** Releases the frames of the movie cache and frees the memory of those not held by plugins */
+void simDetector::releaseMovie()
+{
+    int i;
+
+    for (i=0; i<numMovieFrames_; i++) movieFrames_[i]->release();
+    free(movieFrames_);
+    movieFrames_ = NULL;
+    numMovieFrames_ = 0;
+    movieIndex_ = 0;
+    movieValid_ = false;
+    pMoviePool_->emptyFreeList();
+    setIntegerParam(SimMovieFill, 0);
+    setDoubleParam(SimMovieMemoryUsed, 0.);
+}
+
+/** Maps the file replayed in SimModeFile, if it is not already mapped, and computes the number of frames in it.
+  * The file holds frames with the maximum size, the current data type and color mode, after SimFileOffset bytes
+  * of header. */
+int simDetector::openFile()
+{
+    char fileName[MAX_FILENAME_LEN];
+    int offset;
+    int prefetch;
+    const char *functionName = "openFile";
+
+    getStringParam(SimFileName, sizeof(fileName), fileName);
+    getIntegerParam(SimFileOffset, &offset);
+    getIntegerParam(SimFilePrefetch, &prefetch);
+    numFileFrames_ = 0;
+    fileFrame_ = 0;
+    fileOffset_ = (offset > 0) ? offset : 0;
+    if (!pFile_ && fileName[0]) {
+        pFile_ = new simFileSource();
+        if (pFile_->open(fileName)) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error mapping file %s\n",
+                      driverName, functionName, fileName);
+            delete pFile_;
+            pFile_ = NULL;
+        }
+    }
+    if (pFile_ && (fileOffset_ % pContext_->arrayInfo_.bytesPerElement)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: offset %d is not a multiple of the element size\n",
+                  driverName, functionName, offset);
+    } else if (pFile_ && (pFile_->size() > fileOffset_)) {
+        numFileFrames_ = (int)((pFile_->size() - fileOffset_) / pContext_->arrayInfo_.totalBytes);
+        if (numFileFrames_ == 0) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: file %s is smaller than one frame of %lu bytes\n",
+                      driverName, functionName, fileName, (unsigned long)pContext_->arrayInfo_.totalBytes);
+        }
+    }
+    setIntegerParam(SimFileFrames, numFileFrames_);
+    setIntegerParam(SimFileFrame, 0);
+    if ((numFileFrames_ > 0) && (prefetch > 0)) {
+        if (prefetch > numFileFrames_) prefetch = numFileFrames_;
+        pFile_->prefetch(fileOffset_, (size_t)prefetch * pContext_->arrayInfo_.totalBytes);
+    }
+    return (numFileFrames_ > 0) ? asynSuccess : asynError;
+}
+
+/** Moves to the next frame of the file, starting again at the end, and prefetches the frame SimFilePrefetch
+  * frames ahead.  The caller sets SimFileFrame, this may be called without the mutex. */
+void simDetector::advanceFileFrame()
+{
+    int prefetch = pContext_->frameParams_.filePrefetch;
+
+    fileFrame_ = (fileFrame_ + 1) % numFileFrames_;
+    if (prefetch > 0) {
+        pFile_->prefetch(fileOffset_ + (size_t)((fileFrame_ + prefetch - 1) % numFileFrames_) * pContext_->arrayInfo_.totalBytes,
+                         pContext_->arrayInfo_.totalBytes);
+    }
+}
+
+/** Publishes the next frame of the file without a copy, in an NDArray whose data are the mapped pages.
+  * \param[out] ppImage The frame. */
+int simDetector::getFileFrame(NDArray **ppImage)
+{
+    NDArray *pArray = NULL;
+    simFileWrapper_t *pWrappers;
+    size_t dims[ND_ARRAY_MAX_DIMS];
+    int colorMode;
+    int i;
+    const char *functionName = "getFileFrame";
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    timers_[SimTimerConvert].start();
+    /* Reuse a wrapper of this file which is no longer used by plugins */
+    for (i=0; i<numFileWrappers_; i++) {
+        if (fileWrappers_[i].pArray->getReferenceCount() == 1) {
+            pArray = fileWrappers_[i].pArray;
             break;
-        case NDColorModeRGB2:
-            columnStep = 1;
-            rowStep = 2 * sizeX;
-            pRed   = (epicsType *)pRaw_->pData;
-            pGreen = (epicsType *)pRaw_->pData + sizeX;
-            pBlue  = (epicsType *)pRaw_->pData + 2*sizeX;
+        }
+    }
+    if (!pArray) {
+        for (i=0; i<pContext_->pRaw_->ndims; i++) dims[i] = pContext_->pRaw_->dims[i].size;
+        pWrappers = (simFileWrapper_t *)realloc(fileWrappers_, (numFileWrappers_ + 1) * sizeof(simFileWrapper_t));
+        if (pWrappers) {
+            fileWrappers_ = pWrappers;
+            pArray = pFilePool_->alloc(pContext_->pRaw_->ndims, dims, pContext_->pRaw_->dataType, pContext_->arrayInfo_.totalBytes,
+                                       (void *)pFile_->data());
+        }
+        if (!pArray) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error allocating NDArray for file frame\n",
+                      driverName, functionName);
+            return asynError;
+        }
+        fileWrappers_[numFileWrappers_].pArray = pArray;
+        fileWrappers_[numFileWrappers_].pSource = pFile_;
+        numFileWrappers_++;
+    }
+
+    /* The data type, color mode and size may have changed since the wrapper was last used */
+    pArray->ndims = pContext_->pRaw_->ndims;
+    for (i=0; i<pContext_->pRaw_->ndims; i++) pArray->dims[i] = pContext_->pRaw_->dims[i];
+    pArray->dataType = pContext_->pRaw_->dataType;
+    pArray->dataSize = pContext_->arrayInfo_.totalBytes;
+    pArray->pData = (void *)(pFile_->data() + fileOffset_ + (size_t)fileFrame_ * pContext_->arrayInfo_.totalBytes);
+    pArray->pAttributeList->clear();
+    colorMode = pContext_->frameParams_.colorMode;
+    pArray->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
+    pArray->reserve();
+    *ppImage = pArray;
+    advanceFileFrame();
+    setIntegerParam(SimFileFrame, fileFrame_);
+    timers_[SimTimerConvert].stop();
+    return asynSuccess;
+}
+
+/** Releases the wrappers which are no longer used by plugins and belong to a file which is no longer replayed,
+  * and closes such a file when the last of its wrappers has been released */
+void simDetector::releaseFileWrappers()
+{
+    int i, j;
+    simFileSource *pSource;
+    NDArray *pArray;
+
+    for (i=0; i<numFileWrappers_; ) {
+        pSource = fileWrappers_[i].pSource;
+        pArray = fileWrappers_[i].pArray;
+        if ((pSource == pFile_) || (pArray->getReferenceCount() > 1)) {
+            i++;
+            continue;
+        }
+        /* The mapped pages do not belong to the pool, which must not free them */
+        pArray->pData = NULL;
+        pArray->dataSize = 0;
+        pArray->release();
+        fileWrappers_[i] = fileWrappers_[--numFileWrappers_];
+        for (j=0; j<numFileWrappers_; j++) {
+            if (fileWrappers_[j].pSource == pSource) break;
+        }
+        if (j == numFileWrappers_) delete pSource;
+    }
+}
+
+/** Stops replaying the file and closes it.
+  * If plugins are still using frames of the file it is closed by releaseFileWrappers() when they release them. */
+void simDetector::closeFile()
+{
+    simFileSource *pSource = pFile_;
+    int i;
+
+    pFile_ = NULL;
+    numFileFrames_ = 0;
+    if (!pSource) return;
+    for (i=0; i<numFileWrappers_; i++) {
+        if (fileWrappers_[i].pSource == pSource) {
+            releaseFileWrappers();
+            return;
+        }
+    }
+    delete pSource;
+}
+
+/** Takes the oldest frame from the lookahead ring, waiting for a render thread to produce one if necessary.
+  * The lock is released while waiting.
+  * \param[out] ppImage The frame, or NULL if acquisition was stopped while waiting. */
+int simDetector::getRingFrame(NDArray **ppImage)
+{
+    int acquiring;
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    *ppImage = NULL;
+    while (1) {
+        epicsMutexLock(ringLock_);
+        /* The frame at the head is NULL while a render thread is computing or compressing it */
+        if ((ringCount_ > 0) && ringFailed_[ringHead_]) {
+            ringFailed_[ringHead_] = false;
+            ringHead_ = (ringHead_ + 1) % ringDepth_;
+            ringCount_--;
+            epicsMutexUnlock(ringLock_);
+            epicsEventSignal(ringSpaceEvent_);
+            continue;
+        }
+        if ((ringCount_ > 0) && frameRing_[ringHead_]) {
+            *ppImage = frameRing_[ringHead_];
+            frameRing_[ringHead_] = NULL;
+            ringHead_ = (ringHead_ + 1) % ringDepth_;
+            ringCount_--;
+            epicsMutexUnlock(ringLock_);
+            epicsEventSignal(ringSpaceEvent_);
+            return asynSuccess;
+        }
+        epicsMutexUnlock(ringLock_);
+        getIntegerParam(ADAcquire, &acquiring);
+        if (!acquiring) return asynSuccess;
+        this->unlock();
+        epicsEventWait(ringFrameEvent_);
+        this->lock();
+    }
+}
+
+/** Discards all frames in the lookahead ring and the armed frame, and marks the movie cache for refilling.
+  * Called when a parameter that changes the generated images is modified. */
+void simDetector::flushRing()
+{
+    int i;
+
+    movieValid_ = false;
+    if (pArmedImage_) {
+        pArmedImage_->release();
+        /* The armed image may be the first tile of a frame, which starts again */
+        pContext_->tileIndex_ = 0;
+    }
+    pArmedImage_ = NULL;
+    setIntegerParam(SimArmed, 0);
+    if (ringDepth_ <= 0) return;
+    epicsMutexLock(ringLock_);
+    for (i=0; i<ringDepth_; i++) {
+        if (frameRing_[i]) frameRing_[i]->release();
+        frameRing_[i] = NULL;
+        ringFailed_[i] = false;
+    }
+    ringHead_ = 0;
+    ringCount_ = 0;
+    ringEpoch_++;
+    epicsMutexUnlock(ringLock_);
+    epicsEventSignal(ringSpaceEvent_);
+}
+
+/** Finds the caches of the images which a parameter invalidates in the current simulation mode.
+  * The caches of the other modes are rebuilt when SimMode changes, so their parameters invalidate nothing.
+  * \param[in] function The parameter.
+  * \param[out] pResets The SimReset_t mask of the caches, 0 if the parameter does not change the images in
+  *             the current mode.
+  * \return true if the parameter is one of those used to compute the images. */
+bool simDetector::imageResets(int function, int *pResets)
+{
+    int simMode;
+    int modeReset;
+
+    getIntegerParam(SimMode, &simMode);
+    /* The cache of the mode which depends on the gains */
+    switch (simMode) {
+        case SimModeLinearRamp:
+            modeReset = SimResetRamp;
             break;
-        case NDColorModeRGB3:
-            columnStep = 1;
-            rowStep = 0;
-            pRed   = (epicsType *)pRaw_->pData;
-            pGreen = (epicsType *)pRaw_->pData + sizeX*sizeY;
-            pBlue  = (epicsType *)pRaw_->pData + 2*sizeX*sizeY;
+        case SimModePeaks:
+            modeReset = SimResetPeaks;
+            break;
+        case SimModeSine:
+            modeReset = SimResetSine;
+            break;
+        default:
+            modeReset = 0;
             break;
     }
-    pRaw_->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
 
-    if (resetImage) {
-      if (xSine1_) free(xSine1_);
-      if (xSine2_) free(xSine2_);
-      if (ySine1_) free(ySine1_);
-      if (ySine2_) free(ySine2_);
-      xSine1_ = (double *)calloc(sizeX, sizeof(double));
-      xSine2_ = (double *)calloc(sizeX, sizeof(double));
-      ySine1_ = (double *)calloc(sizeY, sizeof(double));
-      ySine2_ = (double *)calloc(sizeY, sizeof(double));
-      xSineCounter_ = 0;
-      ySineCounter_ = 0;
-    } 
-    
-    for (i=0; i<sizeX; i++) {
-        xTime = xSineCounter_++ * gainX / sizeX;
-        xSine1_[i] = xSine1Amplitude * sin((xTime  * xSine1Frequency + xSine1Phase/360.) * 2. * M_PI);
-        xSine2_[i] = xSine2Amplitude * sin((xTime  * xSine2Frequency + xSine2Phase/360.) * 2. * M_PI);
-    }
-    for (i=0; i<sizeY; i++) {
-        yTime = ySineCounter_++ * gainY / sizeY;
-        ySine1_[i] = ySine1Amplitude * sin((yTime  * ySine1Frequency + ySine1Phase/360.) * 2. * M_PI);
-        ySine2_[i] = ySine2Amplitude * sin((yTime  * ySine2Frequency + ySine2Phase/360.) * 2. * M_PI);
-    }                             
-    
-    if (colorMode == NDColorModeMono) {
-        if (xSineOperation == SimSineOperationAdd) {
-            for (i=0; i<sizeX; i++) {
-                xSine1_[i] = xSine1_[i] + xSine2_[i];
+    *pResets = 0;
+    if ((function == NDDataType) || (function == NDColorMode) || (function == SimMode)) {
+        *pResets = SimResetAll;
+    } else if ((function == SimOffset) || (function == SimNoise) ||
+               (function == SimNoiseSeed) || (function == SimNoiseModel) ||
+               (function == SimNoiseGaussian) || (function == SimNoiseShot) || (function == SimNoiseRead)) {
+        /* The ramp is kept apart from the raw image when there is a background, so it starts again too */
+        *pResets = SimResetFrame | SimResetBackground;
+        if (simMode == SimModeLinearRamp) *pResets |= SimResetRamp;
+        /* Generators are given the seed when they are prepared */
+        if ((simMode == SimModeGenerator) && (function == SimNoiseSeed)) *pResets |= SimResetGenerator;
+    } else if ((function == ADGain) ||
+               (function == SimGainRed) || (function == SimGainGreen) || (function == SimGainBlue)) {
+        /* The values of generators are scaled by the gains as they are added to the image */
+        if (modeReset || (simMode == SimModeGenerator)) *pResets = SimResetFrame | modeReset;
+    } else if ((function == SimGainX) || (function == SimGainY)) {
+        if ((simMode == SimModeLinearRamp) || (simMode == SimModeSine)) *pResets = SimResetFrame | modeReset;
+    } else if ((function == SimPeakStartX) || (function == SimPeakStartY) ||
+               (function == SimPeakNumX)   || (function == SimPeakNumY) ||
+               (function == SimPeakStepX)  || (function == SimPeakStepY) ||
+               (function == SimPeakHeightVariation)) {
+        /* The peaks are drawn again at their new places, from the same peak */
+        if (simMode == SimModePeaks) *pResets = SimResetFrame;
+    } else if ((function == SimPeakWidthX) || (function == SimPeakWidthY) ||
+               (function == SimPeakShiftX) || (function == SimPeakShiftY) ||
+               (function == SimPeakGainBuckets)) {
+        if (simMode == SimModePeaks) *pResets = SimResetFrame | SimResetPeaks;
+    } else if ((function == SimXSineOperation) || (function == SimYSineOperation) ||
+               (function == SimXSine1Amplitude) || (function == SimXSine1Frequency) || (function == SimXSine1Phase) ||
+               (function == SimXSine2Amplitude) || (function == SimXSine2Frequency) || (function == SimXSine2Phase) ||
+               (function == SimYSine1Amplitude) || (function == SimYSine1Frequency) || (function == SimYSine1Phase) ||
+               (function == SimYSine2Amplitude) || (function == SimYSine2Frequency) || (function == SimYSine2Phase)) {
+        if (simMode == SimModeSine) *pResets = SimResetFrame | SimResetSine;
+    } else if ((function == SimFileName) || (function == SimFileOffset)) {
+        if (simMode == SimModeFile) *pResets = SimResetFrame | SimResetFile;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/** Invalidates caches of the images from the next frame, and discards the frames computed ahead with them.
+  * \param[in] resets The SimReset_t mask of the caches; nothing is done if it is 0. */
+void simDetector::requestReset(int resets)
+{
+    if (!resets) return;
+    pendingResets_ |= resets;
+    flushRing();
+}
+
+/** Does the work of the first frames ahead of acquisition, so that acquisition starts at the full frame rate.
+  * Computing the first frame resets the image if needed: the raw image is allocated and the background, the peaks or
+  * the sine tables are computed, the file is mapped or the movie cache is filled.  The frame is then kept for the
+  * start of acquisition, or the lookahead ring is filled.  SimArmBuffers NDArrays of the size of the frames are also
+  * allocated and written, and returned to the free list of the pool, so that the following frames do not page fault.
+  * The frames are discarded if a parameter which changes the images is modified before acquisition starts.
+  * They are computed with the mutex held, so that acquisition cannot start before they are ready. */
+asynStatus simDetector::arm()
+{
+    int status = asynSuccess;
+    int acquiring;
+    int numBuffers;
+    int i;
+    NDArray *pImage = NULL;
+    NDArray **buffers;
+    NDArrayInfo_t arrayInfo;
+    size_t dims[ND_ARRAY_MAX_DIMS];
+    epicsTimeStamp startTime, endTime;
+    simCompression_t compression;
+    const char *functionName = "arm";
+
+    /* NOTE: The caller of this function must have taken the mutex */
+
+    getIntegerParam(ADAcquire, &acquiring);
+    if (acquiring) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: cannot arm while acquiring\n", driverName, functionName);
+        return asynError;
+    }
+    epicsTimeGetCurrent(&startTime);
+    getCompression(&compression);
+    if (ringDepth_ > 0) {
+        /* The render threads are idle until acquisition starts, so fill the ring here */
+        while (1) {
+            epicsMutexLock(ringLock_);
+            if (ringCount_ + ringPending_ >= ringDepth_) {
+                epicsMutexUnlock(ringLock_);
+                break;
             }
+            epicsMutexUnlock(ringLock_);
+            status = nextImage(&pImage, false);
+            if (status) break;
+            if (numModules_ <= 1) compressImage(&pImage, &compression);
+            epicsMutexLock(ringLock_);
+            frameRing_[(ringHead_ + ringCount_) % ringDepth_] = pImage;
+            ringCount_++;
+            epicsMutexUnlock(ringLock_);
         }
-        else {
-            for (i=0; i<sizeX; i++) {
-                xSine1_[i] = xSine1_[i] * xSine2_[i];
+        epicsMutexLock(ringLock_);
+        pImage = (ringCount_ > 0) ? frameRing_[ringHead_] : NULL;
+        epicsMutexUnlock(ringLock_);
+    } else {
+        if (!pArmedImage_) {
+            status = nextImage(&pArmedImage_, false);
+            if (!status && (numModules_ <= 1)) compressImage(&pArmedImage_, &compression);
+        }
+        pImage = pArmedImage_;
+    }
+    if (status || !pImage) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: error computing the first frame\n", driverName, functionName);
+        return asynError;
+    }
+
+    /* Touch the pages of the buffers the plugins will hold while the following frames are computed */
+    getIntegerParam(SimArmBuffers, &numBuffers);
+    if (numBuffers > 0) {
+        pImage->getInfo(&arrayInfo);
+        for (i=0; i<pImage->ndims; i++) dims[i] = pImage->dims[i].size;
+        buffers = (NDArray **)calloc(numBuffers, sizeof(NDArray *));
+        for (i=0; buffers && (i<numBuffers); i++) {
+            buffers[i] = this->pNDArrayPool->alloc(pImage->ndims, dims, pImage->dataType, 0, NULL);
+            if (!buffers[i]) break;
+            memset(buffers[i]->pData, 0, arrayInfo.totalBytes);
+        }
+        for (i=0; buffers && (i<numBuffers) && buffers[i]; i++) buffers[i]->release();
+        free(buffers);
+    }
+
+    epicsTimeGetCurrent(&endTime);
+    setDoubleParam(SimArmTime, epicsTimeDiffInSeconds(&endTime, &startTime) * 1e3);
+    setIntegerParam(SimArmed, 1);
+    return asynSuccess;
+}
+
+/** Enables or disables the render threads; they only fill the ring while acquiring */
+void simDetector::setRingActive(bool active)
+{
+    if (ringDepth_ <= 0) return;
+    epicsMutexLock(ringLock_);
+    ringActive_ = active;
+    epicsMutexUnlock(ringLock_);
+    if (active) {
+        epicsEventSignal(ringSpaceEvent_);
+    } else {
+        /* Wake up simTask if it is waiting for a frame */
+        epicsEventSignal(ringFrameEvent_);
+    }
+}
+
+/** Runs the render thread which computes its frames in this context */
+void simRenderContext::renderTask()
+{
+    pDetector_->renderTask(this);
+}
+
+static void renderTaskC(void *pvt)
+{
+    simRenderContext *pContext = (simRenderContext *)pvt;
+
+    pContext->renderTask();
+}
+
+/** This thread renders frames ahead of simTask and appends them to the lookahead ring.
+  * Each render thread computes its frames in its own context without the driver lock, so the render threads
+  * compute frames in parallel and neither simTask nor the writes to the parameters wait for them.  The frames
+  * which are computed from the previous frame are generated one at a time in pContext_, see nextImage().
+  * \param[in] pContext The context of the render thread. */
+void simDetector::renderTask(simRenderContext *pContext)
+{
+    int status;
+    NDArray *pImage;
+    int affinityEpoch = 0;
+    simCompression_t compression;
+    bool compress;
+    double acquirePeriod;
+    double retryDelay = 0.;
+    int numFailures = 0;
+    const char *functionName = "renderTask";
+
+    while (1) {
+        /* Wait until we are acquiring and there is a free slot in the ring */
+        epicsMutexLock(ringLock_);
+        while (!ringActive_ || (ringCount_ + ringPending_ >= ringDepth_)) {
+            epicsMutexUnlock(ringLock_);
+            epicsEventWait(ringSpaceEvent_);
+            epicsMutexLock(ringLock_);
+        }
+        ringPending_++;
+        /* Wake another render thread if there is still room */
+        if (ringCount_ + ringPending_ < ringDepth_) epicsEventSignal(ringSpaceEvent_);
+        epicsMutexUnlock(ringLock_);
+
+        this->lock();
+        applyAffinity(&cpus_[SimAffinityRender], affinityEpoch_[SimAffinityRender], &affinityEpoch, "render");
+        /* The frame takes its place in the ring when it is claimed, so frames stay in order */
+        status = nextImage(&pImage, true, pContext);
+        if (status != asynSuccess) {
+            /* Wait before trying again, twice as long after each failure in a row, so a lack of memory neither
+             * keeps the lock from the other threads nor floods the log */
+            pImage = NULL;
+            getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+            retryDelay = numFailures ? 2. * retryDelay : acquirePeriod;
+            if (retryDelay < MIN_RETRY_DELAY) retryDelay = MIN_RETRY_DELAY;
+            if (retryDelay > MAX_RETRY_DELAY) retryDelay = MAX_RETRY_DELAY;
+            if (numFailures == 0) {
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                          "%s:%s: error rendering a frame, retrying\n", driverName, functionName);
             }
+            numFailures++;
+        } else if (numFailures > 0) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                      "%s:%s: rendering frames again after %d failures\n", driverName, functionName, numFailures);
+            numFailures = 0;
         }
-        if (ySineOperation == SimSineOperationAdd) {
-            for (i=0; i<sizeY; i++) {
-                ySine1_[i] = ySine1_[i] + ySine2_[i];
+        getCompression(&compression);
+        /* The modules compress their strips of the frames */
+        compress = pImage && encodingEnabled(&compression) && (numModules_ <= 1) && !isEncoded(pImage);
+        /* A frame which is compressed fills its place once it is compressed without the lock, in parallel
+         * with the other render threads; simTask waits for the place to be filled, and skips it if the
+         * frame could not be computed.  flushRing() changes the epoch with both locks held. */
+        epicsMutexLock(ringLock_);
+        if (pContext->ringEpoch_ == ringEpoch_) {
+            if (!pImage) {
+                ringFailed_[pContext->ringSlot_] = true;
+            } else if (!compress) {
+                frameRing_[pContext->ringSlot_] = pImage;
+                pImage = NULL;
             }
         }
-        else {
-            for (i=0; i<sizeY; i++) {
-                ySine1_[i] = ySine1_[i] * ySine2_[i];
+        epicsMutexUnlock(ringLock_);
+        this->unlock();
+        if (compress) {
+            compressImage(&pImage, &compression);
+            epicsMutexLock(ringLock_);
+            if (pContext->ringEpoch_ == ringEpoch_) {
+                frameRing_[pContext->ringSlot_] = pImage;
+                pImage = NULL;
             }
+            epicsMutexUnlock(ringLock_);
         }
+        /* The ring was flushed while the frame was rendered or compressed, so it may have the old settings */
+        if (pImage) pImage->release();
+        epicsEventSignal(ringFrameEvent_);
+        if (status != asynSuccess) epicsThreadSleep(retryDelay);
     }
-    for (i=0; i<sizeY; i++) {
-        switch (colorMode) {
-            case NDColorModeMono:
-                for (j=0; j<sizeX; j++) {
-                    *pMono++ += (epicsType) (gain * (ySine1_[i] + xSine1_[j]));
-                }
+}
+
+/** Hands an image to each module, waiting for the module to take its strip of the previous image.
+  * The caller must have taken the mutex, which is released while waiting.
+  * \param[in] pImage The image.
+  * \param[in] arrayCallbacks Whether the modules call the NDArray callbacks. */
+void simDetector::publishModules(NDArray *pImage, int arrayCallbacks)
+{
+    int i;
+    simModule_t *pModule;
+
+    for (i=0; i<numModules_; i++) {
+        pModule = &modules_[i];
+        this->unlock();
+        epicsEventWait(pModule->idleEvent);
+        this->lock();
+        pImage->reserve();
+        pModule->pImage = pImage;
+        pModule->arrayCallbacks = arrayCallbacks;
+        getCompression(&pModule->compression);
+        epicsEventSignal(pModule->frameEvent);
+    }
+}
+
+static void moduleTaskC(void *pvt)
+{
+    simModule_t *pModule = (simModule_t *)pvt;
+
+    pModule->pDetector->moduleTask(pModule);
+}
+
+/** This thread publishes the strip of rows of each image which belongs to one module on the module's address.
+  * The strip is copied from the image without the lock, and the callbacks to the plugins of the module are done
+  * without the lock, so the plugin chains of the modules run in parallel.  The module is ready for the next
+  * image as soon as it has copied its strip. */
+void simDetector::moduleTask(simModule_t *pModule)
+{
+    NDArray *pImage, *pStrip;
+    NDArrayInfo_t arrayInfo;
+    NDDimension_t dims[ND_ARRAY_MAX_DIMS];
+    int address = pModule->address;
+    int arrayCallbacks;
+    int status;
+    int i;
+    size_t firstRow, numRows;
+    int affinityEpoch = 0;
+    epicsUInt64 publishTime;
+    simCompression_t compression;
+    const char *functionName = "moduleTask";
+
+    while (1) {
+        epicsEventWait(pModule->frameEvent);
+        pImage = pModule->pImage;
+        arrayCallbacks = pModule->arrayCallbacks;
+        compression = pModule->compression;
+        if (!pImage) continue;
+        if (affinityEpoch != pModule->affinityEpoch) {
+            this->lock();
+            applyAffinity(&pModule->cpus, pModule->affinityEpoch, &affinityEpoch, "module");
+            this->unlock();
+        }
+
+        /* The rows of the image are divided between the modules as evenly as possible */
+        pImage->getInfo(&arrayInfo);
+        for (i=0; i<pImage->ndims; i++) {
+            pImage->initDimension(&dims[i], pImage->dims[i].size);
+        }
+        firstRow = arrayInfo.ySize * address / numModules_;
+        numRows  = arrayInfo.ySize * (address + 1) / numModules_ - firstRow;
+        dims[arrayInfo.yDim].offset = firstRow;
+        dims[arrayInfo.yDim].size = numRows;
+        status = pNDArrayPool->convert(pImage, &pStrip, pImage->dataType, dims);
+        pImage->release();
+        pModule->pImage = NULL;
+        epicsEventSignal(pModule->idleEvent);
+        if (status) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s:%s: error copying the strip of module %d\n", driverName, functionName, address);
+            continue;
+        }
+        pStrip->pAttributeList->add("ModuleAddress", "Address of the module", NDAttrInt32, &address);
+        i = (int)firstRow;
+        pStrip->pAttributeList->add("ModuleOffsetY", "First row of the module in the image", NDAttrInt32, &i);
+        /* The modules compress their strips in parallel */
+        compressImage(&pStrip, &compression);
+
+        this->lock();
+        if (this->pArrays[address]) this->pArrays[address]->release();
+        this->pArrays[address] = pStrip;
+        pStrip->getInfo(&arrayInfo);
+        setIntegerParam(address, NDArraySize,  (int)arrayInfo.totalBytes);
+        setIntegerParam(address, NDArraySizeX, (int)arrayInfo.xSize);
+        setIntegerParam(address, NDArraySizeY, (int)arrayInfo.ySize);
+        setCompressionParams(pStrip, address);
+        callParamCallbacks(address);
+        this->unlock();
+
+        /* Only this thread replaces pArrays[address], so pStrip stays valid without the lock */
+        if (arrayCallbacks) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                      "%s:%s: calling imageData callback for module %d\n", driverName, functionName, address);
+            if (pStrip->pAttributeList->find(SimAttrGenerateStart)) {
+                publishTime = simMonotonicNs();
+                pStrip->pAttributeList->add(SimAttrPublish, "Time the frame was published (ns)", NDAttrUInt64, &publishTime);
+            }
+            doCallbacksGenericPointer(pStrip, NDArrayData, address);
+        }
+    }
+}
+
+/** Restricts the calling thread to a set of CPUs if the set has changed since the thread last applied it.
+  * The caller must have taken the mutex.
+  * \param[in] pCpus The CPUs.
+  * \param[in] epoch The number of times the set has been changed.
+  * \param[in,out] pAppliedEpoch The epoch of the set the thread last applied.
+  * \param[in] threadName The kind of thread, for the error message. */
+void simDetector::applyAffinity(const simCpuSet *pCpus, int epoch, int *pAppliedEpoch, const char *threadName)
+{
+    char cpus[256];
+    const char *functionName = "applyAffinity";
+
+    if (*pAppliedEpoch == epoch) return;
+    *pAppliedEpoch = epoch;
+    if (pCpus->apply()) {
+        pCpus->format(cpus, sizeof(cpus));
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: unable to run the %s thread on CPUs %s\n",
+                  driverName, functionName, threadName, cpus);
+    }
+}
+
+/** Sets the CPUs which threads of the driver run on.
+  * Each thread applies its CPUs itself before its next frame.  The raw image, the scratch buffers and the free
+  * NDArrays of the pool are then released, so that the memory of the following frames is touched first, and
+  * so normally allocated on the NUMA node of the CPUs, by the threads which compute them.
+  * \param[in] threads "acquire", "workers", "render", "modules", "moduleN" for module N, or "all".
+  * \param[in] cpus A list of CPU numbers and ranges, for example "0-3,8", or "all" to let the threads run on any CPU. */
+asynStatus simDetector::setAffinity(const char *threads, const char *cpus)
+{
+    simCpuSet set;
+    int first, last, module = -1;
+    int i, j;
+    char extra;
+    const char *functionName = "setAffinity";
+
+    if (set.parse(cpus)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: invalid list of CPUs %s\n", driverName, functionName, cpus);
+        return asynError;
+    }
+    if (!threads) threads = "";
+    first = last = -1;
+    if (strcmp(threads, "all") == 0) {
+        first = 0;
+        last = SimNumAffinity - 1;
+    } else if (strcmp(threads, "acquire") == 0) {
+        first = last = SimAffinityAcquire;
+    } else if (strcmp(threads, "workers") == 0) {
+        first = last = SimAffinityWorkers;
+    } else if (strcmp(threads, "render") == 0) {
+        first = last = SimAffinityRender;
+    } else if (strcmp(threads, "modules") == 0) {
+        first = last = SimAffinityModules;
+    } else if ((sscanf(threads, "module%d%c", &module, &extra) != 1) ||
+               (module < 0) || (module >= numModules_) || !modules_) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: invalid threads %s\n", driverName, functionName, threads);
+        return asynError;
+    }
+
+    this->lock();
+    /* The buffers of the generation are released below */
+    beginGeneration();
+    for (i=first; (i>=0) && (i<=last); i++) {
+        cpus_[i] = set;
+        affinityEpoch_[i]++;
+        if ((i == SimAffinityWorkers) && pWorkerPool_) pWorkerPool_->setAffinity(&set);
+        if ((i == SimAffinityModules) && modules_) {
+            for (j=0; j<numModules_; j++) {
+                modules_[j].cpus = set;
+                modules_[j].affinityEpoch++;
+            }
+        }
+    }
+    if (module >= 0) {
+        modules_[module].cpus = set;
+        modules_[module].affinityEpoch++;
+    }
+
+    /* Release the memory touched by the threads on their previous CPUs; the render threads release theirs before
+     * their next frame */
+    flushRing();
+    pContext_->releaseBuffers();
+    for (i=0; i<numRenderThreads_; i++) renderContexts_[i]->releaseBuffers_ = true;
+    this->pNDArrayPool->emptyFreeList();
+    setIntegerParam(SimResetImage, 1);
+    frameParamsDirty_ = true;
+    endGeneration();
+    this->unlock();
+    return asynSuccess;
+}
+
+/** Sets the generator of the images in SimModeGenerator.
+  * The generator is created by the factory registered with its name, and replaces the previous one.
+  * \param[in] name The name of the factory.
+  * \param[in] args The arguments of the factory, which depend on the generator. */
+asynStatus simDetector::setGenerator(const char *name, const char *args)
+{
+    simGenerator *pGenerator;
+    simGenerator *pPrevious;
+    int simMode;
+    const char *functionName = "setGenerator";
+
+    if (!name) name = "";
+    /* The generator is created without the lock, its factory may take some time */
+    pGenerator = simCreateGenerator(name, args);
+    if (!pGenerator) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s:%s: unable to create generator %s with arguments \"%s\"\n",
+                  driverName, functionName, name, args ? args : "");
+        printf("The generators are:\n");
+        simPrintGenerators(stdout);
+        return asynError;
+    }
+
+    this->lock();
+    /* The previous generator may be computing a frame */
+    beginGeneration();
+    pPrevious = pGenerator_;
+    pGenerator_ = pGenerator;
+    generatorReady_ = 0;
+    getIntegerParam(SimMode, &simMode);
+    if (simMode == SimModeGenerator) requestReset(SimResetFrame | SimResetGenerator);
+    setStringParam(SimGenerator, name);
+    frameParamsDirty_ = true;
+    endGeneration();
+    callParamCallbacks();
+    this->unlock();
+    delete pPrevious;
+    return asynSuccess;
+}
+
+/** Waits until the deadline or until acquisition is stopped.
+  * Sleeps until spinTime seconds before the deadline and then polls the clock, so that short waits are accurate.
+  * The caller must have taken the mutex, which is released while waiting, even if the deadline has passed.
+  * \return true if acquisition was stopped. */
+bool simDetector::waitUntil(const epicsTimeStamp *pDeadline, double spinTime)
+{
+    epicsTimeStamp now;
+    double remaining;
+    bool stopped = false;
+
+    this->unlock();
+    epicsTimeGetCurrent(&now);
+    remaining = epicsTimeDiffInSeconds(pDeadline, &now);
+    if (remaining - spinTime > 0.) {
+        stopped = (epicsEventWaitWithTimeout(stopEventId_, remaining - spinTime) == epicsEventWaitOK);
+    }
+    while (!stopped) {
+        if (epicsEventTryWait(stopEventId_) == epicsEventWaitOK) {
+            stopped = true;
+            break;
+        }
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(pDeadline, &now) <= 0.) break;
+    }
+    this->lock();
+    return stopped;
+}
+
+/** Waits for the trigger which starts the next burst, or for the gate of the trigger source to be open.
+  * Triggers which arrived while the previous burst was acquired, except the last one, are counted as missed.
+  * The caller must have taken the mutex, which is released while waiting.
+  * \param[in,out] pTriggerMode The trigger mode, which is read again if it changes while waiting.
+  * \param[out] pTriggerTime The time of the trigger.
+  * \param[out] pGateOpened In gated mode, true if the gate was closed when the wait started.
+  * \return true if acquisition was stopped. */
+bool simDetector::waitForTrigger(int *pTriggerMode, epicsTimeStamp *pTriggerTime, bool *pGateOpened)
+{
+    epicsUInt32 count;
+    bool waiting = false;
+
+    *pGateOpened = false;
+    while (1) {
+        if (epicsEventTryWait(stopEventId_) == epicsEventWaitOK) return true;
+        getIntegerParam(ADTriggerMode, pTriggerMode);
+        if (*pTriggerMode == SimTriggerSoftware) {
+            if (softwareSeen_ != softwareTriggers_) {
+                triggersMissed_ += softwareTriggers_ - softwareSeen_ - 1;
+                softwareSeen_ = softwareTriggers_;
+                triggerNumber_ = softwareTriggers_;
+                *pTriggerTime = softwareTime_;
                 break;
-            case NDColorModeRGB1:
-            case NDColorModeRGB2:
-            case NDColorModeRGB3:
-                for (j=0; j<sizeX; j++) {
-                    *pRed   += (epicsType)(gain * gainRed   * xSine1_[j]);
-                    *pGreen += (epicsType)(gain * gainGreen * ySine1_[i]);
-                    *pBlue  += (epicsType)(gain * gainBlue  * (xSine2_[j] + ySine2_[i])/2.);
-                    pRed   += columnStep;
-                    pGreen += columnStep;
-                    pBlue  += columnStep;
-                }
-                pRed   += rowStep;
-                pGreen += rowStep;
-                pBlue  += rowStep;
+            }
+        } else if (*pTriggerMode == SimTriggerGated) {
+            if (pTrigger_->gateOpen()) {
+                *pGateOpened = waiting;
+                break;
+            }
+        } else if (*pTriggerMode == SimTriggerExternal) {
+            count = pTrigger_->lastEdge(pTriggerTime);
+            if (count != triggerCount_) {
+                triggersMissed_ += count - triggerCount_ - 1;
+                triggerCount_ = count;
+                triggerNumber_ = count;
                 break;
+            }
+        } else {
+            /* The timing is now internal */
+            break;
+        }
+        if (!waiting) {
+            setIntegerParam(ADStatus, ADStatusWaiting);
+            callParamCallbacks();
+            waiting = true;
         }
+        this->unlock();
+        epicsEventWait(triggerEvent_);
+        this->lock();
     }
-    return(status);
+    setIntegerParam(SimTriggerNumber, (int)triggerNumber_);
+    setIntegerParam(SimTriggersMissed, triggersMissed_);
+    return false;
 }
 
-/** Controls the shutter */
-void simDetector::setShutter(int open)
+/** Subscribes to a trigger source, creating it if it does not exist yet.
+  * \param[in] name The name of the source; an empty name selects the source named after the port. */
+void simDetector::setTriggerSource(const char *name)
 {
-    int shutterMode;
+    epicsTimeStamp time;
 
-    getIntegerParam(ADShutterMode, &shutterMode);
-    if (shutterMode == ADShutterModeDetector) {
-        /* Simulate a shutter by just changing the status readback */
-        setIntegerParam(ADShutterStatus, open);
-    } else {
-        /* For no shutter or EPICS shutter call the base class method */
-        ADDriver::setShutter(open);
-    }
+    if (!name || (name[0] == 0)) name = this->portName;
+    if (pTrigger_) pTrigger_->unsubscribe(triggerEvent_);
+    pTrigger_ = simTriggerSource::find(name);
+    pTrigger_->subscribe(triggerEvent_);
+    /* Only the edges fired from now on start frames */
+    triggerCount_ = pTrigger_->lastEdge(&time);
+    setDoubleParam(SimTriggerPeriod, pTrigger_->period());
+    setIntegerParam(SimTriggerGate, pTrigger_->gateOpen() ? 1 : 0);
+    epicsEventSignal(triggerEvent_);
 }
 
-/** Computes the new image data */
-int simDetector::computeImage()
+/** Clears the frame rate and jitter statistics at the start of acquisition */
+void simDetector::resetPacingStats(const epicsTimeStamp *pStartTime)
 {
-    int status = asynSuccess;
-    NDDataType_t dataType;
-    int itemp;
-    int binX, binY, minX, minY, sizeX, sizeY, reverseX, reverseY;
-    int xDim=0, yDim=1, colorDim=-1;
-    int resetImage;
-    int maxSizeX, maxSizeY;
-    int colorMode;
-    int ndims=0;
-    NDDimension_t dimsOut[3];
-    size_t dims[3];
-    NDArrayInfo_t arrayInfo;
-    NDArray *pImage;
-    const char* functionName = "computeImage";
-
-    /* NOTE: The caller of this function must have taken the mutex */
-
-    status |= getIntegerParam(ADBinX,         &binX);
-    status |= getIntegerParam(ADBinY,         &binY);
-    status |= getIntegerParam(ADMinX,         &minX);
-    status |= getIntegerParam(ADMinY,         &minY);
-    status |= getIntegerParam(ADSizeX,        &sizeX);
-    status |= getIntegerParam(ADSizeY,        &sizeY);
-    status |= getIntegerParam(ADReverseX,     &reverseX);
-    status |= getIntegerParam(ADReverseY,     &reverseY);
-    status |= getIntegerParam(ADMaxSizeX,     &maxSizeX);
-    status |= getIntegerParam(ADMaxSizeY,     &maxSizeY);
-    status |= getIntegerParam(NDColorMode,    &colorMode);
-    status |= getIntegerParam(NDDataType,     &itemp); dataType = (NDDataType_t)itemp;
-    status |= getIntegerParam(SimResetImage,  &resetImage);
-    if (status) asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: error getting parameters\n",
-                    driverName, functionName);
+    rateStartTime_ = *pStartTime;
+    rateFrames_ = 0;
+    jitterSumSquares_ = 0.;
+    jitterMax_ = 0.;
+    jitterCount_ = 0;
+    lateFrames_ = 0;
+    setDoubleParam(SimFrameRate, 0.);
+    setDoubleParam(SimJitterLast, 0.);
+    setDoubleParam(SimJitterRMS, 0.);
+    setDoubleParam(SimJitterMax, 0.);
+    setIntegerParam(SimLateFrames, 0);
+}
 
-    /* Make sure parameters are consistent, fix them if they are not */
-    if (binX < 1) {
-        binX = 1;
-        status |= setIntegerParam(ADBinX, binX);
-    }
-    if (binY < 1) {
-        binY = 1;
-        status |= setIntegerParam(ADBinY, binY);
-    }
-    if (minX < 0) {
-        minX = 0;
-        status |= setIntegerParam(ADMinX, minX);
-    }
-    if (minY < 0) {
-        minY = 0;
-        status |= setIntegerParam(ADMinY, minY);
-    }
-    if (minX > maxSizeX-1) {
-        minX = maxSizeX-1;
-        status |= setIntegerParam(ADMinX, minX);
-    }
-    if (minY > maxSizeY-1) {
-        minY = maxSizeY-1;
-        status |= setIntegerParam(ADMinY, minY);
-    }
-    if (minX+sizeX > maxSizeX) {
-        sizeX = maxSizeX-minX;
-        status |= setIntegerParam(ADSizeX, sizeX);
-    }
-    if (minY+sizeY > maxSizeY) {
-        sizeY = maxSizeY-minY;
-        status |= setIntegerParam(ADSizeY, sizeY);
-    }
+/** Updates the frame rate and jitter statistics with the actual and the scheduled start of a frame.
+  * The jitter is in us and is only measured for the first frame of a burst; the rate is updated about once per second. */
+void simDetector::updatePacingStats(const epicsTimeStamp *pStartTime, const epicsTimeStamp *pScheduledTime, bool burstStart)
+{
+    double jitter;
+    double elapsed;
 
-    switch (colorMode) {
-        case NDColorModeMono:
-            ndims = 2;
-            xDim = 0;
-            yDim = 1;
-            break;
-        case NDColorModeRGB1:
-            ndims = 3;
-            colorDim = 0;
-            xDim     = 1;
-            yDim     = 2;
-            break;
-        case NDColorModeRGB2:
-            ndims = 3;
-            colorDim = 1;
-            xDim     = 0;
-            yDim     = 2;
-            break;
-        case NDColorModeRGB3:
-            ndims = 3;
-            colorDim = 2;
-            xDim     = 0;
-            yDim     = 1;
-            break;
-    }
+    rateFrames_++;
+    if (!burstStart) return;
 
-    if (resetImage) {
-    /* Free the previous raw buffer */
-        if (pRaw_) pRaw_->release();
-        /* Allocate the raw buffer we use to compute images. */
-        dims[xDim] = maxSizeX;
-        dims[yDim] = maxSizeY;
-        if (ndims > 2) dims[colorDim] = 3;
-        pRaw_        = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
-        pBackground_ = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
-        pRamp_       = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
-        pPeak_       = this->pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
-        pRaw_->getInfo(&arrayInfo_);
+    jitter = fabs(epicsTimeDiffInSeconds(pStartTime, pScheduledTime)) * 1e6;
+    jitterSumSquares_ += jitter * jitter;
+    jitterCount_++;
+    if (jitter > jitterMax_) jitterMax_ = jitter;
+    setDoubleParam(SimJitterLast, jitter);
+    setDoubleParam(SimJitterRMS, sqrt(jitterSumSquares_ / jitterCount_));
+    setDoubleParam(SimJitterMax, jitterMax_);
+    setIntegerParam(SimLateFrames, lateFrames_);
 
-        if (!pRaw_) {
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                      "%s:%s: error allocating raw buffer\n",
-                      driverName, functionName);
-            return(status);
-        }
+    elapsed = epicsTimeDiffInSeconds(pStartTime, &rateStartTime_);
+    if (elapsed >= 1.) {
+        /* The frame which starts the next interval is counted in it, so count the intervals between frame starts */
+        setDoubleParam(SimFrameRate, (rateFrames_ - 1) / elapsed);
+        rateStartTime_ = *pStartTime;
+        rateFrames_ = 1;
     }
+}
 
-    switch (dataType) {
-        case NDInt8:
-            status |= computeArray<epicsInt8>(maxSizeX, maxSizeY);
-            break;
-        case NDUInt8:
-            status |= computeArray<epicsUInt8>(maxSizeX, maxSizeY);
-            break;
-        case NDInt16:
-            status |= computeArray<epicsInt16>(maxSizeX, maxSizeY);
-            break;
-        case NDUInt16:
-            status |= computeArray<epicsUInt16>(maxSizeX, maxSizeY);
-            break;
-        case NDInt32:
-            status |= computeArray<epicsInt32>(maxSizeX, maxSizeY);
-            break;
-        case NDUInt32:
-            status |= computeArray<epicsUInt32>(maxSizeX, maxSizeY);
-            break;
-        case NDInt64:
-            status |= computeArray<epicsInt64>(maxSizeX, maxSizeY);
-            break;
-        case NDUInt64:
-            status |= computeArray<epicsUInt64>(maxSizeX, maxSizeY);
-            break;
-        case NDFloat32:
-            status |= computeArray<epicsFloat32>(maxSizeX, maxSizeY);
-            break;
-        case NDFloat64:
-            status |= computeArray<epicsFloat64>(maxSizeX, maxSizeY);
-            break;
-    }
+/** Keeps the most recent image, or tile, in pArrays[0] for the read() function, and shows its size.
+  * \param[in] pImage The new image; the previous one is released. */
+void simDetector::setCurrentImage(NDArray *pImage)
+{
+    NDArrayInfo_t arrayInfo;
 
-    /* Extract the region of interest with binning.
-     * If the entire image is being used (no ROI or binning) that's OK because
-     * convertImage detects that case and is very efficient */
-    pRaw_->initDimension(&dimsOut[xDim], sizeX);
-    pRaw_->initDimension(&dimsOut[yDim], sizeY);
-    if (ndims > 2) pRaw_->initDimension(&dimsOut[colorDim], 3);
-    dimsOut[xDim].binning = binX;
-    dimsOut[xDim].offset  = minX;
-    dimsOut[xDim].reverse = reverseX;
-    dimsOut[yDim].binning = binY;
-    dimsOut[yDim].offset  = minY;
-    dimsOut[yDim].reverse = reverseY;
-    /* We save the most recent image buffer so it can be used in the read() function.
-     * Now release it before getting a new version. */
     if (this->pArrays[0]) this->pArrays[0]->release();
-    status = this->pNDArrayPool->convert(pRaw_,
-                                         &this->pArrays[0],
-                                         dataType,
-                                         dimsOut);
-    if (status) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: error allocating buffer in convert()\n",
-                    driverName, functionName);
-        return(status);
-    }
-    pImage = this->pArrays[0];
+    this->pArrays[0] = pImage;
     pImage->getInfo(&arrayInfo);
-    status = asynSuccess;
-    status |= setIntegerParam(NDArraySize,  (int)arrayInfo.totalBytes);
-    status |= setIntegerParam(NDArraySizeX, (int)pImage->dims[xDim].size);
-    status |= setIntegerParam(NDArraySizeY, (int)pImage->dims[yDim].size);
-    status |= setIntegerParam(SimResetImage, 0);
-    if (status) asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: error setting parameters\n",
-                    driverName, functionName);
-    return(status);
+    setIntegerParam(NDArraySize,  (int)arrayInfo.totalBytes);
+    setIntegerParam(NDArraySizeX, (int)arrayInfo.xSize);
+    setIntegerParam(NDArraySizeY, (int)arrayInfo.ySize);
+    setCompressionParams(pImage, 0);
 }
 
 static void simTaskC(void *drvPvt)
@@ -707,10 +3563,22 @@ void simDetector::simTask()
     int imageMode;
     int arrayCallbacks;
     int acquire=0;
-    NDArray *pImage;
+    int pacingMode;
+    int burstSize, burstFrame=0;
+    bool lastInBurst, statusUpdate=true;
+    NDArray *pImage, *pTile;
     double acquireTime, acquirePeriod, delay;
+    double spinTime, framePeriod, statusRate;
     epicsTimeStamp startTime, endTime;
+    epicsTimeStamp scheduledTime, deadline;
+    epicsTimeStamp burstStartTime, statusTime;
     double elapsedTime;
+    int affinityEpoch = 0;
+    int triggerMode;
+    bool triggered=false, gateOpened;
+    epicsUInt64 publishTime;
+    simCompression_t compression;
+    epicsTimeStamp triggerTime;
     const char *functionName = "simTask";
 
     this->lock();
@@ -727,16 +3595,68 @@ void simDetector::simTask()
             acquire = 1;
             setStringParam(ADStatusMessage, "Acquiring data");
             setIntegerParam(ADNumImagesCounter, 0);
+            /* The first frame is scheduled now, and each following one a frame period later */
+            epicsTimeGetCurrent(&scheduledTime);
+            resetPacingStats(&scheduledTime);
+            /* The status of the first burst is always shown */
+            burstFrame = 0;
+            statusTime.secPastEpoch = 0;
+            statusTime.nsec = 0;
         }
 
         /* We are acquiring. */
+        applyAffinity(&cpus_[SimAffinityAcquire], affinityEpoch_[SimAffinityAcquire], &affinityEpoch, "acquisition");
+        getIntegerParam(ADImageMode, &imageMode);
+        getIntegerParam(SimBurstSize, &burstSize);
+        if (burstSize < 1) burstSize = 1;
+        if (burstFrame >= burstSize) burstFrame = 0;
+
+        /* Unless the timing is internal, wait for the trigger or the gate which starts the burst */
+        getIntegerParam(ADTriggerMode, &triggerMode);
+        if ((triggerMode != SimTriggerInternal) && (burstFrame == 0)) {
+            if (waitForTrigger(&triggerMode, &triggerTime, &gateOpened)) {
+                acquire = 0;
+                if (imageMode == ADImageContinuous) {
+                    setIntegerParam(ADStatus, ADStatusIdle);
+                } else {
+                    setIntegerParam(ADStatus, ADStatusAborted);
+                }
+                callParamCallbacks();
+                continue;
+            }
+            /* The frames resume when a closed gate opens, rather than catching up */
+            if ((triggerMode == SimTriggerGated) && gateOpened) epicsTimeGetCurrent(&scheduledTime);
+        }
+        /* The frames started by a trigger are time stamped with the time of the trigger */
+        if (burstFrame == 0) {
+            triggered = (triggerMode == SimTriggerExternal) || (triggerMode == SimTriggerSoftware);
+        }
+
         /* Get the current time */
         epicsTimeGetCurrent(&startTime);
-        getIntegerParam(ADImageMode, &imageMode);
 
         /* Get the exposure parameters */
         getDoubleParam(ADAcquireTime, &acquireTime);
         getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+        getIntegerParam(SimPacingMode, &pacingMode);
+        getDoubleParam(SimPacingSpin, &spinTime);
+        framePeriod = (acquirePeriod > acquireTime) ? acquirePeriod : acquireTime;
+        if (pacingMode == SimPacingFreeRun) scheduledTime = startTime;
+        /* A triggered burst is scheduled at the trigger, so the jitter is the latency from the trigger, and its
+         * exposures end acquireTime after the trigger */
+        if (triggered && (burstFrame == 0)) scheduledTime = triggerTime;
+
+        /* The frames of a burst are generated back to back without releasing the lock, and the status is only
+         * updated once per burst, and at most statusRate times per second */
+        getDoubleParam(SimStatusRate, &statusRate);
+        if (burstFrame == 0) {
+            burstStartTime = triggered ? triggerTime : startTime;
+            statusUpdate = (statusRate <= 0.) ||
+                           (epicsTimeDiffInSeconds(&startTime, &statusTime) >= 1./statusRate);
+            if (statusUpdate) statusTime = startTime;
+        }
+        lastInBurst = (burstFrame == burstSize-1);
+        updatePacingStats(&startTime, &scheduledTime, burstFrame == 0);
 
         setIntegerParam(ADStatus, ADStatusAcquire);
 
@@ -744,24 +3664,63 @@ void simDetector::simTask()
         setShutter(ADShutterOpen);
 
         /* Call the callbacks to update any changes */
-        callParamCallbacks();
+        if (statusUpdate && (burstFrame == 0)) callParamCallbacks();
 
-        /* Update the image */
-        status = computeImage();
+        /* Update the image, either from the lookahead ring or by computing it here */
+        if (ringDepth_ > 0) {
+            status = getRingFrame(&pImage);
+        } else if (pArmedImage_) {
+            /* The first frame was computed by arm() */
+            pImage = pArmedImage_;
+            pArmedImage_ = NULL;
+            status = asynSuccess;
+        } else {
+            status = nextImage(&pImage, true);
+        }
         if (status) continue;
 
+        /* Compress the frame without the lock; the render threads compress the frames of the ring,
+         * and the modules their strips of the frames */
+        if (pImage && (ringDepth_ == 0) && (numModules_ <= 1) && !isEncoded(pImage)) {
+            getCompression(&compression);
+            if (encodingEnabled(&compression)) {
+                this->unlock();
+                compressImage(&pImage, &compression);
+                this->lock();
+            }
+        }
+
+        /* We save the most recent image buffer so it can be used in the read() function.
+         * Now release it before saving the new version. */
+        if (pImage && (numModules_ > 1)) {
+            /* The modules publish the strips of the image on their own addresses */
+            if (pModuleImage_) pModuleImage_->release();
+            pModuleImage_ = pImage;
+        } else if (pImage) {
+            setCurrentImage(pImage);
+        }
+
         /* Simulate being busy during the exposure time.  Use epicsEventWaitWithTimeout so that
-         * manually stopping the acquisition will work */
-        epicsTimeGetCurrent(&endTime);
-        elapsedTime = epicsTimeDiffInSeconds(&endTime, &startTime);
-        delay = acquireTime - elapsedTime;
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                  "%s:%s: delay=%f\n",
-                  driverName, functionName, delay);
-        if (delay <= 0.0) delay = MIN_DELAY;
-        this->unlock();
-        status = epicsEventWaitWithTimeout(stopEventId_, delay);
-        this->lock();
+         * manually stopping the acquisition will work.  The exposures of a burst end together with the last one. */
+        if (!lastInBurst) {
+            status = epicsEventTryWait(stopEventId_);
+        } else if (pacingMode == SimPacingSleep) {
+            epicsTimeGetCurrent(&endTime);
+            elapsedTime = epicsTimeDiffInSeconds(&endTime, &burstStartTime);
+            delay = burstSize * acquireTime - elapsedTime;
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                      "%s:%s: delay=%f\n",
+                      driverName, functionName, delay);
+            if (delay <= 0.0) delay = MIN_DELAY;
+            this->unlock();
+            status = epicsEventWaitWithTimeout(stopEventId_, delay);
+            this->lock();
+        } else {
+            /* The exposure ends acquireTime after the scheduled start; free-run only checks for a stop */
+            deadline = (pacingMode == SimPacingDeadline) ? scheduledTime : startTime;
+            if (pacingMode == SimPacingDeadline) epicsTimeAddSeconds(&deadline, acquireTime);
+            status = waitUntil(&deadline, spinTime) ? epicsEventWaitOK : epicsEventWaitTimeout;
+        }
         if (status == epicsEventWaitOK) {
             acquire = 0;
             if (imageMode == ADImageContinuous) {
@@ -775,13 +3734,11 @@ void simDetector::simTask()
         /* Close the shutter */
         setShutter(ADShutterClosed);
         
-        if (!acquire) continue;
+        if (!acquire || !pImage) continue;
 
         setIntegerParam(ADStatus, ADStatusReadout);
         /* Call the callbacks to update any changes */
-        callParamCallbacks();
-
-        pImage = this->pArrays[0];
+        if (statusUpdate && lastInBurst) callParamCallbacks();
 
         /* Get the current parameters */
         getIntegerParam(NDArrayCounter, &imageCounter);
@@ -795,17 +3752,64 @@ void simDetector::simTask()
 
         /* Put the frame number and time stamp into the buffer */
         pImage->uniqueId = imageCounter;
-        pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
-        updateTimeStamp(&pImage->epicsTS);
+        if (triggered && (burstFrame == 0)) {
+            pImage->timeStamp = triggerTime.secPastEpoch + triggerTime.nsec / 1.e9;
+            pImage->epicsTS = triggerTime;
+        } else {
+            pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+            updateTimeStamp(&pImage->epicsTS);
+        }
 
-        /* Get any attributes that have been defined for this driver */
-        this->getAttributes(pImage->pAttributeList);
+        /* A tiled frame is published as its tiles, one after the other, which all have the frame number and
+         * time stamp of the frame; pImage is the first tile */
+        while (1) {
+            /* Get any attributes that have been defined for this driver */
+            timers_[SimTimerAttributes].start();
+            attachAttributes(pImage->pAttributeList);
+            if (triggered) {
+                pImage->pAttributeList->add("TriggerNumber", "Number of the trigger which started the burst",
+                                            NDAttrUInt32, &triggerNumber_);
+            }
+            timers_[SimTimerAttributes].stop();
 
-        if (arrayCallbacks) {
-            /* Call the NDArray callback */
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                      "%s:%s: calling imageData callback\n", driverName, functionName);
-            doCallbacksGenericPointer(pImage, NDArrayData, 0);
+            if (numModules_ > 1) {
+                /* The time is the time taken to hand the image to the modules */
+                timers_[SimTimerCallbacks].start();
+                publishModules(pImage, arrayCallbacks);
+                timers_[SimTimerCallbacks].stop();
+            } else if (arrayCallbacks) {
+                /* Call the NDArray callback */
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                          "%s:%s: calling imageData callback\n", driverName, functionName);
+                if (pImage->pAttributeList->find(SimAttrGenerateStart)) {
+                    publishTime = simMonotonicNs();
+                    pImage->pAttributeList->add(SimAttrPublish, "Time the frame was published (ns)", NDAttrUInt64, &publishTime);
+                }
+                timers_[SimTimerCallbacks].start();
+                doCallbacksGenericPointer(pImage, NDArrayData, 0);
+                timers_[SimTimerCallbacks].stop();
+            }
+
+            /* The last tile of a frame, or a frame which is not tiled, leaves the next tile at 0 */
+            if (pContext_->tileIndex_ == 0) break;
+            pTile = NULL;
+            status = nextImage(&pTile, true);
+            if (status || !pTile) {
+                /* The next frame starts again from its first tile */
+                pContext_->tileIndex_ = 0;
+                break;
+            }
+            getCompression(&compression);
+            if (encodingEnabled(&compression)) {
+                this->unlock();
+                compressImage(&pTile, &compression);
+                this->lock();
+            }
+            pTile->uniqueId = pImage->uniqueId;
+            pTile->timeStamp = pImage->timeStamp;
+            pTile->epicsTS = pImage->epicsTS;
+            pImage = pTile;
+            setCurrentImage(pImage);
         }
 
         /* See if acquisition is done */
@@ -820,25 +3824,64 @@ void simDetector::simTask()
   
             acquire = 0;
             setIntegerParam(ADAcquire, acquire);
+            setRingActive(false);
+            /* Show the rate of the last, incomplete, interval */
+            if (rateFrames_ > 1) {
+                setDoubleParam(SimFrameRate, (rateFrames_ - 1) / epicsTimeDiffInSeconds(&startTime, &rateStartTime_));
+            }
             asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
                       "%s:%s: acquisition completed\n", driverName, functionName);
         }
 
         /* Call the callbacks to update any changes */
-        callParamCallbacks();
+        if (!acquire || (statusUpdate && lastInBurst)) {
+            updateTimingParams();
+            callParamCallbacks();
+        }
+        burstFrame++;
+
+        /* Schedule the next frame.  In deadline mode a frame which is more than a period late restarts the schedule,
+         * otherwise the following frames catch up */
+        if (triggered) {
+            /* The next trigger starts the next burst */
+        } else if (pacingMode == SimPacingDeadline) {
+            epicsTimeAddSeconds(&scheduledTime, framePeriod);
+            epicsTimeGetCurrent(&endTime);
+            elapsedTime = epicsTimeDiffInSeconds(&endTime, &scheduledTime);
+            if (elapsedTime > 0.) lateFrames_++;
+            if (elapsedTime > framePeriod) scheduledTime = endTime;
+        } else if ((pacingMode == SimPacingSleep) && lastInBurst) {
+            scheduledTime = burstStartTime;
+            epicsTimeAddSeconds(&scheduledTime, burstSize * framePeriod);
+        }
 
-        /* If we are acquiring then sleep for the acquire period minus elapsed time. */
-        if (acquire) {
+        /* If we are acquiring then sleep for the acquire period minus elapsed time.  A burst waits for all its periods
+         * after its last frame. */
+        if (!lastInBurst || triggered) {
+            /* The next frame of the burst follows at once, or the next trigger starts the next burst */
+        } else if (acquire && (pacingMode == SimPacingDeadline)) {
+            setIntegerParam(ADStatus, ADStatusWaiting);
+            if (statusUpdate) callParamCallbacks();
+            if (waitUntil(&scheduledTime, spinTime)) {
+                acquire = 0;
+                if (imageMode == ADImageContinuous) {
+                    setIntegerParam(ADStatus, ADStatusIdle);
+                } else {
+                    setIntegerParam(ADStatus, ADStatusAborted);
+                }
+                callParamCallbacks();
+            }
+        } else if (acquire && (pacingMode == SimPacingSleep)) {
             epicsTimeGetCurrent(&endTime);
-            elapsedTime = epicsTimeDiffInSeconds(&endTime, &startTime);
-            delay = acquirePeriod - elapsedTime;
+            elapsedTime = epicsTimeDiffInSeconds(&endTime, &burstStartTime);
+            delay = burstSize * acquirePeriod - elapsedTime;
             asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
                       "%s:%s: delay=%f\n",
                       driverName, functionName, delay);
             if (delay >= 0.0) {
                 /* We set the status to waiting to indicate we are in the period delay */
                 setIntegerParam(ADStatus, ADStatusWaiting);
-                callParamCallbacks();
+                if (statusUpdate) callParamCallbacks();
                 this->unlock();
                 status = epicsEventWaitWithTimeout(stopEventId_, delay);
                 this->lock();
@@ -868,6 +3911,7 @@ asynStatus simDetector::writeInt32(asynUser *pasynUser, epicsInt32 value)
     int adstatus;
     int acquiring;
     int imageMode;
+    int resets;
     asynStatus status = asynSuccess;
 
     /* Ensure that ADStatus is set correctly before we set ADAcquire.*/
@@ -893,6 +3937,8 @@ asynStatus simDetector::writeInt32(asynUser *pasynUser, epicsInt32 value)
     /* Set the parameter and readback in the parameter library.  This may be overwritten when we read back the
      * status at the end, but that's OK */
     status = setIntegerParam(function, value);
+    /* The next frame reads the parameters again; the frame being computed keeps those it has read */
+    frameParamsDirty_ = true;
 
     /* For a real detector this is where the parameter is sent to the hardware */
     if (function == ADAcquire) {
@@ -900,18 +3946,83 @@ asynStatus simDetector::writeInt32(asynUser *pasynUser, epicsInt32 value)
             /* Send an event to wake up the simulation task.
              * It won't actually start generating new images until we release the lock below */
             epicsEventSignal(startEventId_); 
+            setRingActive(true);
+            /* Only the triggers from now on start frames */
+            triggerCount_ = pTrigger_->lastEdge(&softwareTime_);
+            softwareSeen_ = softwareTriggers_;
+            triggersMissed_ = 0;
+            setIntegerParam(SimTriggersMissed, 0);
+            /* The armed frames are used by this acquisition */
+            setIntegerParam(SimArmed, 0);
         }
         if (!value && acquiring) {
             /* This was a command to stop acquisition */
             /* Send the stop event */
             epicsEventSignal(stopEventId_); 
+            epicsEventSignal(triggerEvent_);
+            setRingActive(false);
         }
-    } else if ((function == NDDataType) || 
-               (function == NDColorMode) ||
-               (function == SimMode) ||
-               ((function >= SimPeakStartX) && (function <= SimPeakStepY))) {  // This assumes order in simDetector.h!
-        status = setIntegerParam(SimResetImage, 1);
+    } else if (function == SimNumThreads) {
+        int maxThreads;
+        getIntegerParam(SimMaxThreads, &maxThreads);
+        if (value < 1) value = 1;
+        if (value > maxThreads) value = maxThreads;
+        status = setIntegerParam(SimNumThreads, value);
+    } else if ((function == SimPacingMode) || (function == SimBurstSize) || (function == SimMovieCopy)) {
+        /* Only affects the timing of the frames */
+    } else if (function == SimMovieFrames) {
+        movieValid_ = false;
+        flushRing();
+    } else if ((function == SimCompression) || (function == SimBloscLevel) || (function == SimBloscShuffle) ||
+               (function == SimBloscCompressor) || (function == SimJPEGQuality) ||
+               (function == SimBitDepth) || (function == SimPacking) || (function == SimUnpackTiming)) {
+        /* Frames compressed ahead with the old settings are no longer valid, but the image is */
+        epicsMutexLock(compressionLock_);
+        compressionError_ = 0;
+        epicsMutexUnlock(compressionLock_);
+        flushRing();
+    } else if (function == SimLatencyAttributes) {
+        /* Frames rendered ahead carry the attributes of the old setting, but the image is still valid */
+        flushRing();
+    } else if (function == ADTriggerSoftware) {
+        if (value) {
+            epicsTimeGetCurrent(&softwareTime_);
+            softwareTriggers_++;
+            epicsEventSignal(triggerEvent_);
+        }
+        setIntegerParam(ADTriggerSoftware, 0);
+    } else if (function == SimTriggerFire) {
+        if (value) pTrigger_->fire();
+        setIntegerParam(SimTriggerFire, 0);
+    } else if (function == SimTriggerGate) {
+        pTrigger_->setGate(value != 0);
+    } else if (function == SimArm) {
+        if (value) status = arm();
+        setIntegerParam(SimArm, 0);
+    } else if (function == SimTimingReset) {
+        int i;
+        epicsMutexLock(timerLock_);
+        for (i=0; i<SimNumTimers; i++) timers_[i].reset();
+        epicsMutexUnlock(timerLock_);
+        updateTimingParams();
+    } else if (function == SimIncremental) {
+        /* The ramp in the scratch buffer is not advanced by incremental frames, so compute the next frame from scratch */
+        invalidateWindows();
+    } else if (imageResets(function, &resets)) {
+        /* Only the caches which depend on the parameter are computed again */
+        requestReset(resets);
     } else {
+        /* Frames rendered ahead with the old ROI, tiles, buffers or image are no longer valid */
+        if ((function == SimResetImage) ||
+            (function == ADMinX)  || (function == ADMinY)  ||
+            (function == ADSizeX) || (function == ADSizeY) ||
+            (function == ADBinX)  || (function == ADBinY)  ||
+            (function == ADReverseX) || (function == ADReverseY) ||
+            (function == SimTileRows) || (function == SimZeroCopy)) {
+            flushRing();
+        }
+        /* simTask reads the trigger mode again if it is waiting for a trigger */
+        if (function == ADTriggerMode) epicsEventSignal(triggerEvent_);
         /* If this parameter belongs to a base class call its method */
         if (function < FIRST_SIM_DETECTOR_PARAM) status = ADDriver::writeInt32(pasynUser, value);
     }
@@ -931,6 +4042,50 @@ asynStatus simDetector::writeInt32(asynUser *pasynUser, epicsInt32 value)
 }
 
 
+/** Called when asyn clients call pasynOctet->write().
+  * This function performs actions for some parameters, including SimFileName.
+  * For all parameters it sets the value in the parameter library and calls any registered callbacks.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Address of the string to write.
+  * \param[in] nChars Number of characters to write.
+  * \param[out] nActual Number of characters actually written. */
+asynStatus simDetector::writeOctet(asynUser *pasynUser, const char *value,
+                                   size_t nChars, size_t *nActual)
+{
+    int function = pasynUser->reason;
+    int resets;
+    asynStatus status = asynSuccess;
+
+    if (function == SimFileName) {
+        /* The file is mapped again when the next image is computed, even if the name is unchanged */
+        status = ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+        reopenFile_ = true;
+        imageResets(function, &resets);
+        requestReset(resets);
+        callParamCallbacks();
+    } else if (function == SimTriggerSource) {
+        status = ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+        setTriggerSource(value);
+        callParamCallbacks();
+    } else {
+        /* If this parameter belongs to a base class call its method */
+        status = ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+        /* The attributes file and its macros replace the attributes which the cache refers to */
+        if ((function == NDAttributesFile) || (function == NDAttributesMacros)) releaseAttributeCache();
+    }
+
+    if (status)
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+              "%s:writeOctet error, status=%d function=%d, value=%s\n",
+              driverName, status, function, value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:writeOctet: function=%d, value=%s\n",
+              driverName, function, value);
+    return status;
+}
+
+
 /** Called when asyn clients call pasynFloat64->write().
   * This function performs actions for some parameters, including ADAcquireTime, ADGain, etc.
   * For all parameters it sets the value in the parameter library and calls any registered callbacks..
@@ -939,15 +4094,27 @@ asynStatus simDetector::writeInt32(asynUser *pasynUser, epicsInt32 value)
 asynStatus simDetector::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
 {
     int function = pasynUser->reason;
+    int resets;
     asynStatus status = asynSuccess;
 
     /* Set the parameter and readback in the parameter library.  This may be overwritten when we read back the
      * status at the end, but that's OK */
     status = setDoubleParam(function, value);
+    frameParamsDirty_ = true;
 
-    /* Changing any of the simulation parameters requires recomputing the base image */
-    if ((function == ADGain) || (function >= FIRST_SIM_DETECTOR_PARAM)) {
-        status = setIntegerParam(SimResetImage, 1);
+    /* Changing the simulation parameters recomputes the caches of the image which depend on them */
+    if ((function == SimPacingSpin) || (function == SimStatusRate)) {
+        /* Only affects the timing of the frames and of the status updates */
+    } else if (function == SimTriggerPeriod) {
+        /* The period is that of the trigger source, which may be shared with other detectors */
+        pTrigger_->setPeriod(value);
+        status = setDoubleParam(SimTriggerPeriod, pTrigger_->period());
+    } else if (function == SimMovieMemory) {
+        movieValid_ = false;
+        flushRing();
+    } else if (imageResets(function, &resets)) {
+        /* Only the caches which depend on the parameter are computed again */
+        requestReset(resets);
     } else {
         /* This parameter belongs to a base class call its method */
         status = ADDriver::writeFloat64(pasynUser, value);
@@ -979,11 +4146,69 @@ void simDetector::report(FILE *fp, int details)
     fprintf(fp, "Simulation detector %s\n", this->portName);
     if (details > 0) {
         int nx, ny, dataType;
+        int i;
+        size_t scratchSize;
+        char cpus[256], label[32];
         getIntegerParam(ADSizeX, &nx);
         getIntegerParam(ADSizeY, &ny);
         getIntegerParam(NDDataType, &dataType);
         fprintf(fp, "  NX, NY:            %d  %d\n", nx, ny);
         fprintf(fp, "  Data type:         %d\n", dataType);
+        fprintf(fp, "  Kernels:           %s\n", pContext_->pKernels_->name);
+        scratchSize = pContext_->scratch_.totalSize();
+        for (i=0; i<numRenderThreads_; i++) scratchSize += renderContexts_[i]->scratch_.totalSize();
+        fprintf(fp, "  Scratch memory:    %lu bytes\n", (unsigned long)scratchSize);
+        fprintf(fp, "  Stage times (ms):  %10s %10s %10s %10s\n", "count", "last", "mean", "max");
+        epicsMutexLock(timerLock_);
+        for (i=0; i<SimNumTimers; i++) {
+            fprintf(fp, "    %-16s %10u %10.3f %10.3f %10.3f\n", timerNames[i], timers_[i].count(),
+                    timers_[i].last() * 1e3, timers_[i].mean() * 1e3, timers_[i].max() * 1e3);
+        }
+        epicsMutexUnlock(timerLock_);
+        if (numAttributes_ > 0) {
+            fprintf(fp, "  Attributes:        %d, %d constant, %.3f us each\n", numAttributes_,
+                    numInvariantAttributes_, timers_[SimTimerAttributes].mean() * 1e6 / numAttributes_);
+        }
+        if (ringDepth_ > 0) {
+            epicsMutexLock(ringLock_);
+            fprintf(fp, "  Frame ring:        depth=%d, render threads=%d, frames queued=%d\n",
+                    ringDepth_, numRenderThreads_, ringCount_);
+            epicsMutexUnlock(ringLock_);
+        }
+        if (numModules_ > 1) {
+            fprintf(fp, "  Modules:           %d, on addresses 0 to %d\n", numModules_, numModules_ - 1);
+        }
+        if (pTrigger_) {
+            epicsTimeStamp edgeTime;
+            fprintf(fp, "  Trigger source:    %s, period=%g s, edges=%u, gate=%d, missed=%d\n",
+                    pTrigger_->name(), pTrigger_->period(), pTrigger_->lastEdge(&edgeTime),
+                    pTrigger_->gateOpen(), triggersMissed_);
+        }
+        for (i=0; i<SimNumAffinity; i++) {
+            epicsSnprintf(label, sizeof(label), "CPUs, %s:", affinityNames[i]);
+            cpus_[i].format(cpus, sizeof(cpus));
+            fprintf(fp, "  %-19s%s\n", label, cpus);
+        }
+        for (i=0; (i<numModules_) && modules_; i++) {
+            epicsSnprintf(label, sizeof(label), "CPUs, module%d:", i);
+            modules_[i].cpus.format(cpus, sizeof(cpus));
+            fprintf(fp, "  %-19s%s\n", label, cpus);
+        }
+        if (pFile_) {
+            fprintf(fp, "  File:              %s, frames=%d, next=%d, wrappers=%d\n",
+                    pFile_->fileName(), numFileFrames_, fileFrame_, numFileWrappers_);
+        }
+        if (pGenerator_) {
+            char generator[MAX_FILENAME_LEN];
+            getStringParam(SimGenerator, sizeof(generator), generator);
+            fprintf(fp, "  Generator:         %s, capabilities=0x%x, prepared=%d\n",
+                    generator, pGenerator_->capabilities(), generatorReady_);
+        }
+        if (numMovieFrames_ > 0) {
+            fprintf(fp, "  Movie cache:       frames=%d, next=%d, valid=%d\n",
+                    numMovieFrames_, movieIndex_, movieValid_);
+            if (details > 1) pMoviePool_->report(fp, details);
+        }
     }
     /* Invoke the base class method */
     ADDriver::report(fp, details);
@@ -1002,22 +4227,52 @@ void simDetector::report(FILE *fp, int details)
   *            allowed to allocate. Set this to -1 to allow an unlimited amount of memory.
   * \param[in] priority The thread priority for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
   * \param[in] stackSize The stack size for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
+  * \param[in] ringDepth The number of frames that are rendered ahead of the acquisition task.
+  *            Set this to 0, the default, to compute each frame in the acquisition task.
+  * \param[in] numRenderThreads The number of threads rendering frames into the ring if ringDepth>0; default 1.
+  * \param[in] maxThreads The maximum number of threads used to compute bands of rows of each image in parallel;
+  *            default 1.
+  * \param[in] numModules The number of modules of the detector.  If this is greater than 1 each module publishes
+  *            a strip of rows of each image on NDArray addresses 0 to numModules-1, from its own thread; default 1.
   */
 simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDataType_t dataType,
-                         int maxBuffers, size_t maxMemory, int priority, int stackSize)
+                         int maxBuffers, size_t maxMemory, int priority, int stackSize,
+                         int ringDepth, int numRenderThreads, int maxThreads,
+                         int numModules)
 
-    : ADDriver(portName, 1, 0, maxBuffers, maxMemory,
+    : ADDriver(portName, (numModules > 1) ? numModules : 1, 0, maxBuffers, maxMemory,
                0, 0, /* No interfaces beyond those set in ADDriver.cpp */
-               0, 1, /* ASYN_CANBLOCK=0, ASYN_MULTIDEVICE=0, autoConnect=1 */
+               (numModules > 1) ? ASYN_MULTIDEVICE : 0, 1, /* ASYN_CANBLOCK=0, ASYN_MULTIDEVICE if there are modules, autoConnect=1 */
                priority, stackSize),
-      pRaw_(NULL), xSine1_(0), xSine2_(0), ySine1_(0), ySine2_(0)
+      frameParamsDirty_(true), pendingResets_(0), generating_(false), reopenFile_(false),
+      pContext_(0), renderContexts_(0),
+      pGenerator_(0), generatorReady_(0),
+      pWorkerPool_(0),
+      rateFrames_(0), jitterSumSquares_(0.), jitterMax_(0.), jitterCount_(0), lateFrames_(0),
+      pMoviePool_(0), movieFrames_(0), numMovieFrames_(0), movieIndex_(0), movieValid_(false),
+      pFile_(0), fileOffset_(0), numFileFrames_(0), fileFrame_(0), pFilePool_(0), fileWrappers_(0), numFileWrappers_(0),
+      ringDepth_(ringDepth), numRenderThreads_(0), frameRing_(0),
+      ringHead_(0), ringCount_(0), ringPending_(0), ringActive_(false), ringFailed_(0), ringEpoch_(0), pArmedImage_(0),
+      pTrigger_(0), triggerCount_(0), softwareTriggers_(0), softwareSeen_(0), triggerNumber_(0), triggersMissed_(0),
+      numModules_((numModules > 1) ? numModules : 1), modules_(0), pModuleImage_(0),
+      attributes_(0), numAttributes_(0), numInvariantAttributes_(0), attributesValid_(false),
+      compressionError_(0)
 
 {
     int status = asynSuccess;
     char versionString[20];
+    int i;
     const char *functionName = "simDetector";
 
+    for (i=0; i<SimNumAffinity; i++) affinityEpoch_[i] = 0;
+    memset(&frameParams_, 0, sizeof(frameParams_));
+    memset(&sequence_, 0, sizeof(sequence_));
+    memset(&generatorFrame_, 0, sizeof(generatorFrame_));
+    pContext_ = new simRenderContext(this);
+
     /* Create the epicsEvents for signaling to the simulate task when acquisition starts and stops */
+    timerLock_ = epicsMutexMustCreate();
+    compressionLock_ = epicsMutexMustCreate();
     startEventId_ = epicsEventCreate(epicsEventEmpty);
     if (!startEventId_) {
         printf("%s:%s epicsEventCreate failure for start event\n",
@@ -1030,6 +4285,18 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
             driverName, functionName);
         return;
     }
+    triggerEvent_ = epicsEventCreate(epicsEventEmpty);
+    if (!triggerEvent_) {
+        printf("%s:%s epicsEventCreate failure for trigger event\n",
+            driverName, functionName);
+        return;
+    }
+    generateEvent_ = epicsEventCreate(epicsEventEmpty);
+    if (!generateEvent_) {
+        printf("%s:%s epicsEventCreate failure for generate event\n",
+            driverName, functionName);
+        return;
+    }
 
     createParam(SimGainXString,               asynParamFloat64, &SimGainX);
     createParam(SimGainYString,               asynParamFloat64, &SimGainY);
@@ -1049,6 +4316,9 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
     createParam(SimPeakStepXString,           asynParamInt32,   &SimPeakStepX);
     createParam(SimPeakStepYString,           asynParamInt32,   &SimPeakStepY);
     createParam(SimPeakHeightVariationString, asynParamFloat64, &SimPeakHeightVariation);
+    createParam(SimPeakShiftXString,          asynParamFloat64, &SimPeakShiftX);
+    createParam(SimPeakShiftYString,          asynParamFloat64, &SimPeakShiftY);
+    createParam(SimPeakGainBucketsString,     asynParamInt32,   &SimPeakGainBuckets);
     createParam(SimXSineOperationString,      asynParamInt32,   &SimXSineOperation);
     createParam(SimYSineOperationString,      asynParamInt32,   &SimYSineOperation);
     createParam(SimXSine1AmplitudeString,     asynParamFloat64, &SimXSine1Amplitude);
@@ -1063,6 +4333,77 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
     createParam(SimYSine2AmplitudeString,     asynParamFloat64, &SimYSine2Amplitude);
     createParam(SimYSine2FrequencyString,     asynParamFloat64, &SimYSine2Frequency);
     createParam(SimYSine2PhaseString,         asynParamFloat64, &SimYSine2Phase);
+    createParam(SimMaxThreadsString,          asynParamInt32,   &SimMaxThreads);
+    createParam(SimNumThreadsString,          asynParamInt32,   &SimNumThreads);
+    createParam(SimVectorizeString,           asynParamInt32,   &SimVectorize);
+    createParam(SimVectorISAString,           asynParamOctet,   &SimVectorISA);
+    createParam(SimNoiseSeedString,           asynParamInt32,   &SimNoiseSeed);
+    createParam(SimNoiseModelString,          asynParamInt32,   &SimNoiseModel);
+    createParam(SimNoiseGaussianString,       asynParamFloat64, &SimNoiseGaussian);
+    createParam(SimNoiseShotString,           asynParamFloat64, &SimNoiseShot);
+    createParam(SimNoiseReadString,           asynParamFloat64, &SimNoiseRead);
+    createParam(SimZeroCopyString,            asynParamInt32,   &SimZeroCopy);
+    createParam(SimRoiRenderString,           asynParamInt32,   &SimRoiRender);
+    createParam(SimIncrementalString,         asynParamInt32,   &SimIncremental);
+    createParam(SimFrameClassString,          asynParamInt32,   &SimFrameClass);
+    createParam(SimTimingResetString,         asynParamInt32,   &SimTimingReset);
+    createParam(SimPacingModeString,          asynParamInt32,   &SimPacingMode);
+    createParam(SimPacingSpinString,          asynParamFloat64, &SimPacingSpin);
+    createParam(SimBurstSizeString,           asynParamInt32,   &SimBurstSize);
+    createParam(SimStatusRateString,          asynParamFloat64, &SimStatusRate);
+    createParam(SimMovieFramesString,         asynParamInt32,   &SimMovieFrames);
+    createParam(SimMovieMemoryString,         asynParamFloat64, &SimMovieMemory);
+    createParam(SimMovieCopyString,           asynParamInt32,   &SimMovieCopy);
+    createParam(SimMovieFillString,           asynParamInt32,   &SimMovieFill);
+    createParam(SimMovieMemoryUsedString,     asynParamFloat64, &SimMovieMemoryUsed);
+    createParam(SimFileNameString,            asynParamOctet,   &SimFileName);
+    createParam(SimFileOffsetString,          asynParamInt32,   &SimFileOffset);
+    createParam(SimFilePrefetchString,        asynParamInt32,   &SimFilePrefetch);
+    createParam(SimFileZeroCopyString,        asynParamInt32,   &SimFileZeroCopy);
+    createParam(SimFileFramesString,          asynParamInt32,   &SimFileFrames);
+    createParam(SimFileFrameString,           asynParamInt32,   &SimFileFrame);
+    createParam(SimNumModulesString,          asynParamInt32,   &SimNumModules);
+    createParam(SimArmString,                 asynParamInt32,   &SimArm);
+    createParam(SimArmedString,               asynParamInt32,   &SimArmed);
+    createParam(SimArmBuffersString,          asynParamInt32,   &SimArmBuffers);
+    createParam(SimArmTimeString,             asynParamFloat64, &SimArmTime);
+    createParam(SimTriggerSourceString,       asynParamOctet,   &SimTriggerSource);
+    createParam(SimTriggerPeriodString,       asynParamFloat64, &SimTriggerPeriod);
+    createParam(SimTriggerFireString,         asynParamInt32,   &SimTriggerFire);
+    createParam(SimTriggerGateString,         asynParamInt32,   &SimTriggerGate);
+    createParam(SimTriggerNumberString,       asynParamInt32,   &SimTriggerNumber);
+    createParam(SimTriggersMissedString,      asynParamInt32,   &SimTriggersMissed);
+    createParam(SimLatencyAttributesString,   asynParamInt32,   &SimLatencyAttributes);
+    createParam(SimNumAttributesString,       asynParamInt32,   &SimNumAttributes);
+    createParam(SimAttributeCostString,       asynParamFloat64, &SimAttributeCost);
+    createParam(SimCompressionString,         asynParamInt32,   &SimCompression);
+    createParam(SimBloscLevelString,          asynParamInt32,   &SimBloscLevel);
+    createParam(SimBloscShuffleString,        asynParamInt32,   &SimBloscShuffle);
+    createParam(SimBloscCompressorString,     asynParamInt32,   &SimBloscCompressor);
+    createParam(SimJPEGQualityString,         asynParamInt32,   &SimJPEGQuality);
+    createParam(SimCompressionRatioString,    asynParamFloat64, &SimCompressionRatio);
+    createParam(SimBitDepthString,            asynParamInt32,   &SimBitDepth);
+    createParam(SimPackingString,             asynParamInt32,   &SimPacking);
+    createParam(SimUnpackTimingString,        asynParamInt32,   &SimUnpackTiming);
+    createParam(SimTileRowsString,            asynParamInt32,   &SimTileRows);
+    createParam(SimNumTilesString,            asynParamInt32,   &SimNumTiles);
+    createParam(SimGeneratorString,           asynParamOctet,   &SimGenerator);
+    createParam(SimFrameRateString,           asynParamFloat64, &SimFrameRate);
+    createParam(SimJitterLastString,          asynParamFloat64, &SimJitterLast);
+    createParam(SimJitterRMSString,           asynParamFloat64, &SimJitterRMS);
+    createParam(SimJitterMaxString,           asynParamFloat64, &SimJitterMax);
+    createParam(SimLateFramesString,          asynParamInt32,   &SimLateFrames);
+    for (i=0; i<SimNumTimers; i++) {
+        char paramName[64];
+        epicsSnprintf(paramName, sizeof(paramName), SimTimeLastString, timerNames[i]);
+        createParam(paramName, asynParamFloat64, &SimTimeLast[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimTimeMeanString, timerNames[i]);
+        createParam(paramName, asynParamFloat64, &SimTimeMean[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimTimeMaxString, timerNames[i]);
+        createParam(paramName, asynParamFloat64, &SimTimeMax[i]);
+        epicsSnprintf(paramName, sizeof(paramName), SimTimeHistogramString, timerNames[i]);
+        createParam(paramName, asynParamInt32Array, &SimTimeHistogram[i]);
+    }
 
     /* Set some default values for parameters */
     status =  setStringParam (ADManufacturer, "Simulated detector");
@@ -1088,6 +4429,36 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
     status |= setIntegerParam(NDArraySizeY, maxSizeY);
     status |= setIntegerParam(NDArraySize, 0);
     status |= setIntegerParam(NDDataType, dataType);
+    status |= setIntegerParam(SimNumModules, numModules_);
+    status |= setIntegerParam(SimArm, 0);
+    status |= setIntegerParam(SimArmed, 0);
+    status |= setIntegerParam(SimArmBuffers, 2);
+    status |= setDoubleParam (SimArmTime, 0.);
+    status |= setStringParam (SimTriggerSource, "");
+    status |= setIntegerParam(SimTriggerFire, 0);
+    status |= setIntegerParam(SimTriggerNumber, 0);
+    status |= setIntegerParam(SimTriggersMissed, 0);
+    status |= setIntegerParam(SimLatencyAttributes, 0);
+    status |= setIntegerParam(SimNumAttributes, 0);
+    status |= setDoubleParam(SimAttributeCost, 0.);
+    status |= setIntegerParam(SimCompression, SimCompressionNone);
+    status |= setIntegerParam(SimBloscLevel, 5);
+    status |= setIntegerParam(SimBloscShuffle, 1);
+    status |= setIntegerParam(SimBloscCompressor, NDCODEC_BLOSC_BLOSCLZ);
+    status |= setIntegerParam(SimJPEGQuality, 90);
+    status |= setDoubleParam(SimCompressionRatio, 1.);
+    status |= setIntegerParam(SimBitDepth, 0);
+    status |= setIntegerParam(SimPacking, SimPackingContainer);
+    status |= setIntegerParam(SimUnpackTiming, 0);
+    status |= setIntegerParam(SimTileRows, 0);
+    status |= setIntegerParam(SimNumTiles, 1);
+    status |= setStringParam(SimGenerator, "");
+    setTriggerSource("");
+    for (i=1; i<numModules_; i++) {
+        status |= setIntegerParam(i, NDArraySizeX, maxSizeX);
+        status |= setIntegerParam(i, NDArraySizeY, maxSizeY * (i + 1) / numModules_ - maxSizeY * i / numModules_);
+        status |= setIntegerParam(i, NDArraySize, 0);
+    }
     status |= setIntegerParam(ADImageMode, ADImageContinuous);
     status |= setDoubleParam (ADAcquireTime, .001);
     status |= setDoubleParam (ADAcquirePeriod, .005);
@@ -1107,12 +4478,129 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
     status |= setIntegerParam(SimPeakNumY, 1);
     status |= setIntegerParam(SimPeakStepX, 1);
     status |= setIntegerParam(SimPeakStepY, 1);
+    status |= setDoubleParam (SimPeakShiftX, 0.0);
+    status |= setDoubleParam (SimPeakShiftY, 0.0);
+    status |= setIntegerParam(SimPeakGainBuckets, 0);
+    if (maxThreads < 1) maxThreads = 1;
+    status |= setIntegerParam(SimMaxThreads, maxThreads);
+    status |= setIntegerParam(SimNumThreads, 1);
+    status |= setIntegerParam(SimVectorize, 1);
+    status |= setStringParam (SimVectorISA, simGetBestKernels()->name);
+    status |= setIntegerParam(SimNoiseSeed, 0);
+    status |= setIntegerParam(SimNoiseModel, SimNoiseModelBackground);
+    status |= setDoubleParam (SimNoiseGaussian, 0.);
+    status |= setDoubleParam (SimNoiseShot, 0.);
+    status |= setDoubleParam (SimNoiseRead, 0.);
+    status |= setIntegerParam(SimZeroCopy, 1);
+    status |= setIntegerParam(SimRoiRender, 1);
+    status |= setIntegerParam(SimIncremental, 1);
+    status |= setIntegerParam(SimFrameClass, SimFrameDynamic);
+    status |= setIntegerParam(SimTimingReset, 0);
+    status |= setIntegerParam(SimPacingMode, SimPacingSleep);
+    status |= setDoubleParam (SimPacingSpin, 0.);
+    status |= setIntegerParam(SimBurstSize, 1);
+    status |= setDoubleParam (SimStatusRate, 0.);
+    status |= setIntegerParam(SimMovieFrames, 0);
+    status |= setDoubleParam (SimMovieMemory, 256.);
+    status |= setIntegerParam(SimMovieCopy, 0);
+    status |= setIntegerParam(SimMovieFill, 0);
+    status |= setDoubleParam (SimMovieMemoryUsed, 0.);
+    status |= setStringParam (SimFileName, "");
+    status |= setIntegerParam(SimFileOffset, 0);
+    status |= setIntegerParam(SimFilePrefetch, 4);
+    status |= setIntegerParam(SimFileZeroCopy, 0);
+    status |= setIntegerParam(SimFileFrames, 0);
+    status |= setIntegerParam(SimFileFrame, 0);
+    status |= setDoubleParam (SimFrameRate, 0.);
+    status |= setDoubleParam (SimJitterLast, 0.);
+    status |= setDoubleParam (SimJitterRMS, 0.);
+    status |= setDoubleParam (SimJitterMax, 0.);
+    status |= setIntegerParam(SimLateFrames, 0);
+    for (i=0; i<SimNumTimers; i++) {
+        status |= setDoubleParam(SimTimeLast[i], 0.);
+        status |= setDoubleParam(SimTimeMean[i], 0.);
+        status |= setDoubleParam(SimTimeMax[i],  0.);
+    }
 
     if (status) {
         printf("%s: unable to set camera parameters\n", functionName);
         return;
     }
 
+    /* Create the worker threads that compute bands of rows in parallel */
+    if (maxThreads > 1) {
+        pWorkerPool_ = new simWorkerPool("SimDetWorker", maxThreads);
+    }
+
+    /* The movie cache has its own pool; its size is limited by SimMovieMemory rather than by the pool */
+    pMoviePool_ = new NDArrayPool(this, 0);
+    /* The NDArrays which wrap the frames of a file have their own pool, which never allocates their data */
+    pFilePool_ = new NDArrayPool(this, 0);
+
+    /* Create the lookahead ring and the threads that render into it */
+    if (ringDepth_ > 0) {
+        char threadName[32];
+        int i;
+        /* Each render thread computes its frames in its own context */
+        numRenderThreads_ = (numRenderThreads > 1) ? numRenderThreads : 1;
+        renderContexts_ = new simRenderContext *[numRenderThreads_];
+        for (i=0; i<numRenderThreads_; i++) renderContexts_[i] = new simRenderContext(this);
+        frameRing_ = (NDArray **)calloc(ringDepth_, sizeof(NDArray *));
+        ringFailed_ = (bool *)calloc(ringDepth_, sizeof(bool));
+        ringLock_ = epicsMutexCreate();
+        ringFrameEvent_ = epicsEventCreate(epicsEventEmpty);
+        ringSpaceEvent_ = epicsEventCreate(epicsEventEmpty);
+        if (!frameRing_ || !ringFailed_ || !ringLock_ || !ringFrameEvent_ || !ringSpaceEvent_) {
+            printf("%s:%s unable to create frame ring\n",
+                driverName, functionName);
+            return;
+        }
+        for (i=0; i<numRenderThreads_; i++) {
+            epicsSnprintf(threadName, sizeof(threadName), "SimDetRender%d", i);
+            status = (epicsThreadCreate(threadName,
+                                        epicsThreadPriorityMedium,
+                                        epicsThreadGetStackSize(epicsThreadStackMedium),
+                                        (EPICSTHREADFUNC)renderTaskC,
+                                        renderContexts_[i]) == NULL);
+            if (status) {
+                printf("%s:%s epicsThreadCreate failure for render task\n",
+                    driverName, functionName);
+                return;
+            }
+        }
+    }
+
+    /* Create the modules and their threads */
+    if (numModules_ > 1) {
+        char threadName[32];
+        modules_ = new simModule_t[numModules_];
+        for (i=0; i<numModules_; i++) {
+            modules_[i].pDetector = this;
+            modules_[i].address = i;
+            modules_[i].pImage = NULL;
+            modules_[i].arrayCallbacks = 0;
+            modules_[i].affinityEpoch = 0;
+            modules_[i].frameEvent = epicsEventCreate(epicsEventEmpty);
+            modules_[i].idleEvent = epicsEventCreate(epicsEventFull);
+            if (!modules_[i].frameEvent || !modules_[i].idleEvent) {
+                printf("%s:%s epicsEventCreate failure for module %d\n",
+                    driverName, functionName, i);
+                return;
+            }
+            epicsSnprintf(threadName, sizeof(threadName), "SimDetModule%d", i);
+            status = (epicsThreadCreate(threadName,
+                                        epicsThreadPriorityMedium,
+                                        epicsThreadGetStackSize(epicsThreadStackMedium),
+                                        (EPICSTHREADFUNC)moduleTaskC,
+                                        &modules_[i]) == NULL);
+            if (status) {
+                printf("%s:%s epicsThreadCreate failure for module task\n",
+                    driverName, functionName);
+                return;
+            }
+        }
+    }
+
     /* Create the thread that updates the images */
     status = (epicsThreadCreate("SimDetTask",
                                 epicsThreadPriorityMedium,
@@ -1126,26 +4614,47 @@ simDetector::simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDat
     }
 }
 
-/** Configuration command, called directly or from iocsh */
-extern "C" int simDetectorConfig(const char *portName, int maxSizeX, int maxSizeY, int dataType,
-                                 int maxBuffers, int maxMemory, int priority, int stackSize)
+/** Creates a simDetector for simDetectorConfig and for its iocsh command, which accepts a 64-bit maxMemory */
+static int createSimDetector(const char *portName, int maxSizeX, int maxSizeY, int dataType,
+                             int maxBuffers, size_t maxMemory, int priority, int stackSize,
+                             int ringDepth, int numRenderThreads, int maxThreads,
+                             int numModules)
 {
     new simDetector(portName, maxSizeX, maxSizeY, (NDDataType_t)dataType,
                     (maxBuffers < 0) ? 0 : maxBuffers,
-                    (maxMemory < 0) ? 0 : maxMemory, 
-                    priority, stackSize);
+                    maxMemory,
+                    priority, stackSize,
+                    (ringDepth < 0) ? 0 : ringDepth,
+                    numRenderThreads, maxThreads, numModules);
     return(asynSuccess);
 }
 
+/** Configuration command, called directly or from iocsh.
+  * maxMemory is an int, as in previous releases, so that it can be called from the vxWorks shell;
+  * the iocsh command also accepts limits of more than 2 GB. */
+extern "C" int simDetectorConfig(const char *portName, int maxSizeX, int maxSizeY, int dataType,
+                                 int maxBuffers, int maxMemory, int priority, int stackSize,
+                                 int ringDepth, int numRenderThreads, int maxThreads,
+                                 int numModules)
+{
+    return(createSimDetector(portName, maxSizeX, maxSizeY, dataType, maxBuffers,
+                             (maxMemory < 0) ? 0 : (size_t)maxMemory, priority, stackSize,
+                             ringDepth, numRenderThreads, maxThreads, numModules));
+}
+
 /** Code for iocsh registration */
 static const iocshArg simDetectorConfigArg0 = {"Port name", iocshArgString};
 static const iocshArg simDetectorConfigArg1 = {"Max X size", iocshArgInt};
 static const iocshArg simDetectorConfigArg2 = {"Max Y size", iocshArgInt};
 static const iocshArg simDetectorConfigArg3 = {"Data type", iocshArgInt};
 static const iocshArg simDetectorConfigArg4 = {"maxBuffers", iocshArgInt};
-static const iocshArg simDetectorConfigArg5 = {"maxMemory", iocshArgInt};
+static const iocshArg simDetectorConfigArg5 = {"maxMemory", iocshArgDouble};
 static const iocshArg simDetectorConfigArg6 = {"priority", iocshArgInt};
 static const iocshArg simDetectorConfigArg7 = {"stackSize", iocshArgInt};
+static const iocshArg simDetectorConfigArg8 = {"ringDepth", iocshArgInt};
+static const iocshArg simDetectorConfigArg9 = {"numRenderThreads", iocshArgInt};
+static const iocshArg simDetectorConfigArg10 = {"maxThreads", iocshArgInt};
+static const iocshArg simDetectorConfigArg11 = {"numModules", iocshArgInt};
 static const iocshArg * const simDetectorConfigArgs[] =  {&simDetectorConfigArg0,
                                                           &simDetectorConfigArg1,
                                                           &simDetectorConfigArg2,
@@ -1153,12 +4662,72 @@ static const iocshArg * const simDetectorConfigArgs[] =  {&simDetectorConfigArg0
                                                           &simDetectorConfigArg4,
                                                           &simDetectorConfigArg5,
                                                           &simDetectorConfigArg6,
-                                                          &simDetectorConfigArg7};
-static const iocshFuncDef configsimDetector = {"simDetectorConfig", 8, simDetectorConfigArgs};
+                                                          &simDetectorConfigArg7,
+                                                          &simDetectorConfigArg8,
+                                                          &simDetectorConfigArg9,
+                                                          &simDetectorConfigArg10,
+                                                          &simDetectorConfigArg11};
+static const iocshFuncDef configsimDetector = {"simDetectorConfig", 12, simDetectorConfigArgs};
 static void configsimDetectorCallFunc(const iocshArgBuf *args)
 {
-    simDetectorConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival,
-                      args[4].ival, args[5].ival, args[6].ival, args[7].ival);
+    /* maxMemory is parsed as a double, so that limits of more than 2 GB can be given */
+    createSimDetector(args[0].sval, args[1].ival, args[2].ival, args[3].ival,
+                      args[4].ival, (args[5].dval < 0) ? 0 : (size_t)args[5].dval, args[6].ival, args[7].ival,
+                      args[8].ival, args[9].ival, args[10].ival, args[11].ival);
+}
+
+/** Sets the CPUs which threads of a simDetector run on, called directly or from iocsh.
+  * \param[in] portName The name of the simDetector port.
+  * \param[in] threads "acquire", "workers", "render", "modules", "moduleN" for module N, or "all".
+  * \param[in] cpus A list of CPU numbers and ranges, for example "0-3,8", or "all". */
+extern "C" int simDetectorConfigAffinity(const char *portName, const char *threads, const char *cpus)
+{
+    simDetector *pDetector = dynamic_cast<simDetector *>((asynPortDriver *)findAsynPortDriver(portName));
+
+    if (!pDetector) {
+        printf("simDetectorConfigAffinity: %s is not a simDetector port\n", portName ? portName : "");
+        return(asynError);
+    }
+    return(pDetector->setAffinity(threads, cpus));
+}
+
+static const iocshArg simDetectorConfigAffinityArg0 = {"Port name", iocshArgString};
+static const iocshArg simDetectorConfigAffinityArg1 = {"threads", iocshArgString};
+static const iocshArg simDetectorConfigAffinityArg2 = {"cpus", iocshArgString};
+static const iocshArg * const simDetectorConfigAffinityArgs[] =  {&simDetectorConfigAffinityArg0,
+                                                                  &simDetectorConfigAffinityArg1,
+                                                                  &simDetectorConfigAffinityArg2};
+static const iocshFuncDef configsimDetectorAffinity = {"simDetectorConfigAffinity", 3, simDetectorConfigAffinityArgs};
+static void configsimDetectorAffinityCallFunc(const iocshArgBuf *args)
+{
+    simDetectorConfigAffinity(args[0].sval, args[1].sval, args[2].sval);
+}
+
+/** Sets the generator of the images of a simDetector in SimModeGenerator, called directly or from iocsh.
+  * \param[in] portName The name of the simDetector port.
+  * \param[in] generator The name of the generator, "rings" or one registered with simRegisterGenerator().
+  * \param[in] args The arguments of the generator. */
+extern "C" int simDetectorConfigGenerator(const char *portName, const char *generator, const char *args)
+{
+    simDetector *pDetector = dynamic_cast<simDetector *>((asynPortDriver *)findAsynPortDriver(portName));
+
+    if (!pDetector) {
+        printf("simDetectorConfigGenerator: %s is not a simDetector port\n", portName ? portName : "");
+        return(asynError);
+    }
+    return(pDetector->setGenerator(generator, args));
+}
+
+static const iocshArg simDetectorConfigGeneratorArg0 = {"Port name", iocshArgString};
+static const iocshArg simDetectorConfigGeneratorArg1 = {"generator", iocshArgString};
+static const iocshArg simDetectorConfigGeneratorArg2 = {"arguments", iocshArgString};
+static const iocshArg * const simDetectorConfigGeneratorArgs[] =  {&simDetectorConfigGeneratorArg0,
+                                                                   &simDetectorConfigGeneratorArg1,
+                                                                   &simDetectorConfigGeneratorArg2};
+static const iocshFuncDef configsimDetectorGenerator = {"simDetectorConfigGenerator", 3, simDetectorConfigGeneratorArgs};
+static void configsimDetectorGeneratorCallFunc(const iocshArgBuf *args)
+{
+    simDetectorConfigGenerator(args[0].sval, args[1].sval, args[2].sval);
 }
 
 
@@ -1166,6 +4735,8 @@ static void simDetectorRegister(void)
 {
 
     iocshRegister(&configsimDetector, configsimDetectorCallFunc);
+    iocshRegister(&configsimDetectorAffinity, configsimDetectorAffinityCallFunc);
+    iocshRegister(&configsimDetectorGenerator, configsimDetectorGeneratorCallFunc);
 }
 
 extern "C" {
@@ -1,23 +1,259 @@
 #include <epicsEvent.h>
+#include <epicsMutex.h>
 #include "ADDriver.h"
+#include "simWorkerPool.h"
+#include "simKernels.h"
+#include "simRandom.h"
+#include "simTiming.h"
+#include "simFileSource.h"
+#include "simScratch.h"
+#include "simAffinity.h"
+#include "simTrigger.h"
+#include "simPacking.h"
+#include "simGenerator.h"
 
 #define DRIVER_VERSION      2
 #define DRIVER_REVISION     9
 #define DRIVER_MODIFICATION 0
 
+/** Stages of the frame pipeline which are timed */
+typedef enum {
+    SimTimerGenerate,          /**< Computing the raw image */
+    SimTimerConvert,           /**< Extracting the region of interest */
+    SimTimerEncode,            /**< Packing and compressing the frame */
+    SimTimerAttributes,        /**< Getting the attributes */
+    SimTimerCallbacks,         /**< Calling the plugins */
+    SimTimerUnpack,            /**< Unpacking the packed frame, when SimUnpackTiming is enabled */
+    SimNumTimers
+} SimTimer_t;
+
+/** Scratch buffers of the driver */
+typedef enum {
+    SimScratchBackground,      /**< The background with offset and noise */
+    SimScratchRamp,            /**< The linear ramp, when it is added to a background or noise */
+    SimScratchPeak,            /**< One peak */
+    SimScratchPeakProfileX,    /**< The profile of a peak along X */
+    SimScratchPeakProfileY,    /**< The profile of a peak along Y */
+    SimScratchPeakTiles,       /**< The peak scaled by each gain variation bucket and color gain */
+    SimScratchPeakTileValid,   /**< Flags for the tiles which have been computed */
+    SimScratchPeakBuckets,     /**< The gain variation bucket of each peak */
+    SimScratchSineX1,          /**< The first sine wave along X */
+    SimScratchSineX2,          /**< The second sine wave along X */
+    SimScratchSineY1,          /**< The first sine wave along Y */
+    SimScratchSineY2,          /**< The second sine wave along Y */
+    SimScratchSineRed,         /**< The first sine wave along X scaled by the gain and red gain */
+    SimScratchGenerator,       /**< A row of the values of the generator for each task */
+    SimNumScratch
+} SimScratch_t;
+
+/** Caches of the images which are invalidated by the parameters, as a mask of the resets of the next frame.
+  * Each parameter only invalidates the caches which depend on it in the current simulation mode. */
+typedef enum {
+    SimResetFrame      = 0x01, /**< The frame is computed in full rather than from the previous one */
+    SimResetBuffers    = 0x02, /**< The raw buffer, for a new size, data type or color mode */
+    SimResetBackground = 0x04, /**< The background and per-frame noise; the random values start again */
+    SimResetRamp       = 0x08, /**< The linear ramp starts again */
+    SimResetPeaks      = 0x10, /**< The peak and the peaks scaled by each gain variation bucket */
+    SimResetSine       = 0x20, /**< The sine waves start again */
+    SimResetFile       = 0x40, /**< The file replayed in SimModeFile is mapped again */
+    SimResetGenerator  = 0x80, /**< The generator of SimModeGenerator is prepared again */
+    SimResetAll        = 0xff  /**< Everything, as when SimResetImage is written */
+} SimReset_t;
+
+/** Threads of the driver whose CPUs can be set with simDetectorConfigAffinity */
+typedef enum {
+    SimAffinityAcquire,        /**< SimDetTask, which computes and publishes the frames */
+    SimAffinityWorkers,        /**< The worker threads computing bands of rows */
+    SimAffinityRender,         /**< The render threads filling the lookahead ring */
+    SimAffinityModules,        /**< The module threads, by default */
+    SimNumAffinity
+} SimAffinity_t;
+
+/** Region of the raw image which is computed for a frame, in pixels */
+typedef struct {
+    int minX;
+    int minY;
+    int sizeX;
+    int sizeY;
+} simWindow_t;
+
+/** Names of the NDAttributes of the tiles of a frame which is published as strips of rows */
+#define SimAttrTileIndex      "SimTileIndex"
+#define SimAttrNumTiles       "SimNumTiles"
+#define SimAttrTileOffsetY    "SimTileOffsetY"
+#define SimAttrTileSizeY      "SimTileSizeY"
+#define SimAttrFrameSizeY     "SimFrameSizeY"
+
+/** NDArray which wraps a frame of a mapped file, and the file it belongs to */
+typedef struct {
+    NDArray *pArray;
+    simFileSource *pSource;
+} simFileWrapper_t;
+
+/** Settings of the packing and compression of the frames, read with the lock held so that the frames can be
+  * encoded without it */
+typedef struct {
+    int bitDepth;              /**< Bits of each element, or 0 for the full depth of the data type */
+    int packing;               /**< SimPacking_t */
+    int unpackTiming;          /**< Whether the packed frames are unpacked to time it */
+    int compression;           /**< SimCompression_t */
+    int bloscLevel;
+    int bloscShuffle;
+    int bloscCompressor;
+    int jpegQuality;
+    int numThreads;            /**< Threads used by Blosc to compress each frame */
+} simCompression_t;
+
+/** Parameters of the image generation, read from the parameter library with the lock held at the start of a
+  * frame, and only when a write has changed them, so that the frame can be computed without the lock */
+typedef struct {
+    int binX, binY, minX, minY, sizeX, sizeY, reverseX, reverseY;  /**< ROI, clipped to the maximum size */
+    int maxSizeX, maxSizeY;
+    int colorMode;
+    NDDataType_t dataType;
+    int resetImage;            /**< Mask of the SimReset_t caches which the next frame recomputes; cleared when it has */
+    int simMode;
+    int numThreads;
+    int vectorize;
+    int zeroCopy;
+    int roiRender;
+    int fileZeroCopy;
+    int filePrefetch;
+    int tileRows;
+    int movieFrames;
+    int movieCopy;
+    double movieMemory;
+    int latencyAttributes;
+    int incremental;
+    double gain, gainX, gainY, gainRed, gainGreen, gainBlue;
+    double offset, noise;
+    int noiseSeed, noiseModel;
+    double noiseGaussian, noiseShot, noiseRead;
+    int peakStartX, peakStartY, peakStepX, peakStepY;
+    int peakNumX, peakNumY, peakWidthX, peakWidthY;
+    double peakVariation, peakShiftX, peakShiftY;
+    int peakGainBuckets;
+    int xSineOperation, ySineOperation;
+    double xSine1Amplitude, xSine1Frequency, xSine1Phase;
+    double xSine2Amplitude, xSine2Frequency, xSine2Phase;
+    double ySine1Amplitude, ySine1Frequency, ySine1Phase;
+    double ySine2Amplitude, ySine2Frequency, ySine2Phase;
+} simFrameParams_t;
+
+class simDetector;
+
+/** One module of a detector which is made of several modules.  Each module publishes a strip of rows
+  * of the image on its own NDArray address, from its own thread. */
+typedef struct {
+    simDetector *pDetector;
+    int address;
+    NDArray *pImage;           /**< The image to take the strip from, or NULL when the module is idle */
+    int arrayCallbacks;
+    simCompression_t compression;  /**< How the strip of pImage is compressed */
+    epicsEventId frameEvent;   /**< Signalled when pImage has been set */
+    epicsEventId idleEvent;    /**< Signalled when the module has taken its strip of pImage */
+    simCpuSet cpus;            /**< CPUs the module thread runs on */
+    int affinityEpoch;         /**< Incremented when cpus changes */
+} simModule_t;
+
+/** An attribute of the attributes file, as it is attached to the frames */
+typedef struct {
+    NDAttribute *pSource;      /**< The attribute in pAttributeList */
+    NDAttribute *pValue;       /**< Copy of pSource attached to the frames, of which only the value is updated */
+    bool invariant;            /**< The value cannot change, so it is only evaluated when the cache is built */
+} simAttribute_t;
+
+/** Values which carry over from one frame of the simulation to the next, as the next frame starts from them */
+typedef struct {
+    int resets;                /**< SimReset_t mask of the values which the next frame starts again */
+    epicsUInt64 randomIndex;   /**< Next value of the SimRandomStreamFrame stream */
+    epicsUInt64 noiseFrame;    /**< Frames of per-frame noise since the background was reset */
+    epicsUInt64 rampFrame;     /**< Frames of the linear ramp since it was reset */
+    double xSineCounter;
+    double ySineCounter;
+} simFrameSequence_t;
+
+/** State of the generation of the frames, the raw and scratch buffers and what they hold, which only the thread
+  * computing a frame uses.  The driver has one, for simTask and the frames which are computed from the previous
+  * frame, and each render thread of the lookahead ring has its own, so the render threads compute their frames in
+  * parallel.  Each frame is given its values of the simDetector's simFrameSequence_t by claimFrame(). */
+class simRenderContext {
+public:
+    simRenderContext(simDetector *pDetector);
+    void releaseBuffers();
+    void renderTask(); /**< Should be private, but gets called from C, so must be public */
+
+private:
+    template <typename epicsType> int computeArray(int sizeX, int sizeY);
+    template <typename epicsType> int computeLinearRampArray(int sizeX, int sizeY);
+    template <typename epicsType> int computePeaksArray(int sizeX, int sizeY);
+    template <typename epicsType> int computeSineArray(int sizeX, int sizeY);
+    template <typename epicsType> int computeFileArray(int sizeX, int sizeY);
+    template <typename epicsType> int computeGeneratorArray(int sizeX, int sizeY);
+    void runRowTasks(simWorkFunction func, void *pvt, int numRows);
+    void setRawColorMode(int colorMode);
+
+    simDetector *pDetector_;
+    simFrameParams_t frameParams_;   /* Parameters of the frame being computed */
+    int resetImage_;           /* SimReset_t mask of the resets requested for the next frame of this context */
+    bool invalidateWindow_;    /* The next frame must not reuse the previous one */
+    bool releaseBuffers_;      /* The buffers are released before the next frame, see simDetector::setAffinity() */
+    NDArray *pRaw_;
+    NDArray *pPreviousRaw_;
+    bool useBackground_;
+    bool perFrameNoise_;
+    epicsUInt64 noiseFrame_;
+    NDArrayInfo arrayInfo_;
+    simWindow_t window_;       /* Region of the raw image computed for this frame */
+    simWindow_t validWindow_;  /* Region of the raw image, and of the linear ramp, which holds the previous frame */
+    simWindow_t rampWindow_;   /* Region of the ramp scratch buffer which holds the ramp of the previous frame */
+    simScratchArena scratch_;  /* Buffers indexed by SimScratch_t */
+    int frameClass_;           /* SimFrameClass_t of this frame */
+    bool fusedRamp_;           /* The linear ramp is advanced in the raw image rather than in its scratch buffer */
+    double xSineCounter_;
+    double ySineCounter_;
+    simRandom frameRandom_;
+    double *peakGains_;
+    int numPeakGains_;
+    const simKernels *pKernels_;   /* Vectorised kernels used for the current frame */
+    int numThreads_;           /* Worker threads used for the current frame */
+    int rawColorMode_;         /* ColorMode attribute of pRaw_, or -1 if pRaw_ does not have it yet */
+
+    /* Frames published as tiles, strips of tileRows_ rows, so that only one tile is held in memory */
+    int tileRows_;             /* Rows of the tiles of the current frame, or 0 if it is not tiled */
+    int numTiles_;             /* Tiles of the current frame, 1 if it is not tiled */
+    int tileIndex_;            /* Tile of the current frame which is computed next */
+    int tileOffsetY_;          /* First row in the frame of the tile being computed */
+    epicsUInt64 rampFrame_;    /* Frames of the linear ramp since the image was reset */
+    epicsUInt64 previousRampFrame_;    /* rampFrame_ of the frame held by the buffers, which this frame advances */
+
+    /* Place in the lookahead ring of the frame of a render thread */
+    int ringSlot_;
+    int ringEpoch_;
+
+    friend class simDetector;
+};
+
 /** Simulation detector driver; demonstrates most of the features that areaDetector drivers can support. */
 class epicsShareClass simDetector : public ADDriver {
 public:
     simDetector(const char *portName, int maxSizeX, int maxSizeY, NDDataType_t dataType,
                 int maxBuffers, size_t maxMemory,
-                int priority, int stackSize);
+                int priority, int stackSize,
+                int ringDepth=0, int numRenderThreads=1, int maxThreads=1,
+                int numModules=1);
 
     /* These are the methods that we override from ADDriver */
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
     virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+    virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
     virtual void setShutter(int open);
     virtual void report(FILE *fp, int details);
+    asynStatus setAffinity(const char *threads, const char *cpus);
+    asynStatus setGenerator(const char *name, const char *args);
     void simTask(); /**< Should be private, but gets called from C, so must be public */
+    void renderTask(simRenderContext *pContext); /**< Should be private, but gets called from C, so must be public */
+    void moduleTask(simModule_t *pModule); /**< Should be private, but gets called from C, so must be public */
 
 protected:
     int SimGainX;
@@ -39,6 +275,9 @@ protected:
     int SimPeakStepX;
     int SimPeakStepY;
     int SimPeakHeightVariation;
+    int SimPeakShiftX;
+    int SimPeakShiftY;
+    int SimPeakGainBuckets;
     int SimOffset;
     int SimXSineOperation;
     int SimXSine1Amplitude;
@@ -54,37 +293,221 @@ protected:
     int SimYSine2Amplitude;
     int SimYSine2Frequency;
     int SimYSine2Phase;
+    int SimMaxThreads;
+    int SimNumThreads;
+    int SimVectorize;
+    int SimVectorISA;
+    int SimNoiseSeed;
+    int SimNoiseModel;
+    int SimNoiseGaussian;
+    int SimNoiseShot;
+    int SimNoiseRead;
+    int SimZeroCopy;
+    int SimRoiRender;
+    int SimIncremental;
+    int SimFrameClass;
+    int SimTimingReset;
+    int SimTimeLast[SimNumTimers];
+    int SimTimeMean[SimNumTimers];
+    int SimTimeMax[SimNumTimers];
+    int SimTimeHistogram[SimNumTimers];
+    int SimPacingMode;
+    int SimPacingSpin;
+    int SimFrameRate;
+    int SimJitterLast;
+    int SimJitterRMS;
+    int SimJitterMax;
+    int SimLateFrames;
+    int SimBurstSize;
+    int SimStatusRate;
+    int SimMovieFrames;
+    int SimMovieMemory;
+    int SimMovieCopy;
+    int SimMovieFill;
+    int SimMovieMemoryUsed;
+    int SimFileName;
+    int SimFileOffset;
+    int SimFilePrefetch;
+    int SimFileZeroCopy;
+    int SimFileFrames;
+    int SimFileFrame;
+    int SimNumModules;
+    int SimArm;
+    int SimArmed;
+    int SimArmBuffers;
+    int SimArmTime;
+    int SimTriggerSource;
+    int SimTriggerPeriod;
+    int SimTriggerFire;
+    int SimTriggerGate;
+    int SimTriggerNumber;
+    int SimTriggersMissed;
+    int SimLatencyAttributes;
+    int SimNumAttributes;
+    int SimAttributeCost;
+    int SimCompression;
+    int SimBloscLevel;
+    int SimBloscShuffle;
+    int SimBloscCompressor;
+    int SimJPEGQuality;
+    int SimCompressionRatio;
+    int SimBitDepth;
+    int SimPacking;
+    int SimUnpackTiming;
+    int SimTileRows;
+    int SimNumTiles;
+    int SimGenerator;
 
 private:
     /* These are the methods that are new to this class */
-    template <typename epicsType> int computeArray(int sizeX, int sizeY);
-    template <typename epicsType> int computeLinearRampArray(int sizeX, int sizeY);
-    template <typename epicsType> int computePeaksArray(int sizeX, int sizeY);
-    template <typename epicsType> int computeSineArray(int sizeX, int sizeY);
-    int computeImage();
+    void getFrameParams(simFrameParams_t *pParams);
+    void updateFrameParams();
+    void claimFrame(simRenderContext *pContext);
+    void invalidateWindows();
+    void beginGeneration();
+    void endGeneration();
+    int computeImage(NDArray **ppImage, bool releaseLock, simRenderContext *pContext);
+    int nextImage(NDArray **ppImage, bool releaseLock, simRenderContext *pRenderContext=NULL);
+    int getMovieFrame(NDArray **ppImage, bool releaseLock);
+    int fillMovie(int numFrames, bool releaseLock);
+    void releaseMovie();
+    int openFile();
+    void advanceFileFrame();
+    int getFileFrame(NDArray **ppImage);
+    void releaseFileWrappers();
+    void closeFile();
+    int getRingFrame(NDArray **ppImage);
+    void flushRing();
+    bool imageResets(int function, int *pResets);
+    void requestReset(int resets);
+    asynStatus arm();
+    void setRingActive(bool active);
+    void publishModules(NDArray *pImage, int arrayCallbacks);
+    void setCurrentImage(NDArray *pImage);
+    void applyAffinity(const simCpuSet *pCpus, int epoch, int *pAppliedEpoch, const char *threadName);
+    void updateTimingParams();
+    void buildAttributeCache();
+    void releaseAttributeCache();
+    void attachAttributes(NDAttributeList *pList);
+    void getCompression(simCompression_t *pCompression);
+    int compressImage(NDArray **ppImage, const simCompression_t *pCompression);
+    void compressMovie();
+    void setCompressionParams(NDArray *pImage, int address);
+    void addEncodeTimes(double encodeTime, double unpackTime);
+    bool firstCompressionError();
+    bool waitUntil(const epicsTimeStamp *pDeadline, double spinTime);
+    bool waitForTrigger(int *pTriggerMode, epicsTimeStamp *pTriggerTime, bool *pGateOpened);
+    void setTriggerSource(const char *name);
+    void resetPacingStats(const epicsTimeStamp *pStartTime);
+    void updatePacingStats(const epicsTimeStamp *pStartTime, const epicsTimeStamp *pScheduledTime, bool burstStart);
 
     /* Our data */
     epicsEventId startEventId_;
     epicsEventId stopEventId_;
-    NDArray *pRaw_;
-    NDArray *pBackground_;
-    bool useBackground_;
-    NDArray *pRamp_;
-    NDArray *pPeak_;
-    NDArrayInfo arrayInfo_;
-    double *xSine1_;
-    double *xSine2_;
-    double *ySine1_;
-    double *ySine2_;
-    double xSineCounter_;
-    double ySineCounter_;
+
+    /* Parameters read last, which each frame copies to the frameParams_ of its context */
+    simFrameParams_t frameParams_;
+    bool frameParamsDirty_;    /* Set by the writes, so frameParams_ is read again for the next frame */
+    int pendingResets_;        /* SimReset_t mask of the caches invalidated by the writes since frameParams_ was read */
+    bool generating_;          /* Set while a thread generates a frame in pContext_, see beginGeneration() */
+    epicsEventId generateEvent_;   /* Signalled when generating_ is cleared */
+    bool reopenFile_;          /* SimFileName has changed, the file is closed before the next frame */
+    simFrameSequence_t sequence_;  /* Where the next frame claimed by claimFrame() starts */
+    simRenderContext *pContext_;   /* The generation of simTask, and of the frames computed one at a time */
+    simRenderContext **renderContexts_;    /* The generation of each render thread */
+
+    /* Generator of SimModeGenerator, set with simDetectorConfigGenerator */
+    simGenerator *pGenerator_;
+    simGeneratorFrame_t generatorFrame_;   /* The frames the generator was prepared for */
+    int generatorReady_;       /* Whether the generator was prepared successfully */
+
+    /* Worker threads computing bands of rows in parallel */
+    simWorkerPool *pWorkerPool_;
+
+    /* Time taken by each stage of the frame pipeline */
+    simTimer timers_[SimNumTimers];
+    epicsMutexId timerLock_;   /* Protects the ENCODE and UNPACK timers, which are updated without the lock */
+
+    /* Frame pacing statistics */
+    epicsTimeStamp rateStartTime_;
+    int rateFrames_;
+    double jitterSumSquares_;
+    double jitterMax_;
+    int jitterCount_;
+    int lateFrames_;
+
+    /* Movie mode: frames computed in advance, in their own pool, and published in turn */
+    NDArrayPool *pMoviePool_;
+    NDArray **movieFrames_;
+    int numMovieFrames_;
+    int movieIndex_;
+    bool movieValid_;
+
+    /* File replayed in SimModeFile, and the NDArrays which wrap its frames without a copy */
+    simFileSource *pFile_;
+    size_t fileOffset_;
+    int numFileFrames_;
+    int fileFrame_;
+    NDArrayPool *pFilePool_;
+    simFileWrapper_t *fileWrappers_;
+    int numFileWrappers_;
+
+    /* Lookahead frame ring filled by the render threads */
+    int ringDepth_;
+    int numRenderThreads_;
+    NDArray **frameRing_;
+    int ringHead_;
+    int ringCount_;
+    int ringPending_;
+    bool ringActive_;
+    epicsMutexId ringLock_;
+    epicsEventId ringFrameEvent_;
+    epicsEventId ringSpaceEvent_;
+    bool *ringFailed_;         /* Places of the ring whose frame could not be computed, which simTask skips */
+    int ringEpoch_;            /* Incremented by flushRing(), so frames being rendered for the old ring are dropped */
+
+    /* First frame, computed by arm() when there is no lookahead ring */
+    NDArray *pArmedImage_;
+
+    /* Trigger source, and the triggers which have been seen by simTask */
+    simTriggerSource *pTrigger_;
+    epicsEventId triggerEvent_;    /* Signalled by the source, by software triggers and when acquisition stops */
+    epicsUInt32 triggerCount_;     /* Edges of the source seen so far */
+    epicsUInt32 softwareTriggers_; /* Writes to ADTriggerSoftware */
+    epicsUInt32 softwareSeen_;
+    epicsTimeStamp softwareTime_;  /* Time of the last write to ADTriggerSoftware */
+    epicsUInt32 triggerNumber_;    /* Number of the trigger which started the current burst */
+    int triggersMissed_;
+
+    /* Modules publishing strips of the image on addresses 0 to numModules_-1, if numModules_>1 */
+    int numModules_;
+    simModule_t *modules_;
+    NDArray *pModuleImage_;    /* The last image, which is held here rather than in pArrays[0] */
+
+    /* Attributes of the attributes file, resolved by buildAttributeCache() when the file is loaded */
+    simAttribute_t *attributes_;
+    int numAttributes_;
+    int numInvariantAttributes_;
+    bool attributesValid_;
+
+    /* Set when a compression error has been reported, until the compression settings change */
+    int compressionError_;
+    epicsMutexId compressionLock_; /* Protects compressionError_, which is set without the lock */
+
+    /* CPUs the threads run on; each thread applies its set when the epoch changes */
+    simCpuSet cpus_[SimNumAffinity];
+    int affinityEpoch_[SimNumAffinity];
+
+    friend class simRenderContext;
 };
 
 typedef enum {
     SimModeLinearRamp,
     SimModePeaks,
     SimModeSine,
-    SimModeOffsetNoise
+    SimModeOffsetNoise,
+    SimModeFile,
+    SimModeGenerator
 } SimModes_t;
 
 typedef enum {
@@ -92,6 +515,48 @@ typedef enum {
     SimSineOperationMultiply
 } SimSineOperation_t;
 
+typedef enum {
+    SimNoiseModelBackground,
+    SimNoiseModelPerFrame
+} SimNoiseModel_t;
+
+/** How simTask paces the frames */
+typedef enum {
+    SimPacingSleep,            /**< Sleeps for the period minus the time taken by the frame */
+    SimPacingDeadline,         /**< Starts frame n at n periods after the start of acquisition */
+    SimPacingFreeRun           /**< Generates frames as fast as possible, without sleeping */
+} SimPacingMode_t;
+
+/** Values of ADTriggerMode; the first two are those of ADTriggerMode_t */
+typedef enum {
+    SimTriggerInternal = ADTriggerInternal,   /**< Frames are paced by SimPacingMode */
+    SimTriggerExternal = ADTriggerExternal,   /**< Each edge of the trigger source starts a burst */
+    SimTriggerGated,           /**< Frames are paced by SimPacingMode while the gate of the trigger source is open */
+    SimTriggerSoftware         /**< Each write to ADTriggerSoftware starts a burst */
+} SimTriggerMode_t;
+
+/** Codecs of the frames, from ADCore's NDPluginCodec */
+typedef enum {
+    SimCompressionNone,
+    SimCompressionLZ4,
+    SimCompressionBSLZ4,       /**< Bitshuffle and LZ4 */
+    SimCompressionBlosc,
+    SimCompressionJPEG         /**< Only for NDUInt8 */
+} SimCompression_t;
+
+/** Layouts of the frames with a SimBitDepth */
+typedef enum {
+    SimPackingContainer,       /**< Each element in the smallest unsigned data type which holds SimBitDepth bits */
+    SimPackingPacked           /**< The elements of each row packed into a stream of SimBitDepth-bit values */
+} SimPacking_t;
+
+/** How a frame differs from the previous one */
+typedef enum {
+    SimFrameStatic,            /**< Identical to the previous frame */
+    SimFrameAffine,            /**< The previous frame plus a constant */
+    SimFrameDynamic            /**< Computed from scratch */
+} SimFrameClass_t;
+
 #define SimGainXString                "SIM_GAIN_X"
 #define SimGainYString                "SIM_GAIN_Y"
 #define SimGainRedString              "SIM_GAIN_RED"
@@ -110,6 +575,9 @@ typedef enum {
 #define SimPeakStepXString            "SIM_PEAK_STEP_X"
 #define SimPeakStepYString            "SIM_PEAK_STEP_Y"
 #define SimPeakHeightVariationString  "SIM_PEAK_HEIGHT_VARIATION"
+#define SimPeakShiftXString           "SIM_PEAK_SHIFT_X"
+#define SimPeakShiftYString           "SIM_PEAK_SHIFT_Y"
+#define SimPeakGainBucketsString      "SIM_PEAK_GAIN_BUCKETS"
 #define SimXSineOperationString       "SIM_XSINE_OPERATION"
 #define SimXSine1AmplitudeString      "SIM_XSINE1_AMPLITUDE"
 #define SimXSine1FrequencyString      "SIM_XSINE1_FREQUENCY"
@@ -124,3 +592,68 @@ typedef enum {
 #define SimYSine2AmplitudeString      "SIM_YSINE2_AMPLITUDE"
 #define SimYSine2FrequencyString      "SIM_YSINE2_FREQUENCY"
 #define SimYSine2PhaseString          "SIM_YSINE2_PHASE"
+#define SimMaxThreadsString           "SIM_MAX_THREADS"
+#define SimNumThreadsString           "SIM_NUM_THREADS"
+#define SimVectorizeString            "SIM_VECTORIZE"
+#define SimVectorISAString            "SIM_VECTOR_ISA"
+#define SimNoiseSeedString            "SIM_NOISE_SEED"
+#define SimNoiseModelString           "SIM_NOISE_MODEL"
+#define SimNoiseGaussianString        "SIM_NOISE_GAUSSIAN"
+#define SimNoiseShotString            "SIM_NOISE_SHOT"
+#define SimNoiseReadString            "SIM_NOISE_READ"
+#define SimZeroCopyString             "SIM_ZERO_COPY"
+#define SimRoiRenderString            "SIM_ROI_RENDER"
+#define SimIncrementalString          "SIM_INCREMENTAL"
+#define SimFrameClassString           "SIM_FRAME_CLASS"
+#define SimTimingResetString          "SIM_TIMING_RESET"
+#define SimPacingModeString           "SIM_PACING_MODE"
+#define SimPacingSpinString           "SIM_PACING_SPIN"
+#define SimFrameRateString            "SIM_FRAME_RATE"
+#define SimJitterLastString           "SIM_JITTER_LAST"
+#define SimJitterRMSString            "SIM_JITTER_RMS"
+#define SimJitterMaxString            "SIM_JITTER_MAX"
+#define SimLateFramesString           "SIM_LATE_FRAMES"
+#define SimBurstSizeString            "SIM_BURST_SIZE"
+#define SimStatusRateString           "SIM_STATUS_RATE"
+#define SimMovieFramesString          "SIM_MOVIE_FRAMES"
+#define SimMovieMemoryString          "SIM_MOVIE_MEMORY"
+#define SimMovieCopyString            "SIM_MOVIE_COPY"
+#define SimMovieFillString            "SIM_MOVIE_FILL"
+#define SimMovieMemoryUsedString      "SIM_MOVIE_MEMORY_USED"
+#define SimFileNameString             "SIM_FILE_NAME"
+#define SimFileOffsetString           "SIM_FILE_OFFSET"
+#define SimFilePrefetchString         "SIM_FILE_PREFETCH"
+#define SimFileZeroCopyString         "SIM_FILE_ZERO_COPY"
+#define SimFileFramesString           "SIM_FILE_FRAMES"
+#define SimFileFrameString            "SIM_FILE_FRAME"
+#define SimNumModulesString           "SIM_NUM_MODULES"
+#define SimArmString                  "SIM_ARM"
+#define SimArmedString                "SIM_ARMED"
+#define SimArmBuffersString           "SIM_ARM_BUFFERS"
+#define SimArmTimeString              "SIM_ARM_TIME"
+#define SimTriggerSourceString        "SIM_TRIGGER_SOURCE"
+#define SimTriggerPeriodString        "SIM_TRIGGER_PERIOD"
+#define SimTriggerFireString          "SIM_TRIGGER_FIRE"
+#define SimTriggerGateString          "SIM_TRIGGER_GATE"
+#define SimTriggerNumberString        "SIM_TRIGGER_NUMBER"
+#define SimTriggersMissedString       "SIM_TRIGGERS_MISSED"
+#define SimLatencyAttributesString    "SIM_LATENCY_ATTRIBUTES"
+#define SimNumAttributesString        "SIM_NUM_ATTRIBUTES"
+#define SimAttributeCostString        "SIM_ATTRIBUTE_COST"
+#define SimCompressionString          "SIM_COMPRESSION"
+#define SimBloscLevelString           "SIM_BLOSC_LEVEL"
+#define SimBloscShuffleString         "SIM_BLOSC_SHUFFLE"
+#define SimBloscCompressorString      "SIM_BLOSC_COMPRESSOR"
+#define SimJPEGQualityString          "SIM_JPEG_QUALITY"
+#define SimCompressionRatioString     "SIM_COMPRESSION_RATIO"
+#define SimBitDepthString             "SIM_BIT_DEPTH"
+#define SimPackingString              "SIM_PACKING"
+#define SimUnpackTimingString         "SIM_UNPACK_TIMING"
+#define SimTileRowsString             "SIM_TILE_ROWS"
+#define SimNumTilesString             "SIM_NUM_TILES"
+#define SimGeneratorString            "SIM_GENERATOR"
+/* The timing parameters are created for each stage, e.g. SIM_TIME_GENERATE_MEAN */
+#define SimTimeLastString             "SIM_TIME_%s_LAST"
+#define SimTimeMeanString             "SIM_TIME_%s_MEAN"
+#define SimTimeMaxString              "SIM_TIME_%s_MAX"
+#define SimTimeHistogramString        "SIM_TIME_%s_HIST"
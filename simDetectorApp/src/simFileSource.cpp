@@ -0,0 +1,141 @@
+/* simFileSource.cpp
+ *
+ * A file of recorded frames which is mapped into memory and replayed by the simDetector driver.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(vxWorks) || defined(__rtems__)
+  #define SIM_FILE_NO_MMAP
+#else
+  #include <sys/types.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#include <epicsString.h>
+
+#include "simFileSource.h"
+
+simFileSource::simFileSource()
+    : fileName_(0), pData_(0), size_(0), mapped_(false)
+#if defined(_WIN32)
+    , fileHandle_(INVALID_HANDLE_VALUE), mappingHandle_(0)
+#endif
+{
+}
+
+simFileSource::~simFileSource()
+{
+    close();
+}
+
+/** Maps a file into memory, closing the previous one.
+  * \param[in] fileName The name of the file.
+  * \return 0 on success, -1 if the file cannot be opened or mapped. */
+int simFileSource::open(const char *fileName)
+{
+    close();
+    fileName_ = epicsStrDup(fileName);
+
+#if defined(_WIN32)
+    LARGE_INTEGER fileSize;
+    fileHandle_ = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle_ == INVALID_HANDLE_VALUE) return -1;
+    if (!GetFileSizeEx((HANDLE)fileHandle_, &fileSize) || (fileSize.QuadPart == 0)) {
+        close();
+        return -1;
+    }
+    mappingHandle_ = CreateFileMappingA((HANDLE)fileHandle_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle_) pData_ = (char *)MapViewOfFile((HANDLE)mappingHandle_, FILE_MAP_READ, 0, 0, 0);
+    if (!pData_) {
+        close();
+        return -1;
+    }
+    size_ = (size_t)fileSize.QuadPart;
+    mapped_ = true;
+#elif defined(SIM_FILE_NO_MMAP)
+    FILE *file = fopen(fileName, "rb");
+    long fileSize;
+    if (!file) return -1;
+    if ((fseek(file, 0, SEEK_END) != 0) || ((fileSize = ftell(file)) <= 0) || (fseek(file, 0, SEEK_SET) != 0)) {
+        fclose(file);
+        return -1;
+    }
+    pData_ = (char *)malloc(fileSize);
+    if (!pData_ || (fread(pData_, 1, fileSize, file) != (size_t)fileSize)) {
+        fclose(file);
+        close();
+        return -1;
+    }
+    fclose(file);
+    size_ = (size_t)fileSize;
+#else
+    struct stat fileStat;
+    void *pMap;
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return -1;
+    if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+        ::close(fd);
+        return -1;
+    }
+    pMap = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping stays valid after the file is closed */
+    ::close(fd);
+    if (pMap == MAP_FAILED) return -1;
+    pData_ = (char *)pMap;
+    size_ = (size_t)fileStat.st_size;
+    mapped_ = true;
+  #ifdef MADV_SEQUENTIAL
+    /* The frames are read in order, so read ahead aggressively and drop pages behind */
+    madvise(pData_, size_, MADV_SEQUENTIAL);
+  #endif
+#endif
+    return 0;
+}
+
+/** Unmaps the file */
+void simFileSource::close()
+{
+#if defined(_WIN32)
+    if (pData_) UnmapViewOfFile(pData_);
+    if (mappingHandle_) CloseHandle((HANDLE)mappingHandle_);
+    if (fileHandle_ != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)fileHandle_);
+    mappingHandle_ = 0;
+    fileHandle_ = INVALID_HANDLE_VALUE;
+#elif defined(SIM_FILE_NO_MMAP)
+    free(pData_);
+#else
+    if (pData_) munmap(pData_, size_);
+#endif
+    free(fileName_);
+    fileName_ = 0;
+    pData_ = 0;
+    size_ = 0;
+    mapped_ = false;
+}
+
+/** Asks the system to start reading part of the file into memory, so that it is resident when it is used.
+  * \param[in] offset The offset of the first byte in the file.
+  * \param[in] length The number of bytes. */
+void simFileSource::prefetch(size_t offset, size_t length)
+{
+    if (!mapped_ || (offset >= size_)) return;
+    if (length > size_ - offset) length = size_ - offset;
+#if !defined(_WIN32) && !defined(SIM_FILE_NO_MMAP) && defined(MADV_WILLNEED)
+    {
+        /* madvise() needs an address on a page boundary */
+        size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = offset - offset % pageSize;
+        madvise(pData_ + start, length + (offset - start), MADV_WILLNEED);
+    }
+#endif
+}
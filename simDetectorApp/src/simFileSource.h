@@ -0,0 +1,37 @@
+/* simFileSource.h
+ *
+ * A file of recorded frames which is mapped into memory and replayed by the simDetector driver.
+ *
+ */
+
+#ifndef SIM_FILE_SOURCE_H
+#define SIM_FILE_SOURCE_H
+
+#include <stddef.h>
+
+/** A file mapped read-only into memory.
+  * On systems without mmap() or MapViewOfFile() the file is read into memory instead.
+  * The methods are not thread safe, the caller must serialize them. */
+class simFileSource {
+public:
+    simFileSource();
+    ~simFileSource();
+    int open(const char *fileName);
+    void close();
+    void prefetch(size_t offset, size_t length);
+    const char *fileName() const { return fileName_; }
+    const char *data() const { return pData_; }
+    size_t size() const { return size_; }
+
+private:
+    char *fileName_;
+    char *pData_;
+    size_t size_;
+    bool mapped_;              /**< pData_ is a mapping of the file, rather than a copy in memory */
+#if defined(_WIN32)
+    void *fileHandle_;
+    void *mappingHandle_;
+#endif
+};
+
+#endif
@@ -0,0 +1,167 @@
+/* simGenerator.cpp
+ *
+ * Pattern generators which can be added to the simDetector driver without changing it, used in SimModeGenerator.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsString.h>
+
+#include <epicsExport.h>
+#include "simGenerator.h"
+
+/** A registered factory */
+typedef struct simGeneratorEntry {
+    char *name;
+    simGeneratorFactory factory;
+    struct simGeneratorEntry *pNext;
+} simGeneratorEntry;
+
+/* All the factories, protected by factoriesMutex */
+static simGeneratorEntry *pFactories = 0;
+static epicsMutexId factoriesMutex = 0;
+static epicsThreadOnceId factoriesOnce = EPICS_THREAD_ONCE_INIT;
+
+static simGenerator *createRings(const char *args);
+
+/** Adds a factory, or replaces the one with the same name; called with factoriesMutex, or from createFactories() */
+static void addFactory(const char *name, simGeneratorFactory factory)
+{
+    simGeneratorEntry *pEntry;
+
+    for (pEntry=pFactories; pEntry; pEntry=pEntry->pNext) {
+        if (strcmp(pEntry->name, name) == 0) break;
+    }
+    if (!pEntry) {
+        pEntry = (simGeneratorEntry *)calloc(1, sizeof(simGeneratorEntry));
+        pEntry->name = epicsStrDup(name);
+        pEntry->pNext = pFactories;
+        pFactories = pEntry;
+    }
+    pEntry->factory = factory;
+}
+
+static void createFactories(void *)
+{
+    factoriesMutex = epicsMutexMustCreate();
+    /* The generators which come with the driver */
+    addFactory("rings", createRings);
+}
+
+void simRegisterGenerator(const char *name, simGeneratorFactory factory)
+{
+    if (!name || !factory) return;
+    epicsThreadOnce(&factoriesOnce, createFactories, 0);
+    epicsMutexLock(factoriesMutex);
+    addFactory(name, factory);
+    epicsMutexUnlock(factoriesMutex);
+}
+
+simGenerator *simCreateGenerator(const char *name, const char *args)
+{
+    simGeneratorEntry *pEntry;
+    simGeneratorFactory factory = 0;
+
+    if (!name) return 0;
+    if (!args) args = "";
+    epicsThreadOnce(&factoriesOnce, createFactories, 0);
+    epicsMutexLock(factoriesMutex);
+    for (pEntry=pFactories; pEntry; pEntry=pEntry->pNext) {
+        if (strcmp(pEntry->name, name) == 0) {
+            factory = pEntry->factory;
+            break;
+        }
+    }
+    epicsMutexUnlock(factoriesMutex);
+    /* The factory is called without the mutex, so that it can register other factories */
+    return factory ? factory(args) : 0;
+}
+
+void simPrintGenerators(FILE *fp)
+{
+    simGeneratorEntry *pEntry;
+
+    epicsThreadOnce(&factoriesOnce, createFactories, 0);
+    epicsMutexLock(factoriesMutex);
+    for (pEntry=pFactories; pEntry; pEntry=pEntry->pNext) {
+        fprintf(fp, "  %s\n", pEntry->name);
+    }
+    epicsMutexUnlock(factoriesMutex);
+}
+
+/** Concentric rings of a powder diffraction pattern, with a Gaussian profile across each ring.
+  * The arguments are "centreX centreY spacing width", in pixels; a negative centre is the centre of the frame.
+  * The pattern does not change from frame to frame, and every pixel is computed from its coordinates alone. */
+class simRingsGenerator : public simGenerator {
+public:
+    simRingsGenerator(double centreX, double centreY, double spacing, double width)
+        : requestX_(centreX), requestY_(centreY), centreX_(0.), centreY_(0.), spacing_(spacing), width_(width),
+          pDistanceX2_(0), sizeX_(0) {}
+    ~simRingsGenerator() { free(pDistanceX2_); }
+
+    int capabilities() const
+    {
+        return SimGeneratorParallel | SimGeneratorRoi | SimGeneratorIncremental;
+    }
+
+    int prepare(const simGeneratorFrame_t *pFrame)
+    {
+        double *pDistanceX2;
+        int i;
+
+        centreX_ = (requestX_ < 0) ? (pFrame->sizeX - 1) / 2.0 : requestX_;
+        centreY_ = (requestY_ < 0) ? (pFrame->sizeY - 1) / 2.0 : requestY_;
+        /* The squares of the distances along X are the same for every row */
+        pDistanceX2 = (double *)realloc(pDistanceX2_, (pFrame->sizeX ? pFrame->sizeX : 1) * sizeof(double));
+        if (!pDistanceX2) return -1;
+        pDistanceX2_ = pDistanceX2;
+        sizeX_ = pFrame->sizeX;
+        for (i=0; i<sizeX_; i++) {
+            pDistanceX2_[i] = (i - centreX_) * (i - centreX_);
+        }
+        return 0;
+    }
+
+    void renderRow(const simGeneratorFrame_t * /* pFrame */, int y, int minX, int numX, double *pValues)
+    {
+        double distanceY2 = (y - centreY_) * (y - centreY_);
+        double scale = -0.5 / (width_ * width_);
+        double offRing;
+        int i;
+
+        for (i=0; i<numX; i++) {
+            /* The distance to the nearest ring */
+            offRing = fmod(sqrt(pDistanceX2_[minX + i] + distanceY2), spacing_);
+            if (offRing > spacing_ / 2) offRing -= spacing_;
+            pValues[i] = exp(offRing * offRing * scale);
+        }
+    }
+
+    void advance(const simGeneratorFrame_t * /* pFrame */) {}
+
+private:
+    double requestX_, requestY_;
+    double centreX_, centreY_;
+    double spacing_;
+    double width_;
+    double *pDistanceX2_;
+    int sizeX_;
+};
+
+static simGenerator *createRings(const char *args)
+{
+    double centreX = -1., centreY = -1., spacing = 20., width = 2.;
+
+    sscanf(args, "%lf %lf %lf %lf", &centreX, &centreY, &spacing, &width);
+    if ((spacing <= 0.) || (width <= 0.)) {
+        printf("simRingsGenerator: the spacing and width must be greater than 0\n");
+        return 0;
+    }
+    return new simRingsGenerator(centreX, centreY, spacing, width);
+}
@@ -0,0 +1,72 @@
+/* simGenerator.h
+ *
+ * Pattern generators which can be added to the simDetector driver without changing it, used in SimModeGenerator.
+ *
+ * A generator computes the intensity of the pixels of a frame, one row at a time; the driver adds it to the
+ * background and noise, scaled by the gains, in the data type and color mode of the frame.  Generators are
+ * created by name from a factory, which is registered with simRegisterGenerator().  A library loaded at run
+ * time with dlload can register its factories from a static constructor, and simDetectorConfigGenerator then
+ * gives a generator to a driver.
+ *
+ */
+
+#ifndef SIM_GENERATOR_H
+#define SIM_GENERATOR_H
+
+#include <stdio.h>
+
+#include <shareLib.h>
+#include "NDArray.h"
+
+/** Capabilities of a generator, which choose how the driver calls it */
+typedef enum {
+    SimGeneratorParallel    = 0x01, /**< Rows can be rendered at the same time by several threads */
+    SimGeneratorRoi         = 0x02, /**< Parts of rows can be rendered, so only the region of interest is */
+    SimGeneratorIncremental = 0x04  /**< The pattern only changes when the generator is prepared, so with
+                                         SimIncremental the previous frame is kept */
+} SimGeneratorCaps_t;
+
+/** The frames being generated */
+typedef struct {
+    int sizeX;                 /**< Width of the frame */
+    int sizeY;                 /**< Height of the frame, of all its tiles when it is tiled */
+    int colorMode;             /**< NDColorMode_t of the frame */
+    NDDataType_t dataType;
+    epicsUInt32 seed;          /**< SimNoiseSeed, for generators with random patterns */
+} simGeneratorFrame_t;
+
+/** A pattern generator.
+  * The driver calls prepare() after a reset, which happens before the first frame and whenever the size, data
+  * type, color mode or seed of the frames change, then renderRow() for the rows of each frame and advance() at
+  * the end of the frame.  The calls of a generator never overlap, except for the calls of renderRow() from
+  * several threads when the generator has SimGeneratorParallel. */
+class simGenerator {
+public:
+    virtual ~simGenerator() {}
+    /** Returns the SimGeneratorCaps_t mask of the capabilities of the generator */
+    virtual int capabilities() const = 0;
+    /** Prepares the generator for frames, for example to compute its tables.
+      * \return 0 on success; the frames are black if the generator cannot be prepared. */
+    virtual int prepare(const simGeneratorFrame_t *pFrame) = 0;
+    /** Computes the intensity of pixels [minX, minX+numX) of row y of the frame.  Without SimGeneratorRoi, minX is
+      * 0 and numX is the width of the frame.  Without SimGeneratorParallel, the rows are computed in order. */
+    virtual void renderRow(const simGeneratorFrame_t *pFrame, int y, int minX, int numX, double *pValues) = 0;
+    /** Moves the pattern to the next frame; not called for the frames which keep the previous frame */
+    virtual void advance(const simGeneratorFrame_t *pFrame) = 0;
+};
+
+/** Creates a generator from the arguments of simDetectorConfigGenerator.
+  * \return The generator, or NULL if the arguments are invalid. */
+typedef simGenerator *(*simGeneratorFactory)(const char *args);
+
+/** Registers the factory of the generators with a name, replacing any factory with the same name */
+epicsShareFunc void simRegisterGenerator(const char *name, simGeneratorFactory factory);
+
+/** Creates a generator with the factory registered with a name.
+  * \return The generator, or NULL if there is no such factory or the arguments are invalid. */
+epicsShareFunc simGenerator *simCreateGenerator(const char *name, const char *args);
+
+/** Prints the names of the registered factories */
+epicsShareFunc void simPrintGenerators(FILE *fp);
+
+#endif
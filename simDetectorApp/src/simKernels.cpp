@@ -0,0 +1,583 @@
+/* simKernels.cpp
+ *
+ * Scalar, SSE2, AVX2 and NEON versions of the simDetector inner loops.
+ *
+ * The vectorised kernels must give bit-identical results to the scalar ones.
+ * The double arithmetic is done in the same order, without fused multiply-add.
+ * Conversions from double to integer use the same truncation and wrap-around as the
+ * scalar conversion on the same target.
+ *
+ */
+
+#include <stddef.h>
+
+#include <epicsTypes.h>
+
+#include "simKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define SIM_KERNELS_SSE2
+  #define SIM_KERNELS_AVX2
+  #define SIM_KERNELS_X86_RUNTIME
+  #define SIM_TARGET_SSE2 __attribute__((target("sse2")))
+  #define SIM_TARGET_AVX2 __attribute__((target("avx2")))
+  #include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define SIM_KERNELS_SSE2
+  #define SIM_TARGET_SSE2
+  #if defined(__AVX2__)
+    #define SIM_KERNELS_AVX2
+    #define SIM_TARGET_AVX2
+  #endif
+  #include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  #define SIM_KERNELS_NEON
+  #include <arm_neon.h>
+#endif
+
+static const simKernels scalarKernels = {
+    "Scalar",
+    simAddArrayLoop<epicsUInt8>, simAddArrayLoop<epicsUInt16>, simAddArrayLoop<epicsFloat32>,
+    simAddConstantLoop<epicsUInt8>, simAddConstantLoop<epicsUInt16>, simAddConstantLoop<epicsFloat32>,
+    simAddSineLoop<epicsUInt8>, simAddSineLoop<epicsUInt16>, simAddSineLoop<epicsFloat32>,
+    simAddScaledLoop<epicsUInt8>, simAddScaledLoop<epicsUInt16>, simAddScaledLoop<epicsFloat32>
+};
+
+#ifdef SIM_KERNELS_SSE2
+/* SSE2 kernels, 16 bytes at a time.
+ * _mm_cvttpd_epi32 truncates like the scalar (int) conversion, and packing after sign-extending the
+ * low bits gives the same wrap-around as the scalar narrowing to 8 or 16 bits. */
+
+SIM_TARGET_SSE2 static inline __m128i sse2Narrow32To16(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+SIM_TARGET_SSE2 static inline __m128i sse2Narrow16To8(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi16(_mm_slli_epi16(lo, 8), 8);
+    hi = _mm_srai_epi16(_mm_slli_epi16(hi, 8), 8);
+    return _mm_packs_epi16(lo, hi);
+}
+
+/* 4 values of a * (x[i] + y) * scale truncated to int32 */
+SIM_TARGET_SSE2 static inline __m128i sse2Sine4(const double *x, __m128d y, __m128d a, __m128d scale)
+{
+    __m128d v0 = _mm_mul_pd(_mm_mul_pd(a, _mm_add_pd(_mm_loadu_pd(x),   y)), scale);
+    __m128d v1 = _mm_mul_pd(_mm_mul_pd(a, _mm_add_pd(_mm_loadu_pd(x+2), y)), scale);
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(v0), _mm_cvttpd_epi32(v1));
+}
+
+/* 4 values of a * x[i] truncated to int32 */
+SIM_TARGET_SSE2 static inline __m128i sse2Scaled4(const double *x, __m128d a)
+{
+    __m128d v0 = _mm_mul_pd(a, _mm_loadu_pd(x));
+    __m128d v1 = _mm_mul_pd(a, _mm_loadu_pd(x+2));
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(v0), _mm_cvttpd_epi32(v1));
+}
+
+SIM_TARGET_SSE2 static void addArraySSE2UInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(pOut+i)), _mm_loadu_si128((const __m128i *)(pIn+i)));
+        _mm_storeu_si128((__m128i *)(pOut+i), v);
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_SSE2 static void addArraySSE2UInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        __m128i v = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pOut+i)), _mm_loadu_si128((const __m128i *)(pIn+i)));
+        _mm_storeu_si128((__m128i *)(pOut+i), v);
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_SSE2 static void addArraySSE2Float32(epicsFloat32 *pOut, const epicsFloat32 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        _mm_storeu_ps(pOut+i, _mm_add_ps(_mm_loadu_ps(pOut+i), _mm_loadu_ps(pIn+i)));
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_SSE2 static void addConstantSSE2UInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, epicsUInt8 value, size_t n)
+{
+    __m128i c = _mm_set1_epi8((char)value);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        _mm_storeu_si128((__m128i *)(pOut+i), _mm_add_epi8(_mm_loadu_si128((const __m128i *)(pIn+i)), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_SSE2 static void addConstantSSE2UInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, epicsUInt16 value, size_t n)
+{
+    __m128i c = _mm_set1_epi16((short)value);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        _mm_storeu_si128((__m128i *)(pOut+i), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pIn+i)), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_SSE2 static void addConstantSSE2Float32(epicsFloat32 *pOut, const epicsFloat32 *pIn, epicsFloat32 value, size_t n)
+{
+    __m128 c = _mm_set1_ps(value);
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        _mm_storeu_ps(pOut+i, _mm_add_ps(_mm_loadu_ps(pIn+i), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_SSE2 static void addSineSSE2UInt8(epicsUInt8 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m128d vy = _mm_set1_pd(y), va = _mm_set1_pd(a), vs = _mm_set1_pd(scale);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i lo = sse2Narrow32To16(sse2Sine4(x+i,    vy, va, vs), sse2Sine4(x+i+4,  vy, va, vs));
+        __m128i hi = sse2Narrow32To16(sse2Sine4(x+i+8,  vy, va, vs), sse2Sine4(x+i+12, vy, va, vs));
+        __m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(pOut+i)), sse2Narrow16To8(lo, hi));
+        _mm_storeu_si128((__m128i *)(pOut+i), v);
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_SSE2 static void addSineSSE2UInt16(epicsUInt16 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m128d vy = _mm_set1_pd(y), va = _mm_set1_pd(a), vs = _mm_set1_pd(scale);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        __m128i s = sse2Narrow32To16(sse2Sine4(x+i, vy, va, vs), sse2Sine4(x+i+4, vy, va, vs));
+        _mm_storeu_si128((__m128i *)(pOut+i), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pOut+i)), s));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_SSE2 static void addSineSSE2Float32(epicsFloat32 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m128d vy = _mm_set1_pd(y), va = _mm_set1_pd(a), vs = _mm_set1_pd(scale);
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        __m128d v0 = _mm_mul_pd(_mm_mul_pd(va, _mm_add_pd(_mm_loadu_pd(x+i),   vy)), vs);
+        __m128d v1 = _mm_mul_pd(_mm_mul_pd(va, _mm_add_pd(_mm_loadu_pd(x+i+2), vy)), vs);
+        __m128 s = _mm_movelh_ps(_mm_cvtpd_ps(v0), _mm_cvtpd_ps(v1));
+        _mm_storeu_ps(pOut+i, _mm_add_ps(_mm_loadu_ps(pOut+i), s));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_SSE2 static void addScaledSSE2UInt8(epicsUInt8 *pOut, const double *x, double a, size_t n)
+{
+    __m128d va = _mm_set1_pd(a);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i lo = sse2Narrow32To16(sse2Scaled4(x+i,   va), sse2Scaled4(x+i+4,  va));
+        __m128i hi = sse2Narrow32To16(sse2Scaled4(x+i+8, va), sse2Scaled4(x+i+12, va));
+        __m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(pOut+i)), sse2Narrow16To8(lo, hi));
+        _mm_storeu_si128((__m128i *)(pOut+i), v);
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+SIM_TARGET_SSE2 static void addScaledSSE2UInt16(epicsUInt16 *pOut, const double *x, double a, size_t n)
+{
+    __m128d va = _mm_set1_pd(a);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        __m128i s = sse2Narrow32To16(sse2Scaled4(x+i, va), sse2Scaled4(x+i+4, va));
+        _mm_storeu_si128((__m128i *)(pOut+i), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pOut+i)), s));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+SIM_TARGET_SSE2 static void addScaledSSE2Float32(epicsFloat32 *pOut, const double *x, double a, size_t n)
+{
+    __m128d va = _mm_set1_pd(a);
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        __m128 s = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(va, _mm_loadu_pd(x+i))),
+                                 _mm_cvtpd_ps(_mm_mul_pd(va, _mm_loadu_pd(x+i+2))));
+        _mm_storeu_ps(pOut+i, _mm_add_ps(_mm_loadu_ps(pOut+i), s));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+static const simKernels sse2Kernels = {
+    "SSE2",
+    addArraySSE2UInt8, addArraySSE2UInt16, addArraySSE2Float32,
+    addConstantSSE2UInt8, addConstantSSE2UInt16, addConstantSSE2Float32,
+    addSineSSE2UInt8, addSineSSE2UInt16, addSineSSE2Float32,
+    addScaledSSE2UInt8, addScaledSSE2UInt16, addScaledSSE2Float32
+};
+#endif /* SIM_KERNELS_SSE2 */
+
+#ifdef SIM_KERNELS_AVX2
+/* AVX2 kernels, 32 bytes at a time.
+ * Only avx2 is enabled for these functions, not fma, so the compiler cannot contract a*b+c. */
+
+SIM_TARGET_AVX2 static inline __m128i avx2Narrow32To16(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+SIM_TARGET_AVX2 static inline __m128i avx2Narrow16To8(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi16(_mm_slli_epi16(lo, 8), 8);
+    hi = _mm_srai_epi16(_mm_slli_epi16(hi, 8), 8);
+    return _mm_packs_epi16(lo, hi);
+}
+
+SIM_TARGET_AVX2 static inline __m256i avx2Combine(__m128i lo, __m128i hi)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+SIM_TARGET_AVX2 static inline __m128i avx2Sine4(const double *x, __m256d y, __m256d a, __m256d scale)
+{
+    return _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_mul_pd(a, _mm256_add_pd(_mm256_loadu_pd(x), y)), scale));
+}
+
+SIM_TARGET_AVX2 static inline __m128i avx2Scaled4(const double *x, __m256d a)
+{
+    return _mm256_cvttpd_epi32(_mm256_mul_pd(a, _mm256_loadu_pd(x)));
+}
+
+SIM_TARGET_AVX2 static void addArrayAVX2UInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+32<=n; i+=32) {
+        __m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(pOut+i)), _mm256_loadu_si256((const __m256i *)(pIn+i)));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_AVX2 static void addArrayAVX2UInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m256i v = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(pOut+i)), _mm256_loadu_si256((const __m256i *)(pIn+i)));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_AVX2 static void addArrayAVX2Float32(epicsFloat32 *pOut, const epicsFloat32 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        _mm256_storeu_ps(pOut+i, _mm256_add_ps(_mm256_loadu_ps(pOut+i), _mm256_loadu_ps(pIn+i)));
+    }
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+SIM_TARGET_AVX2 static void addConstantAVX2UInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, epicsUInt8 value, size_t n)
+{
+    __m256i c = _mm256_set1_epi8((char)value);
+    size_t i=0;
+    for (; i+32<=n; i+=32) {
+        _mm256_storeu_si256((__m256i *)(pOut+i), _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(pIn+i)), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_AVX2 static void addConstantAVX2UInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, epicsUInt16 value, size_t n)
+{
+    __m256i c = _mm256_set1_epi16((short)value);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        _mm256_storeu_si256((__m256i *)(pOut+i), _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(pIn+i)), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_AVX2 static void addConstantAVX2Float32(epicsFloat32 *pOut, const epicsFloat32 *pIn, epicsFloat32 value, size_t n)
+{
+    __m256 c = _mm256_set1_ps(value);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        _mm256_storeu_ps(pOut+i, _mm256_add_ps(_mm256_loadu_ps(pIn+i), c));
+    }
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+SIM_TARGET_AVX2 static void addSineAVX2UInt8(epicsUInt8 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m256d vy = _mm256_set1_pd(y), va = _mm256_set1_pd(a), vs = _mm256_set1_pd(scale);
+    size_t i=0;
+    for (; i+32<=n; i+=32) {
+        __m128i s0 = avx2Narrow16To8(avx2Narrow32To16(avx2Sine4(x+i,    vy, va, vs), avx2Sine4(x+i+4,  vy, va, vs)),
+                                     avx2Narrow32To16(avx2Sine4(x+i+8,  vy, va, vs), avx2Sine4(x+i+12, vy, va, vs)));
+        __m128i s1 = avx2Narrow16To8(avx2Narrow32To16(avx2Sine4(x+i+16, vy, va, vs), avx2Sine4(x+i+20, vy, va, vs)),
+                                     avx2Narrow32To16(avx2Sine4(x+i+24, vy, va, vs), avx2Sine4(x+i+28, vy, va, vs)));
+        __m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(pOut+i)), avx2Combine(s0, s1));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_AVX2 static void addSineAVX2UInt16(epicsUInt16 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m256d vy = _mm256_set1_pd(y), va = _mm256_set1_pd(a), vs = _mm256_set1_pd(scale);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i s0 = avx2Narrow32To16(avx2Sine4(x+i,   vy, va, vs), avx2Sine4(x+i+4,  vy, va, vs));
+        __m128i s1 = avx2Narrow32To16(avx2Sine4(x+i+8, vy, va, vs), avx2Sine4(x+i+12, vy, va, vs));
+        __m256i v = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(pOut+i)), avx2Combine(s0, s1));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_AVX2 static void addSineAVX2Float32(epicsFloat32 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    __m256d vy = _mm256_set1_pd(y), va = _mm256_set1_pd(a), vs = _mm256_set1_pd(scale);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        __m128 s0 = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_mul_pd(va, _mm256_add_pd(_mm256_loadu_pd(x+i),   vy)), vs));
+        __m128 s1 = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_mul_pd(va, _mm256_add_pd(_mm256_loadu_pd(x+i+4), vy)), vs));
+        __m256 s = _mm256_insertf128_ps(_mm256_castps128_ps256(s0), s1, 1);
+        _mm256_storeu_ps(pOut+i, _mm256_add_ps(_mm256_loadu_ps(pOut+i), s));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+SIM_TARGET_AVX2 static void addScaledAVX2UInt8(epicsUInt8 *pOut, const double *x, double a, size_t n)
+{
+    __m256d va = _mm256_set1_pd(a);
+    size_t i=0;
+    for (; i+32<=n; i+=32) {
+        __m128i s0 = avx2Narrow16To8(avx2Narrow32To16(avx2Scaled4(x+i,    va), avx2Scaled4(x+i+4,  va)),
+                                     avx2Narrow32To16(avx2Scaled4(x+i+8,  va), avx2Scaled4(x+i+12, va)));
+        __m128i s1 = avx2Narrow16To8(avx2Narrow32To16(avx2Scaled4(x+i+16, va), avx2Scaled4(x+i+20, va)),
+                                     avx2Narrow32To16(avx2Scaled4(x+i+24, va), avx2Scaled4(x+i+28, va)));
+        __m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(pOut+i)), avx2Combine(s0, s1));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+SIM_TARGET_AVX2 static void addScaledAVX2UInt16(epicsUInt16 *pOut, const double *x, double a, size_t n)
+{
+    __m256d va = _mm256_set1_pd(a);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i s0 = avx2Narrow32To16(avx2Scaled4(x+i,   va), avx2Scaled4(x+i+4,  va));
+        __m128i s1 = avx2Narrow32To16(avx2Scaled4(x+i+8, va), avx2Scaled4(x+i+12, va));
+        __m256i v = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(pOut+i)), avx2Combine(s0, s1));
+        _mm256_storeu_si256((__m256i *)(pOut+i), v);
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+SIM_TARGET_AVX2 static void addScaledAVX2Float32(epicsFloat32 *pOut, const double *x, double a, size_t n)
+{
+    __m256d va = _mm256_set1_pd(a);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        __m128 s0 = _mm256_cvtpd_ps(_mm256_mul_pd(va, _mm256_loadu_pd(x+i)));
+        __m128 s1 = _mm256_cvtpd_ps(_mm256_mul_pd(va, _mm256_loadu_pd(x+i+4)));
+        __m256 s = _mm256_insertf128_ps(_mm256_castps128_ps256(s0), s1, 1);
+        _mm256_storeu_ps(pOut+i, _mm256_add_ps(_mm256_loadu_ps(pOut+i), s));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+static const simKernels avx2Kernels = {
+    "AVX2",
+    addArrayAVX2UInt8, addArrayAVX2UInt16, addArrayAVX2Float32,
+    addConstantAVX2UInt8, addConstantAVX2UInt16, addConstantAVX2Float32,
+    addSineAVX2UInt8, addSineAVX2UInt16, addSineAVX2Float32,
+    addScaledAVX2UInt8, addScaledAVX2UInt16, addScaledAVX2Float32
+};
+#endif /* SIM_KERNELS_AVX2 */
+
+#ifdef SIM_KERNELS_NEON
+/* NEON kernels for AArch64.
+ * The scalar double to unsigned conversion on AArch64 saturates to 32 bits and then truncates.
+ * vcvtq_u64_f64 followed by vqmovn_u64 reproduces that. */
+
+static inline uint32x4_t neonToUInt32(float64x2_t v0, float64x2_t v1)
+{
+    return vcombine_u32(vqmovn_u64(vcvtq_u64_f64(v0)), vqmovn_u64(vcvtq_u64_f64(v1)));
+}
+
+static inline uint32x4_t neonSine4(const double *x, float64x2_t y, float64x2_t a, float64x2_t scale)
+{
+    float64x2_t v0 = vmulq_f64(vmulq_f64(a, vaddq_f64(vld1q_f64(x),   y)), scale);
+    float64x2_t v1 = vmulq_f64(vmulq_f64(a, vaddq_f64(vld1q_f64(x+2), y)), scale);
+    return neonToUInt32(v0, v1);
+}
+
+static inline uint32x4_t neonScaled4(const double *x, float64x2_t a)
+{
+    return neonToUInt32(vmulq_f64(a, vld1q_f64(x)), vmulq_f64(a, vld1q_f64(x+2)));
+}
+
+static inline uint16x8_t neonNarrow32To16(uint32x4_t lo, uint32x4_t hi)
+{
+    return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+}
+
+static inline uint8x16_t neonNarrow16To8(uint16x8_t lo, uint16x8_t hi)
+{
+    return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+}
+
+static void addArrayNEONUInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+16<=n; i+=16) vst1q_u8(pOut+i, vaddq_u8(vld1q_u8(pOut+i), vld1q_u8(pIn+i)));
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+static void addArrayNEONUInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+8<=n; i+=8) vst1q_u16(pOut+i, vaddq_u16(vld1q_u16(pOut+i), vld1q_u16(pIn+i)));
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+static void addArrayNEONFloat32(epicsFloat32 *pOut, const epicsFloat32 *pIn, size_t n)
+{
+    size_t i=0;
+    for (; i+4<=n; i+=4) vst1q_f32(pOut+i, vaddq_f32(vld1q_f32(pOut+i), vld1q_f32(pIn+i)));
+    simAddArrayLoop(pOut+i, pIn+i, n-i);
+}
+
+static void addConstantNEONUInt8(epicsUInt8 *pOut, const epicsUInt8 *pIn, epicsUInt8 value, size_t n)
+{
+    uint8x16_t c = vdupq_n_u8(value);
+    size_t i=0;
+    for (; i+16<=n; i+=16) vst1q_u8(pOut+i, vaddq_u8(vld1q_u8(pIn+i), c));
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+static void addConstantNEONUInt16(epicsUInt16 *pOut, const epicsUInt16 *pIn, epicsUInt16 value, size_t n)
+{
+    uint16x8_t c = vdupq_n_u16(value);
+    size_t i=0;
+    for (; i+8<=n; i+=8) vst1q_u16(pOut+i, vaddq_u16(vld1q_u16(pIn+i), c));
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+static void addConstantNEONFloat32(epicsFloat32 *pOut, const epicsFloat32 *pIn, epicsFloat32 value, size_t n)
+{
+    float32x4_t c = vdupq_n_f32(value);
+    size_t i=0;
+    for (; i+4<=n; i+=4) vst1q_f32(pOut+i, vaddq_f32(vld1q_f32(pIn+i), c));
+    simAddConstantLoop(pOut+i, pIn+i, value, n-i);
+}
+
+static void addSineNEONUInt8(epicsUInt8 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    float64x2_t vy = vdupq_n_f64(y), va = vdupq_n_f64(a), vs = vdupq_n_f64(scale);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        uint16x8_t lo = neonNarrow32To16(neonSine4(x+i,   vy, va, vs), neonSine4(x+i+4,  vy, va, vs));
+        uint16x8_t hi = neonNarrow32To16(neonSine4(x+i+8, vy, va, vs), neonSine4(x+i+12, vy, va, vs));
+        vst1q_u8(pOut+i, vaddq_u8(vld1q_u8(pOut+i), neonNarrow16To8(lo, hi)));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+static void addSineNEONUInt16(epicsUInt16 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    float64x2_t vy = vdupq_n_f64(y), va = vdupq_n_f64(a), vs = vdupq_n_f64(scale);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        uint16x8_t s = neonNarrow32To16(neonSine4(x+i, vy, va, vs), neonSine4(x+i+4, vy, va, vs));
+        vst1q_u16(pOut+i, vaddq_u16(vld1q_u16(pOut+i), s));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+static void addSineNEONFloat32(epicsFloat32 *pOut, const double *x, double y, double a, double scale, size_t n)
+{
+    float64x2_t vy = vdupq_n_f64(y), va = vdupq_n_f64(a), vs = vdupq_n_f64(scale);
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        float64x2_t v0 = vmulq_f64(vmulq_f64(va, vaddq_f64(vld1q_f64(x+i),   vy)), vs);
+        float64x2_t v1 = vmulq_f64(vmulq_f64(va, vaddq_f64(vld1q_f64(x+i+2), vy)), vs);
+        float32x4_t s = vcombine_f32(vcvt_f32_f64(v0), vcvt_f32_f64(v1));
+        vst1q_f32(pOut+i, vaddq_f32(vld1q_f32(pOut+i), s));
+    }
+    simAddSineLoop(pOut+i, x+i, y, a, scale, n-i);
+}
+
+static void addScaledNEONUInt8(epicsUInt8 *pOut, const double *x, double a, size_t n)
+{
+    float64x2_t va = vdupq_n_f64(a);
+    size_t i=0;
+    for (; i+16<=n; i+=16) {
+        uint16x8_t lo = neonNarrow32To16(neonScaled4(x+i,   va), neonScaled4(x+i+4,  va));
+        uint16x8_t hi = neonNarrow32To16(neonScaled4(x+i+8, va), neonScaled4(x+i+12, va));
+        vst1q_u8(pOut+i, vaddq_u8(vld1q_u8(pOut+i), neonNarrow16To8(lo, hi)));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+static void addScaledNEONUInt16(epicsUInt16 *pOut, const double *x, double a, size_t n)
+{
+    float64x2_t va = vdupq_n_f64(a);
+    size_t i=0;
+    for (; i+8<=n; i+=8) {
+        uint16x8_t s = neonNarrow32To16(neonScaled4(x+i, va), neonScaled4(x+i+4, va));
+        vst1q_u16(pOut+i, vaddq_u16(vld1q_u16(pOut+i), s));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+static void addScaledNEONFloat32(epicsFloat32 *pOut, const double *x, double a, size_t n)
+{
+    float64x2_t va = vdupq_n_f64(a);
+    size_t i=0;
+    for (; i+4<=n; i+=4) {
+        float32x4_t s = vcombine_f32(vcvt_f32_f64(vmulq_f64(va, vld1q_f64(x+i))),
+                                     vcvt_f32_f64(vmulq_f64(va, vld1q_f64(x+i+2))));
+        vst1q_f32(pOut+i, vaddq_f32(vld1q_f32(pOut+i), s));
+    }
+    simAddScaledLoop(pOut+i, x+i, a, n-i);
+}
+
+static const simKernels neonKernels = {
+    "NEON",
+    addArrayNEONUInt8, addArrayNEONUInt16, addArrayNEONFloat32,
+    addConstantNEONUInt8, addConstantNEONUInt16, addConstantNEONFloat32,
+    addSineNEONUInt8, addSineNEONUInt16, addSineNEONFloat32,
+    addScaledNEONUInt8, addScaledNEONUInt16, addScaledNEONFloat32
+};
+#endif /* SIM_KERNELS_NEON */
+
+const simKernels *simGetScalarKernels()
+{
+    return &scalarKernels;
+}
+
+const simKernels *simGetBestKernels()
+{
+#if defined(SIM_KERNELS_X86_RUNTIME)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &avx2Kernels;
+    if (__builtin_cpu_supports("sse2")) return &sse2Kernels;
+    return &scalarKernels;
+#elif defined(SIM_KERNELS_AVX2)
+    return &avx2Kernels;
+#elif defined(SIM_KERNELS_SSE2)
+    return &sse2Kernels;
+#elif defined(SIM_KERNELS_NEON)
+    return &neonKernels;
+#else
+    return &scalarKernels;
+#endif
+}
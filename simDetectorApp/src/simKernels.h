@@ -0,0 +1,105 @@
+/* simKernels.h
+ *
+ * Vectorised inner loops used by the simDetector driver.
+ * The instruction set is selected at run time; every kernel gives results identical to the scalar code.
+ *
+ */
+
+#ifndef SIM_KERNELS_H
+#define SIM_KERNELS_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+/** Table of kernels for one instruction set.
+  * addArray:    pOut[i] += pIn[i]
+  * addConstant: pOut[i] = pIn[i] + value, where pIn can be pOut
+  * addSine:     pOut[i] += (type)(a * (x[i] + y) * scale)
+  * addScaled:   pOut[i] += (type)(a * x[i])
+  */
+typedef struct simKernels {
+    const char *name;
+    void (*addArrayUInt8)   (epicsUInt8   *pOut, const epicsUInt8   *pIn, size_t n);
+    void (*addArrayUInt16)  (epicsUInt16  *pOut, const epicsUInt16  *pIn, size_t n);
+    void (*addArrayFloat32) (epicsFloat32 *pOut, const epicsFloat32 *pIn, size_t n);
+    void (*addConstantUInt8)   (epicsUInt8   *pOut, const epicsUInt8   *pIn, epicsUInt8   value, size_t n);
+    void (*addConstantUInt16)  (epicsUInt16  *pOut, const epicsUInt16  *pIn, epicsUInt16  value, size_t n);
+    void (*addConstantFloat32) (epicsFloat32 *pOut, const epicsFloat32 *pIn, epicsFloat32 value, size_t n);
+    void (*addSineUInt8)   (epicsUInt8   *pOut, const double *x, double y, double a, double scale, size_t n);
+    void (*addSineUInt16)  (epicsUInt16  *pOut, const double *x, double y, double a, double scale, size_t n);
+    void (*addSineFloat32) (epicsFloat32 *pOut, const double *x, double y, double a, double scale, size_t n);
+    void (*addScaledUInt8)   (epicsUInt8   *pOut, const double *x, double a, size_t n);
+    void (*addScaledUInt16)  (epicsUInt16  *pOut, const double *x, double a, size_t n);
+    void (*addScaledFloat32) (epicsFloat32 *pOut, const double *x, double a, size_t n);
+} simKernels;
+
+/** Returns the scalar kernels */
+const simKernels *simGetScalarKernels();
+/** Returns the fastest kernels supported by this CPU */
+const simKernels *simGetBestKernels();
+
+/* Scalar loops, used by the scalar kernels and for the tails of the vectorised ones */
+template <typename epicsType> inline void simAddArrayLoop(epicsType *pOut, const epicsType *pIn, size_t n)
+{
+    size_t i;
+    for (i=0; i<n; i++) pOut[i] += pIn[i];
+}
+
+template <typename epicsType> inline void simAddConstantLoop(epicsType *pOut, const epicsType *pIn, epicsType value, size_t n)
+{
+    size_t i;
+    for (i=0; i<n; i++) pOut[i] = pIn[i] + value;
+}
+
+template <typename epicsType> inline void simAddSineLoop(epicsType *pOut, const double *x, double y,
+                                                         double a, double scale, size_t n)
+{
+    size_t i;
+    for (i=0; i<n; i++) pOut[i] += (epicsType)(a * (x[i] + y) * scale);
+}
+
+template <typename epicsType> inline void simAddScaledLoop(epicsType *pOut, const double *x, double a, size_t n)
+{
+    size_t i;
+    for (i=0; i<n; i++) pOut[i] += (epicsType)(a * x[i]);
+}
+
+/* Generic versions used for the data types that do not have vectorised kernels */
+template <typename epicsType> inline void simAddArray(const simKernels *, epicsType *pOut, const epicsType *pIn, size_t n)
+    { simAddArrayLoop(pOut, pIn, n); }
+template <typename epicsType> inline void simAddConstant(const simKernels *, epicsType *pOut, const epicsType *pIn,
+                                                         epicsType value, size_t n)
+    { simAddConstantLoop(pOut, pIn, value, n); }
+template <typename epicsType> inline void simAddSine(const simKernels *, epicsType *pOut, const double *x, double y,
+                                                     double a, double scale, size_t n)
+    { simAddSineLoop(pOut, x, y, a, scale, n); }
+template <typename epicsType> inline void simAddScaled(const simKernels *, epicsType *pOut, const double *x, double a, size_t n)
+    { simAddScaledLoop(pOut, x, a, n); }
+
+/* Overloads for the data types with vectorised kernels */
+inline void simAddArray(const simKernels *pK, epicsUInt8 *pOut, const epicsUInt8 *pIn, size_t n)
+    { pK->addArrayUInt8(pOut, pIn, n); }
+inline void simAddArray(const simKernels *pK, epicsUInt16 *pOut, const epicsUInt16 *pIn, size_t n)
+    { pK->addArrayUInt16(pOut, pIn, n); }
+inline void simAddArray(const simKernels *pK, epicsFloat32 *pOut, const epicsFloat32 *pIn, size_t n)
+    { pK->addArrayFloat32(pOut, pIn, n); }
+inline void simAddConstant(const simKernels *pK, epicsUInt8 *pOut, const epicsUInt8 *pIn, epicsUInt8 value, size_t n)
+    { pK->addConstantUInt8(pOut, pIn, value, n); }
+inline void simAddConstant(const simKernels *pK, epicsUInt16 *pOut, const epicsUInt16 *pIn, epicsUInt16 value, size_t n)
+    { pK->addConstantUInt16(pOut, pIn, value, n); }
+inline void simAddConstant(const simKernels *pK, epicsFloat32 *pOut, const epicsFloat32 *pIn, epicsFloat32 value, size_t n)
+    { pK->addConstantFloat32(pOut, pIn, value, n); }
+inline void simAddSine(const simKernels *pK, epicsUInt8 *pOut, const double *x, double y, double a, double scale, size_t n)
+    { pK->addSineUInt8(pOut, x, y, a, scale, n); }
+inline void simAddSine(const simKernels *pK, epicsUInt16 *pOut, const double *x, double y, double a, double scale, size_t n)
+    { pK->addSineUInt16(pOut, x, y, a, scale, n); }
+inline void simAddSine(const simKernels *pK, epicsFloat32 *pOut, const double *x, double y, double a, double scale, size_t n)
+    { pK->addSineFloat32(pOut, x, y, a, scale, n); }
+inline void simAddScaled(const simKernels *pK, epicsUInt8 *pOut, const double *x, double a, size_t n)
+    { pK->addScaledUInt8(pOut, x, a, n); }
+inline void simAddScaled(const simKernels *pK, epicsUInt16 *pOut, const double *x, double a, size_t n)
+    { pK->addScaledUInt16(pOut, x, a, n); }
+inline void simAddScaled(const simKernels *pK, epicsFloat32 *pOut, const double *x, double a, size_t n)
+    { pK->addScaledFloat32(pOut, x, a, n); }
+
+#endif
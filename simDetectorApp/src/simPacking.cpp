@@ -0,0 +1,234 @@
+/* simPacking.cpp
+ *
+ * Low bit depth and packed pixel formats for the simDetector driver.
+ *
+ */
+
+#include <stddef.h>
+
+#include <limits>
+
+#include <epicsTypes.h>
+
+#include "simPacking.h"
+
+/** Returns the largest value of bitDepth bits */
+static epicsUInt32 maxValueOf(int bitDepth)
+{
+    return (bitDepth >= 32) ? 0xffffffffu : ((epicsUInt32)1 << bitDepth) - 1;
+}
+
+/** Clips a value to [0, maxValue], rounding floating point values to the nearest integer */
+template <typename epicsType> static inline epicsUInt32 clipElement(epicsType value, epicsUInt32 maxValue)
+{
+    if (std::numeric_limits<epicsType>::is_integer) {
+        if (!(value > 0)) return 0;
+        if ((epicsUInt64)value >= maxValue) return maxValue;
+        return (epicsUInt32)value;
+    }
+    /* NaN is clipped to 0 */
+    if (!(value > 0)) return 0;
+    if ((double)value + 0.5 >= (double)maxValue) return maxValue;
+    return (epicsUInt32)((double)value + 0.5);
+}
+
+NDDataType_t simContainerType(int bitDepth)
+{
+    if (bitDepth <= 8)  return NDUInt8;
+    if (bitDepth <= 16) return NDUInt16;
+    return NDUInt32;
+}
+
+size_t simPackedRowBytes(size_t numElements, int bitDepth)
+{
+    return (numElements * bitDepth + 7) / 8;
+}
+
+template <typename epicsType, typename containerType>
+static void clipElementsT(const epicsType *pIn, size_t numElements, int bitDepth, containerType *pOut)
+{
+    epicsUInt32 maxValue = maxValueOf(bitDepth);
+    size_t i;
+
+    for (i=0; i<numElements; i++) pOut[i] = (containerType)clipElement(pIn[i], maxValue);
+}
+
+template <typename epicsType> static void clipElementsT(const epicsType *pIn, size_t numElements, int bitDepth, void *pOut)
+{
+    switch (simContainerType(bitDepth)) {
+        case NDUInt8:
+            clipElementsT(pIn, numElements, bitDepth, (epicsUInt8 *)pOut);
+            break;
+        case NDUInt16:
+            clipElementsT(pIn, numElements, bitDepth, (epicsUInt16 *)pOut);
+            break;
+        default:
+            clipElementsT(pIn, numElements, bitDepth, (epicsUInt32 *)pOut);
+            break;
+    }
+}
+
+void simClipElements(const void *pIn, NDDataType_t dataType, size_t numElements, int bitDepth, void *pOut)
+{
+    switch (dataType) {
+        case NDInt8:
+            clipElementsT((const epicsInt8 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDUInt8:
+            clipElementsT((const epicsUInt8 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDInt16:
+            clipElementsT((const epicsInt16 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDUInt16:
+            clipElementsT((const epicsUInt16 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDInt32:
+            clipElementsT((const epicsInt32 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDUInt32:
+            clipElementsT((const epicsUInt32 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDInt64:
+            clipElementsT((const epicsInt64 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDUInt64:
+            clipElementsT((const epicsUInt64 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDFloat32:
+            clipElementsT((const epicsFloat32 *)pIn, numElements, bitDepth, pOut);
+            break;
+        case NDFloat64:
+            clipElementsT((const epicsFloat64 *)pIn, numElements, bitDepth, pOut);
+            break;
+    }
+}
+
+template <typename epicsType>
+static void packRowsT(const epicsType *pIn, size_t rowElements, size_t numRows, int bitDepth, epicsUInt8 *pOut)
+{
+    epicsUInt32 maxValue = maxValueOf(bitDepth);
+    size_t rowBytes = simPackedRowBytes(rowElements, bitDepth);
+    size_t row, i;
+
+    for (row=0; row<numRows; row++) {
+        const epicsType *pRow = pIn + row * rowElements;
+        epicsUInt8 *pDest = pOut + row * rowBytes;
+        if (bitDepth == 12) {
+            /* The most common packed format: two elements in 3 bytes */
+            for (i=0; i+1<rowElements; i+=2) {
+                epicsUInt32 first  = clipElement(pRow[i], maxValue);
+                epicsUInt32 second = clipElement(pRow[i+1], maxValue);
+                pDest[0] = (epicsUInt8)first;
+                pDest[1] = (epicsUInt8)((first >> 8) | (second << 4));
+                pDest[2] = (epicsUInt8)(second >> 4);
+                pDest += 3;
+            }
+            if (i < rowElements) {
+                epicsUInt32 first = clipElement(pRow[i], maxValue);
+                pDest[0] = (epicsUInt8)first;
+                pDest[1] = (epicsUInt8)(first >> 8);
+            }
+        } else {
+            /* At most 7 bits are left over from the previous element, so 64 bits hold them and the next one */
+            epicsUInt64 bits = 0;
+            int numBits = 0;
+            for (i=0; i<rowElements; i++) {
+                bits |= (epicsUInt64)clipElement(pRow[i], maxValue) << numBits;
+                numBits += bitDepth;
+                while (numBits >= 8) {
+                    *pDest++ = (epicsUInt8)bits;
+                    bits >>= 8;
+                    numBits -= 8;
+                }
+            }
+            if (numBits > 0) *pDest = (epicsUInt8)bits;
+        }
+    }
+}
+
+void simPackRows(const void *pIn, NDDataType_t dataType, size_t rowElements, size_t numRows, int bitDepth,
+                 epicsUInt8 *pOut)
+{
+    switch (dataType) {
+        case NDInt8:
+            packRowsT((const epicsInt8 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDUInt8:
+            packRowsT((const epicsUInt8 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDInt16:
+            packRowsT((const epicsInt16 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDUInt16:
+            packRowsT((const epicsUInt16 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDInt32:
+            packRowsT((const epicsInt32 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDUInt32:
+            packRowsT((const epicsUInt32 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDInt64:
+            packRowsT((const epicsInt64 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDUInt64:
+            packRowsT((const epicsUInt64 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDFloat32:
+            packRowsT((const epicsFloat32 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+        case NDFloat64:
+            packRowsT((const epicsFloat64 *)pIn, rowElements, numRows, bitDepth, pOut);
+            break;
+    }
+}
+
+template <typename containerType>
+static void unpackRowsT(const epicsUInt8 *pIn, size_t rowElements, size_t numRows, int bitDepth, containerType *pOut)
+{
+    epicsUInt32 mask = maxValueOf(bitDepth);
+    size_t rowBytes = simPackedRowBytes(rowElements, bitDepth);
+    size_t row, i;
+
+    for (row=0; row<numRows; row++) {
+        const epicsUInt8 *pSrc = pIn + row * rowBytes;
+        containerType *pRow = pOut + row * rowElements;
+        if (bitDepth == 12) {
+            for (i=0; i+1<rowElements; i+=2) {
+                pRow[i]   = (containerType)(pSrc[0] | ((pSrc[1] & 0x0f) << 8));
+                pRow[i+1] = (containerType)((pSrc[1] >> 4) | (pSrc[2] << 4));
+                pSrc += 3;
+            }
+            if (i < rowElements) pRow[i] = (containerType)(pSrc[0] | ((pSrc[1] & 0x0f) << 8));
+        } else {
+            /* Only the bytes holding bits of the row are read */
+            epicsUInt64 bits = 0;
+            int numBits = 0;
+            for (i=0; i<rowElements; i++) {
+                while (numBits < bitDepth) {
+                    bits |= (epicsUInt64)*pSrc++ << numBits;
+                    numBits += 8;
+                }
+                pRow[i] = (containerType)(bits & mask);
+                bits >>= bitDepth;
+                numBits -= bitDepth;
+            }
+        }
+    }
+}
+
+void simUnpackRows(const epicsUInt8 *pIn, size_t rowElements, size_t numRows, int bitDepth, void *pOut)
+{
+    switch (simContainerType(bitDepth)) {
+        case NDUInt8:
+            unpackRowsT(pIn, rowElements, numRows, bitDepth, (epicsUInt8 *)pOut);
+            break;
+        case NDUInt16:
+            unpackRowsT(pIn, rowElements, numRows, bitDepth, (epicsUInt16 *)pOut);
+            break;
+        default:
+            unpackRowsT(pIn, rowElements, numRows, bitDepth, (epicsUInt32 *)pOut);
+            break;
+    }
+}
@@ -0,0 +1,52 @@
+/* simPacking.h
+ *
+ * Low bit depth and packed pixel formats for the simDetector driver.
+ *
+ * A packed row is a stream of bitDepth-bit elements, least significant bit first, as in the GenICam Mono12p
+ * format; with bitDepth=12 two elements take 3 bytes.  Each row starts on a byte boundary, so rows can be
+ * packed and unpacked independently.
+ *
+ */
+
+#ifndef SIM_PACKING_H
+#define SIM_PACKING_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+#include "NDArray.h"
+
+/** The largest bit depth which can be packed */
+#define SIM_MAX_BIT_DEPTH 32
+
+/** Names of the NDAttributes of the frames with a bit depth; the packed frames have all three */
+#define SimAttrBitDepth       "SimBitDepth"
+#define SimAttrPackedElements "SimPackedElements"
+#define SimAttrPackedDataType "SimPackedDataType"
+
+/** Returns the smallest unsigned data type which holds bitDepth bits */
+NDDataType_t simContainerType(int bitDepth);
+
+/** Returns the size in bytes of the smallest unsigned data type which holds bitDepth bits */
+inline size_t simContainerSize(int bitDepth)
+{
+    return (bitDepth <= 8) ? 1 : ((bitDepth <= 16) ? 2 : 4);
+}
+
+/** Returns the number of bytes of a row of numElements elements packed with bitDepth bits each */
+size_t simPackedRowBytes(size_t numElements, int bitDepth);
+
+/** Clips the elements of an array to bitDepth bits, rounding floating point values, and stores them in the
+  * container type of bitDepth.  Negative values become 0 and values above 2^bitDepth-1 become 2^bitDepth-1,
+  * as for an ADC. */
+void simClipElements(const void *pIn, NDDataType_t dataType, size_t numElements, int bitDepth, void *pOut);
+
+/** Clips the elements of numRows rows of rowElements elements to bitDepth bits, as simClipElements() does,
+  * and packs each row into simPackedRowBytes(rowElements, bitDepth) bytes. */
+void simPackRows(const void *pIn, NDDataType_t dataType, size_t rowElements, size_t numRows, int bitDepth,
+                 epicsUInt8 *pOut);
+
+/** Unpacks rows packed by simPackRows() into the container type of bitDepth */
+void simUnpackRows(const epicsUInt8 *pIn, size_t rowElements, size_t numRows, int bitDepth, void *pOut);
+
+#endif
@@ -0,0 +1,136 @@
+/* simRandom.cpp
+ *
+ * Counter-based random number generator for the simDetector driver.
+ *
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include <epicsTypes.h>
+
+#include "simRandom.h"
+
+/* Number of blocks computed together by fillUniform(); the lanes are independent so the compiler can vectorise them */
+#define SIM_RANDOM_LANES 8
+
+/** Constructor for simRandom
+  * \param[in] seed The seed; the same seed always gives the same values.
+  * \param[in] stream The stream number; each stream is an independent sequence for the same seed.
+  */
+simRandom::simRandom(epicsUInt64 seed, epicsUInt64 stream)
+{
+    setSeed(seed, stream);
+}
+
+/** Sets the seed and the stream, and moves to the start of the stream */
+void simRandom::setSeed(epicsUInt64 seed, epicsUInt64 stream)
+{
+    key_[0] = (epicsUInt32)seed;
+    key_[1] = (epicsUInt32)(seed >> 32);
+    stream_ = stream;
+    skipTo(0);
+}
+
+/** Moves to value number index of the stream */
+void simRandom::skipTo(epicsUInt64 index)
+{
+    block_ = index / 4;
+    refill();
+    numUsed_ = (int)(index % 4);
+}
+
+void simRandom::refill()
+{
+    epicsUInt32 counter[4];
+
+    counter[0] = (epicsUInt32)block_;
+    counter[1] = (epicsUInt32)(block_ >> 32);
+    counter[2] = (epicsUInt32)stream_;
+    counter[3] = (epicsUInt32)(stream_ >> 32);
+    philox(key_, counter, values_);
+    block_++;
+    numUsed_ = 0;
+}
+
+/** Converts a 32-bit random value to a standard normal value by inverting the normal cumulative distribution.
+  * This uses the rational approximation of P. J. Acklam, which has a relative error below 1.2e-9.
+  * It needs only one random value, and no transcendental functions except in the tails (5% of values). */
+double simRandom::toNormal(epicsUInt32 value)
+{
+    static const double a[] = {-3.969683028665376e+01,  2.209460984245205e+02, -2.759285104469687e+02,
+                                1.383577518672690e+02, -3.066479806614716e+01,  2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01,  1.615858368580409e+02, -1.556989798598866e+02,
+                                6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00,  4.374664141464968e+00,  2.938163982698783e+00};
+    static const double d[] = { 7.784695709041462e-03,  3.224671290700398e-01,  2.445134137142996e+00,
+                                3.754408661907416e+00};
+    const double pLow = 0.02425;
+    /* Strictly inside (0, 1) */
+    double p = (value + 0.5) * (1.0 / 4294967296.0);
+    double q, r;
+
+    if (p < pLow) {
+        q = sqrt(-2. * log(p));
+        return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+               ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.);
+    }
+    if (p > 1. - pLow) {
+        q = sqrt(-2. * log(1. - p));
+        return -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+                ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.);
+    }
+    q = p - 0.5;
+    r = q * q;
+    return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5]) * q /
+           (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1.);
+}
+
+/** Fills a buffer with the next n values of the stream, uniformly distributed in [0, 1).
+  * This gives the same values as calling uniform() n times, but computes several blocks at once. */
+void simRandom::fillUniform(double *pOut, size_t n)
+{
+    const double scale = 1.0 / 4294967296.0;
+    epicsUInt32 c0[SIM_RANDOM_LANES], c1[SIM_RANDOM_LANES], c2[SIM_RANDOM_LANES], c3[SIM_RANDOM_LANES];
+    epicsUInt32 k0, k1;
+    size_t i=0;
+    int lane, round;
+
+    /* Use up the current block */
+    while ((i < n) && (numUsed_ < 4)) pOut[i++] = uniform();
+
+    /* numUsed_ is now 4 so block_ is the next block to compute */
+    while (i + 4*SIM_RANDOM_LANES <= n) {
+        for (lane=0; lane<SIM_RANDOM_LANES; lane++) {
+            epicsUInt64 block = block_ + lane;
+            c0[lane] = (epicsUInt32)block;
+            c1[lane] = (epicsUInt32)(block >> 32);
+            c2[lane] = (epicsUInt32)stream_;
+            c3[lane] = (epicsUInt32)(stream_ >> 32);
+        }
+        k0 = key_[0];
+        k1 = key_[1];
+        for (round=0; round<SIM_PHILOX_ROUNDS; round++) {
+            for (lane=0; lane<SIM_RANDOM_LANES; lane++) {
+                epicsUInt64 p0 = (epicsUInt64)SIM_PHILOX_M0 * c0[lane];
+                epicsUInt64 p1 = (epicsUInt64)SIM_PHILOX_M1 * c2[lane];
+                c0[lane] = (epicsUInt32)(p1 >> 32) ^ c1[lane] ^ k0;
+                c1[lane] = (epicsUInt32)p1;
+                c2[lane] = (epicsUInt32)(p0 >> 32) ^ c3[lane] ^ k1;
+                c3[lane] = (epicsUInt32)p0;
+            }
+            k0 += SIM_PHILOX_W0;
+            k1 += SIM_PHILOX_W1;
+        }
+        for (lane=0; lane<SIM_RANDOM_LANES; lane++) {
+            pOut[i++] = c0[lane] * scale;
+            pOut[i++] = c1[lane] * scale;
+            pOut[i++] = c2[lane] * scale;
+            pOut[i++] = c3[lane] * scale;
+        }
+        block_ += SIM_RANDOM_LANES;
+    }
+
+    while (i < n) pOut[i++] = uniform();
+}
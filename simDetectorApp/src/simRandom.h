@@ -0,0 +1,102 @@
+/* simRandom.h
+ *
+ * Counter-based random number generator for the simDetector driver.
+ *
+ * This is the Philox4x32-10 generator of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11.
+ * Value n of a stream is a function of (seed, stream, n) only: a thread can start anywhere in the stream,
+ * and filling a buffer in parallel bands gives the same result as filling it serially.
+ * Each simRandom object must only be used by one thread at a time, but every thread can have its own.
+ *
+ */
+
+#ifndef SIM_RANDOM_H
+#define SIM_RANDOM_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+/** Streams used by the driver; different streams with the same seed are independent */
+typedef enum {
+    SimRandomStreamFrame,      /**< Values drawn serially once per frame */
+    SimRandomStreamBackground, /**< The background noise image, indexed by element */
+    SimRandomStreamNoise,      /**< Per-frame noise, indexed by element; frame n uses stream SimRandomStreamNoise + 2*n */
+    SimRandomStreamReadNoise   /**< Per-frame read noise, indexed by row; frame n uses stream SimRandomStreamReadNoise + 2*n */
+} SimRandomStream_t;
+
+class simRandom {
+public:
+    simRandom(epicsUInt64 seed=0, epicsUInt64 stream=0);
+    void setSeed(epicsUInt64 seed, epicsUInt64 stream=0);
+    void skipTo(epicsUInt64 index);
+    inline epicsUInt32 next();
+    inline double uniform();
+    void fillUniform(double *pOut, size_t n);
+    static inline double toUniform(epicsUInt32 value);
+    static inline double toUniformPositive(epicsUInt32 value);
+    static double toNormal(epicsUInt32 value);
+    static inline void philox(const epicsUInt32 key[2], const epicsUInt32 counter[4], epicsUInt32 out[4]);
+
+private:
+    void refill();
+    epicsUInt32 key_[2];
+    epicsUInt64 stream_;
+    epicsUInt64 block_;        /* Index of the next block of 4 values to generate */
+    epicsUInt32 values_[4];
+    int numUsed_;
+};
+
+#define SIM_PHILOX_M0 0xD2511F53U
+#define SIM_PHILOX_M1 0xCD9E8D57U
+#define SIM_PHILOX_W0 0x9E3779B9U
+#define SIM_PHILOX_W1 0xBB67AE85U
+#define SIM_PHILOX_ROUNDS 10
+
+/** Computes one block of 4 random values from the key and the counter */
+inline void simRandom::philox(const epicsUInt32 key[2], const epicsUInt32 counter[4], epicsUInt32 out[4])
+{
+    epicsUInt32 c0=counter[0], c1=counter[1], c2=counter[2], c3=counter[3];
+    epicsUInt32 k0=key[0], k1=key[1];
+    int round;
+
+    for (round=0; round<SIM_PHILOX_ROUNDS; round++) {
+        epicsUInt64 p0 = (epicsUInt64)SIM_PHILOX_M0 * c0;
+        epicsUInt64 p1 = (epicsUInt64)SIM_PHILOX_M1 * c2;
+        c0 = (epicsUInt32)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (epicsUInt32)p1;
+        c2 = (epicsUInt32)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (epicsUInt32)p0;
+        k0 += SIM_PHILOX_W0;
+        k1 += SIM_PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/** Converts a 32-bit random value to a double uniformly distributed in [0, 1) */
+inline double simRandom::toUniform(epicsUInt32 value)
+{
+    return value * (1.0 / 4294967296.0);
+}
+
+/** Converts a 32-bit random value to a double uniformly distributed in (0, 1], which can be passed to log() */
+inline double simRandom::toUniformPositive(epicsUInt32 value)
+{
+    return (value + 1.0) * (1.0 / 4294967296.0);
+}
+
+/** Returns the next 32-bit random value of the stream */
+inline epicsUInt32 simRandom::next()
+{
+    if (numUsed_ >= 4) refill();
+    return values_[numUsed_++];
+}
+
+/** Returns the next random value of the stream as a double uniformly distributed in [0, 1) */
+inline double simRandom::uniform()
+{
+    return toUniform(next());
+}
+
+#endif
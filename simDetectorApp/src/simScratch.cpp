@@ -0,0 +1,68 @@
+/* simScratch.cpp
+ *
+ * Scratch buffers owned by the simDetector driver.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "simScratch.h"
+
+/** Constructor for simScratchArena; no memory is allocated until alloc() is called.
+  * \param[in] numBuffers The number of buffers. */
+simScratchArena::simScratchArena(int numBuffers)
+    : numBuffers_(numBuffers)
+{
+    buffers_ = (simScratchBuffer_t *)calloc(numBuffers, sizeof(simScratchBuffer_t));
+}
+
+simScratchArena::~simScratchArena()
+{
+    int i;
+
+    for (i=0; i<numBuffers_; i++) free(i);
+    ::free(buffers_);
+}
+
+/** Makes a buffer at least size bytes long.
+  * \param[in] buffer The number of the buffer.
+  * \param[in] size The size in bytes.
+  * \return The start of the buffer, or NULL if it cannot be allocated. */
+void *simScratchArena::alloc(int buffer, size_t size)
+{
+    simScratchBuffer_t *pBuffer = &buffers_[buffer];
+    size_t address;
+
+    /* Keep the buffer unless it is too small, or at least twice as large as needed */
+    if (pBuffer->pData && (size <= pBuffer->size) && (size > pBuffer->size / 2)) return pBuffer->pData;
+    free(buffer);
+    if (size == 0) return NULL;
+    pBuffer->pBlock = malloc(size + SIM_SCRATCH_ALIGN - 1);
+    if (!pBuffer->pBlock) return NULL;
+    address = (size_t)pBuffer->pBlock;
+    address = (address + SIM_SCRATCH_ALIGN - 1) & ~(size_t)(SIM_SCRATCH_ALIGN - 1);
+    pBuffer->pData = (void *)address;
+    pBuffer->size = size;
+    return pBuffer->pData;
+}
+
+/** Frees a buffer which is no longer needed */
+void simScratchArena::free(int buffer)
+{
+    simScratchBuffer_t *pBuffer = &buffers_[buffer];
+
+    ::free(pBuffer->pBlock);
+    pBuffer->pBlock = NULL;
+    pBuffer->pData = NULL;
+    pBuffer->size = 0;
+}
+
+/** Returns the total size of the buffers in bytes */
+size_t simScratchArena::totalSize() const
+{
+    size_t total = 0;
+    int i;
+
+    for (i=0; i<numBuffers_; i++) total += buffers_[i].size;
+    return total;
+}
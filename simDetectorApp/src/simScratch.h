@@ -0,0 +1,40 @@
+/* simScratch.h
+ *
+ * Scratch buffers owned by the simDetector driver.
+ *
+ */
+
+#ifndef SIM_SCRATCH_H
+#define SIM_SCRATCH_H
+
+#include <stddef.h>
+
+/** Alignment of the scratch buffers in bytes, a cache line */
+#define SIM_SCRATCH_ALIGN 64
+
+/** A fixed number of scratch buffers, each of which is allocated when it is first needed with the size it needs.
+  * A buffer is only reallocated when it is too small, or much larger than needed.
+  * The contents of a buffer are not preserved when it is reallocated.
+  * The methods are not thread safe, the caller must serialize them. */
+class simScratchArena {
+public:
+    simScratchArena(int numBuffers);
+    ~simScratchArena();
+    void *alloc(int buffer, size_t size);
+    void free(int buffer);
+    void *data(int buffer) const { return buffers_[buffer].pData; }
+    size_t size(int buffer) const { return buffers_[buffer].size; }
+    size_t totalSize() const;
+
+private:
+    typedef struct {
+        void *pBlock;          /**< The memory from malloc() */
+        void *pData;           /**< The aligned start of the buffer in pBlock */
+        size_t size;           /**< The size of the buffer in bytes */
+    } simScratchBuffer_t;
+
+    int numBuffers_;
+    simScratchBuffer_t *buffers_;
+};
+
+#endif
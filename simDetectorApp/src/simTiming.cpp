@@ -0,0 +1,93 @@
+/* simTiming.cpp
+ *
+ * Timing statistics for the stages of the simDetector frame pipeline.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#include <epicsTime.h>
+
+#include "simTiming.h"
+
+simTimer::simTimer()
+{
+    reset();
+}
+
+/** Discards all the times recorded so far */
+void simTimer::reset()
+{
+    last_ = 0.;
+    sum_ = 0.;
+    max_ = 0.;
+    count_ = 0;
+    memset(histogram_, 0, sizeof(histogram_));
+    startTime_ = simMonotonicNs();
+}
+
+/** Marks the start of the stage */
+void simTimer::start()
+{
+    startTime_ = simMonotonicNs();
+}
+
+/** Marks the end of the stage and records the time since start() */
+void simTimer::stop()
+{
+    epicsUInt64 now = simMonotonicNs();
+
+    /* The fallback clock of simMonotonicNs() can go backwards */
+    add((now > startTime_) ? (now - startTime_) * 1e-9 : 0.);
+}
+
+/** Records the time taken by the stage */
+void simTimer::add(double seconds)
+{
+    int exponent;
+    int bin = 0;
+
+    if (seconds < 0.) seconds = 0.;
+    last_ = seconds;
+    sum_ += seconds;
+    if (seconds > max_) max_ = seconds;
+    count_++;
+    /* frexp gives 2^(exponent-1) <= us < 2^exponent */
+    if (seconds >= 2e-6) {
+        frexp(seconds * 1e6, &exponent);
+        bin = exponent - 1;
+        if (bin >= SIM_TIMING_BINS) bin = SIM_TIMING_BINS - 1;
+    }
+    histogram_[bin]++;
+}
+
+epicsUInt64 simMonotonicNs()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (epicsUInt64)(counter.QuadPart / frequency.QuadPart) * 1000000000u +
+           (epicsUInt64)(counter.QuadPart % frequency.QuadPart) * 1000000000u / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (epicsUInt64)now.tv_sec * 1000000000u + now.tv_nsec;
+#else
+    /* The wall clock, which can go backwards if it is set */
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    return (epicsUInt64)now.secPastEpoch * 1000000000u + now.nsec;
+#endif
+}
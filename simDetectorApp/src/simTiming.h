@@ -0,0 +1,50 @@
+/* simTiming.h
+ *
+ * Timing statistics for the stages of the simDetector frame pipeline.
+ *
+ */
+
+#ifndef SIM_TIMING_H
+#define SIM_TIMING_H
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+/** Number of bins of the histogram; bin 0 counts times below 2 us, bin n times from 2^n to 2^(n+1) us,
+  * and the last bin all longer times */
+#define SIM_TIMING_BINS 24
+
+/** Statistics of the time taken by one stage: the last, mean and maximum times and a histogram.
+  * The methods are not thread safe, the caller must serialize them. */
+class simTimer {
+public:
+    simTimer();
+    void reset();
+    void start();
+    void stop();
+    void add(double seconds);
+    double last() const { return last_; }
+    double mean() const { return count_ ? sum_ / count_ : 0.; }
+    double max() const { return max_; }
+    epicsUInt32 count() const { return count_; }
+    epicsInt32 *histogram() { return histogram_; }
+
+private:
+    epicsUInt64 startTime_;  /**< simMonotonicNs() at start(), so the times are not affected by setting the clock */
+    double last_;
+    double sum_;
+    double max_;
+    epicsUInt32 count_;
+    epicsInt32 histogram_[SIM_TIMING_BINS];
+};
+
+/** Names of the NDAttributes with the monotonic times, in ns, at which a frame was generated and published */
+#define SimAttrGenerateStart "SimGenerateStart"
+#define SimAttrGenerateEnd   "SimGenerateEnd"
+#define SimAttrPublish       "SimPublish"
+
+/** Returns a monotonic time in nanoseconds, from an arbitrary origin which is the same for all the threads of
+  * the process, so differences between the times taken by different threads are meaningful. */
+epicsUInt64 simMonotonicNs();
+
+#endif
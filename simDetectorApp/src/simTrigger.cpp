@@ -0,0 +1,227 @@
+/* simTrigger.cpp
+ *
+ * Trigger sources shared by the simDetector drivers of an IOC, which emulate an external timing system.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsString.h>
+#include <epicsStdio.h>
+
+#include "simTrigger.h"
+
+/* All the sources, protected by sourcesMutex */
+static simTriggerSource *pSources = 0;
+static epicsMutexId sourcesMutex = 0;
+static epicsThreadOnceId sourcesOnce = EPICS_THREAD_ONCE_INIT;
+
+static void createSourcesMutex(void *)
+{
+    sourcesMutex = epicsMutexMustCreate();
+}
+
+static void timerTaskC(void *pvt)
+{
+    simTriggerSource *pSource = (simTriggerSource *)pvt;
+
+    pSource->timerTask();
+}
+
+simTriggerSource::simTriggerSource(const char *name)
+    : subscribers_(0), numSubscribers_(0), count_(0), gate_(false), period_(0.), timerStarted_(false), pNext_(0)
+{
+    name_ = epicsStrDup(name);
+    mutex_ = epicsMutexMustCreate();
+    wakeEvent_ = epicsEventMustCreate(epicsEventEmpty);
+    epicsTimeGetCurrent(&time_);
+}
+
+/** Finds the source with a name, creating it if it does not exist yet.
+  * \param[in] name The name of the source. */
+simTriggerSource *simTriggerSource::find(const char *name)
+{
+    simTriggerSource *pSource;
+
+    if (!name) name = "";
+    epicsThreadOnce(&sourcesOnce, createSourcesMutex, 0);
+    epicsMutexLock(sourcesMutex);
+    for (pSource=pSources; pSource; pSource=pSource->pNext_) {
+        if (strcmp(pSource->name_, name) == 0) break;
+    }
+    if (!pSource) {
+        pSource = new simTriggerSource(name);
+        pSource->pNext_ = pSources;
+        pSources = pSource;
+    }
+    epicsMutexUnlock(sourcesMutex);
+    return pSource;
+}
+
+/** Adds an event which is signalled on every edge and every change of the gate.
+  * \param[in] event The event. */
+void simTriggerSource::subscribe(epicsEventId event)
+{
+    epicsEventId *subscribers;
+
+    epicsMutexLock(mutex_);
+    subscribers = (epicsEventId *)realloc(subscribers_, (numSubscribers_ + 1) * sizeof(epicsEventId));
+    if (subscribers) {
+        subscribers_ = subscribers;
+        subscribers_[numSubscribers_++] = event;
+    } else {
+        printf("simTriggerSource:subscribe: unable to subscribe to %s\n", name_);
+    }
+    epicsMutexUnlock(mutex_);
+}
+
+void simTriggerSource::unsubscribe(epicsEventId event)
+{
+    int i;
+
+    epicsMutexLock(mutex_);
+    for (i=0; i<numSubscribers_; i++) {
+        if (subscribers_[i] == event) {
+            subscribers_[i] = subscribers_[--numSubscribers_];
+            break;
+        }
+    }
+    epicsMutexUnlock(mutex_);
+}
+
+/** The caller must have taken mutex_ */
+void simTriggerSource::signalSubscribers()
+{
+    int i;
+
+    for (i=0; i<numSubscribers_; i++) epicsEventSignal(subscribers_[i]);
+}
+
+/** Fires an edge now */
+void simTriggerSource::fire()
+{
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    fire(&now);
+}
+
+/** Fires an edge.
+  * \param[in] pTime The time of the edge, which the detectors use as the time stamp of the frames it starts. */
+void simTriggerSource::fire(const epicsTimeStamp *pTime)
+{
+    epicsMutexLock(mutex_);
+    count_++;
+    time_ = *pTime;
+    signalSubscribers();
+    epicsMutexUnlock(mutex_);
+}
+
+/** Returns the number of edges so far.
+  * \param[out] pTime The time of the last edge. */
+epicsUInt32 simTriggerSource::lastEdge(epicsTimeStamp *pTime)
+{
+    epicsUInt32 count;
+
+    epicsMutexLock(mutex_);
+    count = count_;
+    *pTime = time_;
+    epicsMutexUnlock(mutex_);
+    return count;
+}
+
+void simTriggerSource::setGate(bool open)
+{
+    epicsMutexLock(mutex_);
+    gate_ = open;
+    signalSubscribers();
+    epicsMutexUnlock(mutex_);
+}
+
+bool simTriggerSource::gateOpen()
+{
+    bool open;
+
+    epicsMutexLock(mutex_);
+    open = gate_;
+    epicsMutexUnlock(mutex_);
+    return open;
+}
+
+/** Sets the period of the timer, which fires the first edge one period from now.
+  * \param[in] period The period in seconds, or 0 to stop the timer. */
+void simTriggerSource::setPeriod(double period)
+{
+    char threadName[32];
+    bool startTimer;
+
+    if (period < 0.) period = 0.;
+    epicsMutexLock(mutex_);
+    period_ = period;
+    startTimer = (period > 0.) && !timerStarted_;
+    if (startTimer) timerStarted_ = true;
+    epicsMutexUnlock(mutex_);
+    if (startTimer) {
+        epicsSnprintf(threadName, sizeof(threadName), "SimTrigger%s", name_);
+        if (epicsThreadCreate(threadName,
+                              epicsThreadPriorityHigh,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              (EPICSTHREADFUNC)timerTaskC,
+                              this) == NULL) {
+            printf("simTriggerSource:setPeriod: epicsThreadCreate failure for %s\n", name_);
+        }
+    } else {
+        epicsEventSignal(wakeEvent_);
+    }
+}
+
+double simTriggerSource::period()
+{
+    double period;
+
+    epicsMutexLock(mutex_);
+    period = period_;
+    epicsMutexUnlock(mutex_);
+    return period;
+}
+
+/** Timer thread; fires an edge every period.  The edges are time stamped with the times they are scheduled for,
+  * so every subscriber sees the same time for an edge whatever the latency of this thread. */
+void simTriggerSource::timerTask()
+{
+    epicsTimeStamp next, now;
+    double period, remaining;
+
+    epicsTimeGetCurrent(&next);
+    epicsTimeAddSeconds(&next, this->period());
+    while (1) {
+        period = this->period();
+        if (period <= 0.) {
+            epicsEventWait(wakeEvent_);
+            epicsTimeGetCurrent(&next);
+            epicsTimeAddSeconds(&next, this->period());
+            continue;
+        }
+        epicsTimeGetCurrent(&now);
+        remaining = epicsTimeDiffInSeconds(&next, &now);
+        if (remaining > 0.) {
+            if (epicsEventWaitWithTimeout(wakeEvent_, remaining) == epicsEventWaitOK) {
+                /* The period has changed */
+                epicsTimeGetCurrent(&next);
+                epicsTimeAddSeconds(&next, this->period());
+                continue;
+            }
+        }
+        fire(&next);
+        epicsTimeAddSeconds(&next, period);
+        /* Restart the schedule rather than firing a series of late edges */
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(&now, &next) > period) {
+            next = now;
+            epicsTimeAddSeconds(&next, period);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/* simTrigger.h
+ *
+ * Trigger sources shared by the simDetector drivers of an IOC, which emulate an external timing system.
+ *
+ */
+
+#ifndef SIM_TRIGGER_H
+#define SIM_TRIGGER_H
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+/** A named source of trigger edges and of a gate.  The edges come from a periodic timer, or are fired by software,
+  * and every detector which subscribes to the source sees the same edges with the same time stamps.
+  * Sources are created on first use and are never deleted.  The methods are thread safe. */
+class simTriggerSource {
+public:
+    static simTriggerSource *find(const char *name);
+    const char *name() const { return name_; }
+    void subscribe(epicsEventId event);
+    void unsubscribe(epicsEventId event);
+    void fire();
+    void fire(const epicsTimeStamp *pTime);
+    epicsUInt32 lastEdge(epicsTimeStamp *pTime);
+    void setGate(bool open);
+    bool gateOpen();
+    void setPeriod(double period);
+    double period();
+    void timerTask(); /**< Should be private, but gets called from C, so must be public */
+
+private:
+    simTriggerSource(const char *name);
+    void signalSubscribers();
+
+    char *name_;
+    epicsMutexId mutex_;
+    epicsEventId wakeEvent_;   /**< Wakes the timer when the period changes */
+    epicsEventId *subscribers_;
+    int numSubscribers_;
+    epicsUInt32 count_;        /**< Number of edges so far */
+    epicsTimeStamp time_;      /**< Time of the last edge */
+    bool gate_;
+    double period_;            /**< Period of the timer in seconds, or 0 if it is stopped */
+    bool timerStarted_;
+    simTriggerSource *pNext_;
+};
+
+#endif
@@ -0,0 +1,144 @@
+/* simWorkerPool.cpp
+ *
+ * A pool of threads used by the simDetector driver to compute parts of an image in parallel.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsStdio.h>
+
+#include "simWorkerPool.h"
+
+typedef struct {
+    simWorkerPool *pPool;
+    int worker;
+} simWorkerArgs;
+
+static void workerTaskC(void *drvPvt)
+{
+    simWorkerArgs *pArgs = (simWorkerArgs *)drvPvt;
+
+    pArgs->pPool->workerTask(pArgs->worker);
+}
+
+/** Constructor for simWorkerPool.
+  * \param[in] name Base name for the worker threads.
+  * \param[in] numThreads The maximum number of threads working on a job, including the caller of run().
+  */
+simWorkerPool::simWorkerPool(const char *name, int numThreads)
+    : numWorkers_(0), startEvents_(0), func_(0), pvt_(0), numTasks_(0), nextTask_(0), numActive_(0),
+      affinityEpoch_(0)
+{
+    char threadName[32];
+    simWorkerArgs *pArgs;
+    int i;
+
+    runMutex_ = epicsMutexMustCreate();
+    taskMutex_ = epicsMutexMustCreate();
+    doneEvent_ = epicsEventMustCreate(epicsEventEmpty);
+    if (numThreads < 2) return;
+    startEvents_ = (epicsEventId *)calloc(numThreads-1, sizeof(epicsEventId));
+    for (i=0; i<numThreads-1; i++) {
+        startEvents_[i] = epicsEventMustCreate(epicsEventEmpty);
+        pArgs = (simWorkerArgs *)malloc(sizeof(simWorkerArgs));
+        pArgs->pPool = this;
+        pArgs->worker = i;
+        epicsSnprintf(threadName, sizeof(threadName), "%s%d", name, i);
+        if (epicsThreadCreate(threadName,
+                              epicsThreadPriorityMedium,
+                              epicsThreadGetStackSize(epicsThreadStackMedium),
+                              (EPICSTHREADFUNC)workerTaskC,
+                              pArgs) == NULL) {
+            printf("simWorkerPool: epicsThreadCreate failure for %s\n", threadName);
+            free(pArgs);
+            break;
+        }
+        numWorkers_++;
+    }
+}
+
+/** Returns the maximum number of threads that can work on a job, including the caller of run() */
+int simWorkerPool::getMaxThreads()
+{
+    return numWorkers_ + 1;
+}
+
+/** Picks up tasks until there are none left */
+void simWorkerPool::doTasks()
+{
+    int task;
+
+    while (1) {
+        epicsMutexLock(taskMutex_);
+        task = nextTask_++;
+        epicsMutexUnlock(taskMutex_);
+        if (task >= numTasks_) break;
+        func_(pvt_, task, numTasks_);
+    }
+}
+
+/** Runs a job and waits for it to complete.  The pool runs one job at a time; a job which is run while another
+  * one is running is done by the calling thread alone.
+  * \param[in] func Function called once for each task.
+  * \param[in] pvt Pointer passed to func.
+  * \param[in] numTasks Number of tasks the job is split into.
+  * \param[in] numThreads Number of threads to use, including the calling thread.
+  */
+void simWorkerPool::run(simWorkFunction func, void *pvt, int numTasks, int numThreads)
+{
+    int i;
+
+    if (numThreads > numWorkers_ + 1) numThreads = numWorkers_ + 1;
+    if (numThreads > numTasks) numThreads = numTasks;
+    /* A caller which finds the pool busy, such as another render thread, does its tasks itself */
+    if ((numThreads <= 1) || (epicsMutexTryLock(runMutex_) != epicsMutexLockOK)) {
+        for (i=0; i<numTasks; i++) func(pvt, i, numTasks);
+        return;
+    }
+    func_ = func;
+    pvt_ = pvt;
+    numTasks_ = numTasks;
+    nextTask_ = 0;
+    numActive_ = numThreads - 1;
+    for (i=0; i<numThreads-1; i++) {
+        epicsEventSignal(startEvents_[i]);
+    }
+    doTasks();
+    epicsEventWait(doneEvent_);
+    epicsMutexUnlock(runMutex_);
+}
+
+/** Sets the CPUs that the workers run on.  Each worker applies them itself before its next job.
+  * \param[in] pCpus The CPUs; an empty set lets the workers run on any CPU. */
+void simWorkerPool::setAffinity(const simCpuSet *pCpus)
+{
+    /* No job is running while the mutex is held, so the workers are not reading cpus_ */
+    epicsMutexLock(runMutex_);
+    cpus_ = *pCpus;
+    affinityEpoch_++;
+    epicsMutexUnlock(runMutex_);
+}
+
+/** Worker thread; waits for a job and helps with its tasks */
+void simWorkerPool::workerTask(int worker)
+{
+    int affinityEpoch = 0;
+    bool done;
+
+    while (1) {
+        epicsEventWait(startEvents_[worker]);
+        if (affinityEpoch != affinityEpoch_) {
+            affinityEpoch = affinityEpoch_;
+            if (cpus_.apply()) printf("simWorkerPool: unable to set the CPUs of worker %d\n", worker);
+        }
+        doTasks();
+        epicsMutexLock(taskMutex_);
+        done = (--numActive_ == 0);
+        epicsMutexUnlock(taskMutex_);
+        if (done) epicsEventSignal(doneEvent_);
+    }
+}
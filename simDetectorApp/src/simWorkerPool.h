@@ -0,0 +1,61 @@
+/* simWorkerPool.h
+ *
+ * A pool of threads used by the simDetector driver to compute parts of an image in parallel.
+ *
+ */
+
+#ifndef SIM_WORKER_POOL_H
+#define SIM_WORKER_POOL_H
+
+#include <stddef.h>
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+#include "simAffinity.h"
+
+/** Function executed for each task; task runs from 0 to numTasks-1 */
+typedef void (*simWorkFunction)(void *pvt, int task, int numTasks);
+
+/** Pool of worker threads.  run() splits a job into tasks that are picked up by the workers and
+  * by the calling thread, and returns when all tasks are complete. */
+class simWorkerPool {
+public:
+    simWorkerPool(const char *name, int numThreads);
+    int getMaxThreads();
+    void run(simWorkFunction func, void *pvt, int numTasks, int numThreads);
+    void setAffinity(const simCpuSet *pCpus);
+    void workerTask(int worker); /**< Should be private, but gets called from C, so must be public */
+
+private:
+    void doTasks();
+
+    int numWorkers_;           /**< Number of threads in the pool, not counting the caller of run() */
+    epicsEventId *startEvents_;
+    epicsEventId doneEvent_;
+    epicsMutexId runMutex_;
+    epicsMutexId taskMutex_;   /**< Protects nextTask_ and numActive_ */
+    simWorkFunction func_;
+    void *pvt_;
+    int numTasks_;
+    int nextTask_;
+    int numActive_;
+    simCpuSet cpus_;           /**< CPUs the workers run on */
+    int affinityEpoch_;        /**< Incremented when cpus_ changes */
+};
+
+/** Computes the range of rows [*firstRow, *lastRow) handled by one task */
+inline void simRowBand(int task, int numTasks, int numRows, int *firstRow, int *lastRow)
+{
+    *firstRow = (int)(((double)task * numRows) / numTasks);
+    *lastRow  = (int)(((double)(task+1) * numRows) / numTasks);
+}
+
+/** Computes the range of array elements [*first, *last) handled by one task */
+inline void simElementBand(int task, int numTasks, size_t numElements, size_t *first, size_t *last)
+{
+    *first = (size_t)(((double)task * numElements) / numTasks);
+    *last  = (size_t)(((double)(task+1) * numElements) / numTasks);
+}
+
+#endif